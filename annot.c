@@ -0,0 +1,443 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, annotation files
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Labels, comments and directives for an image, kept in a file of their
+ * own so annotations can be handed around without the object code:
+ *
+ *    ; a comment about the file
+ *    LABEL 0x0139 main_loop
+ *    COMMENT 0x0139 waits for the A button
+ *    ENTRY0xe100
+ *    FONT8,0x473,0x180
+ *
+ * Anything other than LABEL and COMMENT is a directive, just as it would
+ * be given on the command line, and is applied before the command line's.
+ * An address can have any number of comments; they're listed in order.
+ *
+ * The file is turned into an index laid out like the binary export, so it
+ * can be mmap'ed and used in place: an annot_header_type, the records
+ * sorted by address (then LABEL before COMMENT, then file order), the
+ * directives in file order, and the string table. A text file is built
+ * into the same layout in memory; --compile-annotations writes it out, and
+ * a compiled file is mapped straight in. Every lookup is a binary search.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lcdis.h"
+
+struct annot_s
+{
+   unsigned char *     base;   // the whole index, as annot_header_type describes
+   size_t              size;
+   size_t              maplen; // mmap'ed (or 0: malloc'ed)
+   annot_record_type * records;
+   int                 nrecords;
+   uint32_t *          dirs;   // directives: string offsets
+   char **             dirlist;// ...as pointers, for lcdis_option
+   int                 ndirs;
+   char *              strings;
+};
+
+typedef struct
+{
+   annot_record_type r;
+   int               seq;      // line in the file, to keep comments in order
+} parsed_type;
+
+
+static int by_addr (const void * a, const void * b)
+{
+   const parsed_type * x = (const parsed_type *) a;
+   const parsed_type * y = (const parsed_type *) b;
+
+   if (x->r.addr != y->r.addr)
+      return (x->r.addr < y->r.addr) ? -1 : 1;
+   if (x->r.kind != y->r.kind)
+      return (x->r.kind < y->r.kind) ? -1 : 1;
+   return x->seq - y->seq;
+}
+
+
+// Appends s (n bytes) and a NUL to the string table being built.
+//
+// Returns: its offset, or -1 if out of memory
+
+static long add_string (char ** strings, size_t * len, size_t * room, const char * s, size_t n)
+{
+   char * p;
+   long at = *len;
+
+   while (*len + n + 1 > *room)
+   {  *room = *room ? *room * 2 : 0x1000;
+      if ((p = (char *) realloc (*strings, *room)) == NULL)
+         return -1;
+      *strings = p;
+   }
+   memcpy (*strings + *len, s, n);
+   (*strings)[*len + n] = 0;
+   *len += n + 1;
+   return at;
+}
+
+
+// Points a's fields into a->base, checking everything in the header is
+// inside it and the strings are terminated.
+//
+// Returns: 0=ok
+//          1=not an index, or broken
+
+static int attach (annot_type * a)
+{
+   annot_header_type * h = (annot_header_type *) a->base;
+   int i;
+
+   if (   (a->size < sizeof (annot_header_type)) || memcmp (h->magic, ANNOT_MAGIC, 4)
+       || (h->version != ANNOT_VERSION)
+       || (h->records.offset    > a->size) || (h->records.count    > (a->size - h->records.offset) / sizeof (annot_record_type))
+       || (h->directives.offset > a->size) || (h->directives.count > (a->size - h->directives.offset) / sizeof (uint32_t))
+       || (h->strings.offset    > a->size) || (h->strings.count    > a->size - h->strings.offset)
+       || (h->strings.count == 0) || a->base[h->strings.offset + h->strings.count - 1])
+      return 1;
+   a->records  = (annot_record_type *) (a->base + h->records.offset);
+   a->nrecords = h->records.count;
+   a->dirs     = (uint32_t *) (a->base + h->directives.offset);
+   a->ndirs    = h->directives.count;
+   a->strings  = (char *) (a->base + h->strings.offset);
+   for (i=0; i<a->nrecords; i++)
+      if (a->records[i].text >= h->strings.count)
+         return 1;
+   if ((a->dirlist = (char **) malloc ((a->ndirs + 1) * sizeof (char *))) == NULL)
+      return 1;
+   for (i=0; i<a->ndirs; i++)
+   {  if (a->dirs[i] >= h->strings.count)
+         return 1;
+      a->dirlist[i] = a->strings + a->dirs[i];
+   }
+   return 0;
+}
+
+
+// Builds the index for the annotation text (NUL-terminated) into
+// a->base. Lines that make no sense get a warning in the listing.
+//
+// Returns: 0=ok
+//          1=out of memory
+
+static int parse (lcdis_type * ctx, annot_type * a, char * text, char * filename)
+{
+   parsed_type * recs=NULL;
+   uint32_t * dirs=NULL;
+   char * strings=NULL;
+   size_t slen=0, sroom=0;
+   int nrecs=0, recroom=0, ndirs=0, dirroom=0;
+   int line=0, kind, addr, i, n;
+   char * p, * next, * word, * end;
+   long at;
+   annot_header_type * h;
+   void * grown;
+   int failed=0;
+
+   failed = add_string (&strings, &slen, &sroom, "", 0) < 0;   // so the table is never empty
+   for (p=text; p && *p && !failed; p=next)
+   {
+      line++;
+      if ((next = strchr (p, '\n')) != NULL)
+         *next++ = 0;
+      for (end=p+strlen(p); (end > p) && isspace ((unsigned char) end[-1]); )
+         *--end = 0;
+      while (isspace ((unsigned char) *p))
+         p++;
+      if ((*p == 0) || (*p == ';') || (*p == '#'))
+         continue;
+
+      for (word=p; *p && !isspace ((unsigned char) *p); p++)
+         ;
+      n = p - word;
+      while (isspace ((unsigned char) *p))
+         p++;
+      kind = ((n == 5) && (strncmp (word, "LABEL", 5) == 0))   ? ANNOT_LABEL
+           : ((n == 7) && (strncmp (word, "COMMENT", 7) == 0)) ? ANNOT_COMMENT
+           : -1;
+
+      if (kind < 0)                                  // a directive
+      {  if (*p)
+         {  out_printf (&ctx->out, "WARNING: %s line %d: directives can't have spaces in them.\n", filename, line);
+            continue;
+         }
+         if ((at = add_string (&strings, &slen, &sroom, word, n)) < 0)
+            failed = 1;
+         else
+         if (ndirs == dirroom)
+         {  dirroom = dirroom ? dirroom * 2 : 64;
+            if ((grown = realloc (dirs, dirroom * sizeof (uint32_t))) == NULL)
+               failed = 1;
+            else
+               dirs = (uint32_t *) grown;
+         }
+         if (!failed)
+            dirs[ndirs++] = at;
+         continue;
+      }
+
+      addr = (int) strtol (p, &end, 0);
+      if ((end == p) || (addr < 0) || (addr > 0xFFFF) || (*end && !isspace ((unsigned char) *end)))
+      {  out_printf (&ctx->out, "WARNING: %s line %d: cannot parse address. Must use decimal or 0x notation.\n", filename, line);
+         continue;
+      }
+      for (p=end; isspace ((unsigned char) *p); p++)
+         ;
+      n = strlen (p);
+      if ((kind == ANNOT_LABEL) && ((n == 0) || strpbrk (p, " \t")))
+      {  out_printf (&ctx->out, "WARNING: %s line %d: a label is one word.\n", filename, line);
+         continue;
+      }
+      if ((at = add_string (&strings, &slen, &sroom, p, n)) < 0)
+         failed = 1;
+      else
+      if (nrecs == recroom)
+      {  recroom = recroom ? recroom * 2 : 256;
+         if ((grown = realloc (recs, recroom * sizeof (parsed_type))) == NULL)
+            failed = 1;
+         else
+            recs = (parsed_type *) grown;
+      }
+      if (failed)
+         break;
+      recs[nrecs].r.addr = addr;
+      recs[nrecs].r.kind = kind;
+      recs[nrecs].r.text = at;
+      recs[nrecs].seq    = line;
+      nrecs++;
+   }
+   if (!failed)
+      qsort (recs, nrecs, sizeof (parsed_type), by_addr);
+
+   // header, records, directives and strings, each 4-byte aligned
+   a->size = sizeof (annot_header_type) + nrecs * sizeof (annot_record_type)
+           + ndirs * sizeof (uint32_t) + ((slen + 3) & ~3);
+   if (failed || ((a->base = (unsigned char *) calloc (a->size, 1)) == NULL))
+   {  free (recs);
+      free (dirs);
+      free (strings);
+      return 1;
+   }
+   h = (annot_header_type *) a->base;
+   memcpy (h->magic, ANNOT_MAGIC, 4);
+   h->version            = ANNOT_VERSION;
+   h->records.offset     = sizeof (annot_header_type);
+   h->records.count      = nrecs;
+   h->directives.offset  = h->records.offset + nrecs * sizeof (annot_record_type);
+   h->directives.count   = ndirs;
+   h->strings.offset     = h->directives.offset + ndirs * sizeof (uint32_t);
+   h->strings.count      = slen;
+   for (i=0; i<nrecs; i++)
+      ((annot_record_type *) (a->base + h->records.offset))[i] = recs[i].r;
+   if (ndirs)
+      memcpy (a->base + h->directives.offset, dirs, ndirs * sizeof (uint32_t));
+   memcpy (a->base + h->strings.offset, strings, slen);
+   failed = attach (a);
+
+   free (recs);
+   free (dirs);
+   free (strings);
+   return failed;
+}
+
+
+// Loads an annotation file, text or compiled, in place of any loaded
+// before. Its directives are annot_directives.
+//
+// Returns: 0=loaded
+//          1=can't open or read it, or it's a broken index (after a warning)
+
+int annot_load (lcdis_type * ctx, char * filename)
+{
+   annot_type * a;
+   struct stat st;
+   char * text, * grown;
+   int fd, n;
+   size_t got, room;
+   int failed=1;
+
+   annot_free (ctx);
+   if ((fd = open (filename, O_RDONLY)) < 0)
+      return 1;
+   if (   (fstat (fd, &st) != 0)
+       || ((a = (annot_type *) calloc (1, sizeof (annot_type))) == NULL))
+   {  close (fd);
+      return 1;
+   }
+
+   a->size = st.st_size;
+   a->base = (unsigned char *) MAP_FAILED;
+   if (S_ISREG (st.st_mode) && (a->size >= sizeof (annot_header_type)))
+      a->base = (unsigned char *) mmap (NULL, a->size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if ((a->base != MAP_FAILED) && (memcmp (a->base, ANNOT_MAGIC, 4) == 0))
+   {  a->maplen = a->size;                 // a compiled index: use it where it is
+      if ((failed = attach (a)) != 0)
+         out_printf (&ctx->out, "WARNING: %s is a broken annotation index.\n", filename);
+   }
+   else
+   {  if (a->base != MAP_FAILED)
+         munmap (a->base, a->size);
+      a->base = NULL;
+      a->size = 0;
+      text = NULL;
+      room = got = 0;
+      do                                   // read it all (it may be a pipe)
+      {  if (got + 1 >= room)
+         {  room = room ? room * 2 : 0x20000;
+            if ((grown = (char *) realloc (text, room)) == NULL)
+            {  n = -1;
+               break;
+            }
+            text = grown;
+         }
+         if ((n = read (fd, text + got, room - 1 - got)) > 0)
+            got += n;
+      } while (n > 0);
+      if (n == 0)
+      {  text[got] = 0;
+         failed = parse (ctx, a, text, filename);
+      }
+      free (text);
+   }
+   close (fd);
+
+   ctx->annot = a;
+   if (failed)
+      annot_free (ctx);
+   return failed;
+}
+
+
+// Writes the index out (for annot_load to map straight in next time).
+//
+// Returns: 0=ok
+//          1=couldn't
+
+int annot_save (lcdis_type * ctx, char * filename)
+{
+   annot_type * a = ctx->annot;
+   out_type o;
+   int fd;
+   int failed;
+
+   if ((a == NULL) || ((fd = open (filename, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0))
+      return 1;
+   if (out_open (&o, fd))
+   {  close (fd);
+      return 1;
+   }
+   out_mem (&o, (char *) a->base, a->size);
+   out_flush (&o);
+   failed = o.error;
+   out_close (&o);
+   close (fd);
+   return failed;
+}
+
+
+void annot_free (lcdis_type * ctx)
+{
+   annot_type * a = ctx->annot;
+
+   if (a == NULL)
+      return;
+   if (a->base && a->maplen)
+      munmap (a->base, a->maplen);
+   else
+      free (a->base);
+   free (a->dirlist);
+   free (a);
+   ctx->annot = NULL;
+}
+
+
+// Returns: how many directives the file had (*list points at them)
+
+int annot_directives (lcdis_type * ctx, char *** list)
+{
+   if (ctx->annot == NULL)
+      return 0;
+   *list = ctx->annot->dirlist;
+   return ctx->annot->ndirs;
+}
+
+
+// Returns: the first record at or after addr (nrecords if none)
+
+static int first_at (annot_type * a, int addr)
+{
+   int lo=0, hi=a->nrecords, mid;
+
+   while (lo < hi)
+   {  mid = (lo + hi) / 2;
+      if ((int) a->records[mid].addr < addr)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+
+// Returns: the annotated label at addr, or NULL
+
+char * annot_label (lcdis_type * ctx, int addr)
+{
+   annot_type * a = ctx->annot;
+   int i;
+
+   if (a == NULL)
+      return NULL;
+   i = first_at (a, addr);
+   if ((i < a->nrecords) && ((int) a->records[i].addr == addr) && (a->records[i].kind == ANNOT_LABEL))
+      return a->strings + a->records[i].text;
+   return NULL;
+}
+
+
+// Returns: the first annotated address at or after addr (dis_data starts a
+//          new line there), or -1 if none
+
+int annot_next (lcdis_type * ctx, int addr)
+{
+   annot_type * a = ctx->annot;
+   int i;
+
+   if (a == NULL)
+      return -1;
+   i = first_at (a, addr);
+   return (i < a->nrecords) ? (int) a->records[i].addr : -1;
+}
+
+
+// "      ;text" for each comment on an address in [pin,end)
+
+void annot_comments (lcdis_type * ctx, int pin, int end)
+{
+   annot_type * a = ctx->annot;
+   int i;
+
+   if (a == NULL)
+      return;
+   for (i=first_at (a, pin); (i < a->nrecords) && ((int) a->records[i].addr < end); i++)
+      if (a->records[i].kind == ANNOT_COMMENT)
+      {  out_str (&ctx->out, "      ;");
+         out_str (&ctx->out, a->strings + a->records[i].text);
+      }
+}
@@ -0,0 +1,425 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, batch mode
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Disassembles a whole collection of images, writing one listing per image.
+ * The images are spread over a fixed pool of threads. Every thread starts
+ * with its own share of the list and, once that runs dry, steals from the
+ * other threads, so one huge BIOS image doesn't leave the rest idle.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "lcdis.h"
+
+// One worker's queue. The owner takes from the tail, thieves from the head,
+// so they only fight over the last item.
+typedef struct
+{
+   int *  items;               // indices into batch_type.inputs
+   int    head, tail;          // items[head..tail-1] are still to do
+   pthread_mutex_t lock;
+} deque_type;
+
+typedef struct batch_s batch_type;
+
+typedef struct
+{
+   batch_type *  batch;
+   int           id;
+   lcdis_type *  ctx;          // reused for every image this worker does
+   int           unreadable;
+   int           unwritable;
+   int           failed;
+   double        bytes;
+} worker_type;
+
+struct batch_s
+{
+   char **       inputs;
+   int           ninputs;
+   char **       names;        // each input's output name (see name_outputs)
+   char *        outdir;
+   char **       options;
+   int           noptions;
+   int           exports;      // EXPORT_xxx files to write next to each listing
+   int           stats;        // STATS_xxx to print to stderr for each image, 0=none
+   int           nworkers;
+   deque_type *  deques;
+   worker_type * workers;
+};
+
+
+static double now (void)
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// is this a file name we disassemble when given a directory? (.vms and .bin)
+static int image_name (char * name)
+{
+   char * ext;
+
+   ext = strrchr (name, '.');
+   if (ext == NULL)
+      return 0;
+   return (   (tolower(ext[1])=='v' && tolower(ext[2])=='m' && tolower(ext[3])=='s' && ext[4]==0)
+           || (tolower(ext[1])=='b' && tolower(ext[2])=='i' && tolower(ext[3])=='n' && ext[4]==0));
+}
+
+
+static void add_input (batch_type * b, int * room, char * path)
+{
+   if (b->ninputs == *room)
+   {  *room = *room ? *room * 2 : 64;
+      b->inputs = (char **) realloc (b->inputs, *room * sizeof (char *));
+   }
+   b->inputs[b->ninputs++] = strdup (path);
+}
+
+
+// source is either a directory (every .vms/.bin file in it) or a text file
+// with one image path per line.
+//
+// Returns: 0=ok
+//          1=can't read source
+
+static int collect_inputs (batch_type * b, char * source)
+{
+   struct stat st;
+   DIR * dir;
+   struct dirent * de;
+   FILE * fin;
+   char path[4096];
+   int room=0;
+   int len;
+
+   if (stat (source, &st) != 0)
+      return 1;
+
+   if (S_ISDIR (st.st_mode))
+   {
+      if ((dir = opendir (source)) == NULL)
+         return 1;
+      while ((de = readdir (dir)) != NULL)
+      {
+         if (!image_name (de->d_name))
+            continue;
+         snprintf (path, sizeof (path), "%s/%s", source, de->d_name);
+         if (stat (path, &st) == 0 && S_ISREG (st.st_mode))
+            add_input (b, &room, path);
+      }
+      closedir (dir);
+   }
+   else
+   {
+      if ((fin = fopen (source, "r")) == NULL)
+         return 1;
+      while (fgets (path, sizeof (path), fin))
+      {
+         len = strlen (path);
+         while (len && isspace ((unsigned char) path[len-1]))
+            path[--len] = 0;
+         if (len)
+            add_input (b, &room, path);
+      }
+      fclose (fin);
+   }
+   return 0;
+}
+
+
+static char * base_name (char * path)
+{
+   char * base;
+
+   base = strrchr (path, '/');
+   return base ? base+1 : path;
+}
+
+
+typedef struct
+{
+   char * base;                // the input's file name
+   int    item;                //    and where it is in the list
+} named_type;
+
+static int by_name (const void * x, const void * y)
+{
+   const named_type * a = (const named_type *) x;
+   const named_type * b = (const named_type *) y;
+   int c;
+
+   c = strcmp (a->base, b->base);
+   return c ? c : a->item - b->item;
+}
+
+
+// Names each input's output files after its file name. Inputs from a list
+// file can share one (a/game.vms, b/game.vms), and their workers would
+// write over each other, so the second and later get ".2", ".3", ... in
+// list order: game.vms.lst, game.vms.2.lst.
+//
+// Returns: 0=ok
+//          1=out of memory
+
+static int name_outputs (batch_type * b)
+{
+   named_type * order;
+   char * name;
+   int i, n=1;
+
+   b->names = (char **) calloc (b->ninputs + 1, sizeof (char *));
+   order    = (named_type *) malloc ((b->ninputs + 1) * sizeof (named_type));
+   if (!b->names || !order)
+   {  free (order);
+      return 1;
+   }
+   for (i=0; i<b->ninputs; i++)
+   {  order[i].base = base_name (b->inputs[i]);
+      order[i].item = i;
+   }
+   qsort (order, b->ninputs, sizeof (named_type), by_name);
+
+   for (i=0; i<b->ninputs; i++)
+   {
+      n = (i && !strcmp (order[i].base, order[i-1].base)) ? n+1 : 1;
+      if ((name = (char *) malloc (strlen (order[i].base) + 12)) == NULL)
+      {  free (order);
+         return 1;
+      }
+      if (n == 1)
+         strcpy (name, order[i].base);
+      else
+         sprintf (name, "%s.%d", order[i].base, n);
+      b->names[order[i].item] = name;
+   }
+   free (order);
+   return 0;
+}
+
+
+// listing name: outdir/<output name>.lst (or .json, .lcx for the exports)
+static void listing_name (char * out, int size, batch_type * b, int item, char * ext)
+{
+   snprintf (out, size, "%s/%s.%s", b->outdir, b->names[item], ext);
+}
+
+
+// Writes the analysis of the image just done as an EXPORT_xxx file.
+//
+// Returns: 0=ok
+//          1=couldn't
+
+static int export_one (worker_type * w, int item, int format)
+{
+   batch_type * b = w->batch;
+   char outname[4096];
+   int fd;
+   int failed;
+
+   listing_name (outname, sizeof (outname), b, item, (format == EXPORT_BINARY) ? "lcx" : "json");
+   if ((fd = open (outname, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0)
+      return 1;
+   failed = lcdis_export (w->ctx, fd, format);
+   close (fd);
+   return failed;
+}
+
+
+static void run_one (worker_type * w, int item)
+{
+   batch_type * b = w->batch;
+   lcdis_type * ctx = w->ctx;
+   char outname[4096];
+   int fd;
+   int i;
+
+   listing_name (outname, sizeof (outname), b, item, "lst");
+   if ((fd = open (outname, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0)
+   {  w->unwritable++;
+      return;
+   }
+   out_set_fd (&ctx->out, fd);
+
+   lcdis_reset (ctx);
+   lcdis_banner (ctx);
+   if (lcdis_load (ctx, b->inputs[item]))
+      w->unreadable++;
+   else
+   {
+      for (i=0; i<b->noptions; i++)
+         lcdis_option (ctx, b->options[i]);
+      lcdis_map (ctx);
+      if (ctx->gaveup)        // the error is at the end of the listing
+         w->failed++;
+      else
+      {  lcdis_listing (ctx);
+         if (   ((b->exports & EXPORT_JSON)   && export_one (w, item, EXPORT_JSON))
+             || ((b->exports & EXPORT_BINARY) && export_one (w, item, EXPORT_BINARY)))
+            w->unwritable++;
+      }
+      w->bytes += ctx->memsize;
+      if (b->stats)
+         stats_print (ctx, 2, b->inputs[item], b->stats);
+   }
+   out_flush (&ctx->out);
+   if (ctx->out.error)
+      w->unwritable++;
+   close (fd);
+   out_set_fd (&ctx->out, -1);   // nothing's waiting, so this just parks it
+}
+
+
+// Returns: next item for worker w, or -1 when there's nothing left anywhere
+
+static int next_item (worker_type * w)
+{
+   batch_type * b = w->batch;
+   deque_type * q;
+   int item=-1;
+   int i;
+
+   q = &b->deques[w->id];             // own work first, newest end
+   pthread_mutex_lock (&q->lock);
+   if (q->tail > q->head)
+      item = q->items[--q->tail];
+   pthread_mutex_unlock (&q->lock);
+
+   for (i=1; (item < 0) && (i < b->nworkers); i++)   // then steal, oldest end
+   {
+      q = &b->deques[(w->id + i) % b->nworkers];
+      pthread_mutex_lock (&q->lock);
+      if (q->tail > q->head)
+         item = q->items[q->head++];
+      pthread_mutex_unlock (&q->lock);
+   }
+   return item;
+}
+
+
+static void * worker (void * arg)
+{
+   worker_type * w = (worker_type *) arg;
+   int item;
+
+   while ((item = next_item (w)) >= 0)
+      run_one (w, item);
+   return NULL;
+}
+
+
+// Disassembles every image in source (see collect_inputs) into outdir,
+// applying the same directives to each. jobs<=0 uses one thread per CPU.
+// exports (EXPORT_xxx bits) adds outdir/<name>.json and/or outdir/<name>.lcx.
+// stats (STATS_xxx) prints each image's --stats to stderr as it's done.
+//
+// Returns: 0=ok (result filled in; individual images may still have failed)
+//          1=can't read source or out of memory
+
+int lcdis_batch (char * source, char * outdir, char ** options, int noptions,
+                 int jobs, int exports, int stats, batch_result_type * result)
+{
+   batch_type b;
+   pthread_t * threads;
+   double start;
+   int i, w, per;
+   int made=0;                // workers set up
+   int failed=0;
+
+   memset (&b, 0, sizeof (b));
+   memset (result, 0, sizeof (*result));
+   if (collect_inputs (&b, source))
+      return 1;
+   if (name_outputs (&b))
+      failed=1;
+   mkdir (outdir, 0777);      // fine if it's already there
+
+   if (jobs <= 0)
+      jobs = (int) sysconf (_SC_NPROCESSORS_ONLN);
+   if (jobs > b.ninputs)
+      jobs = b.ninputs;
+   if (jobs < 1)
+      jobs = 1;
+
+   b.outdir   = outdir;
+   b.options  = options;
+   b.noptions = noptions;
+   b.exports  = exports;
+   b.stats    = stats;
+   b.nworkers = jobs;
+   b.deques   = (deque_type *)  calloc (jobs, sizeof (deque_type));
+   b.workers  = (worker_type *) calloc (jobs, sizeof (worker_type));
+   threads    = (pthread_t *)   calloc (jobs, sizeof (pthread_t));
+
+   // each worker's context is made here and reused for all its images
+   for (w=0; w<jobs && !failed; w++, made++)
+   {
+      per = b.ninputs / jobs + 1;
+      b.deques[w].items = (int *) malloc (per * sizeof (int));
+      pthread_mutex_init (&b.deques[w].lock, NULL);
+      b.workers[w].batch = &b;
+      b.workers[w].id    = w;
+      if ((b.workers[w].ctx = lcdis_new()) == NULL || b.deques[w].items == NULL)
+         failed=1;
+      else
+         b.workers[w].ctx->keepgoing=1;
+   }
+
+   if (!failed)
+   {
+      for (i=0; i<b.ninputs; i++)        // contiguous shares to start with
+      {  w = (int) ((long) i * jobs / b.ninputs);
+         b.deques[w].items[b.deques[w].tail++] = i;
+      }
+
+      start = now();
+      for (w=0; w<jobs; w++)
+         pthread_create (&threads[w], NULL, worker, &b.workers[w]);
+      for (w=0; w<jobs; w++)
+         pthread_join (threads[w], NULL);
+      result->seconds = now() - start;
+
+      result->images = b.ninputs;
+      for (w=0; w<jobs; w++)
+      {  result->unreadable += b.workers[w].unreadable;
+         result->unwritable += b.workers[w].unwritable;
+         result->failed     += b.workers[w].failed;
+         result->bytes      += b.workers[w].bytes;
+      }
+   }
+
+   for (w=0; w<made; w++)
+   {  lcdis_free (b.workers[w].ctx);
+      free (b.deques[w].items);
+      pthread_mutex_destroy (&b.deques[w].lock);
+   }
+   for (i=0; i<b.ninputs; i++)
+   {  free (b.inputs[i]);
+      if (b.names)
+         free (b.names[i]);
+   }
+   free (b.inputs);
+   free (b.names);
+   free (b.deques);
+   free (b.workers);
+   free (threads);
+   return failed;
+}
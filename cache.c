@@ -0,0 +1,302 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, caching the memory map
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Tracing is the slow part of a run, and the same image usually gets run
+ * again and again with the same directives. lcdis_map_cached keeps what
+ * the directives and lcdis_map did to the maps (and what they printed) in
+ * a file named after a hash of the image and a hash of the directives:
+ *
+ *    <cachedir>/<image hash>-<directives hash>.lcc
+ *
+ * Same image, same directives: the maps and the text are loaded and
+ * nothing is traced. The file holds the image and the directives too, and
+ * both are compared in full, so a hash collision is just a miss. Anything
+ * else, even one more ENTRYn, is traced from scratch: ENTRYn points are
+ * traced before the standard entry points, so starting from an earlier
+ * run's maps would not give the same listing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lcdis.h"
+
+#define CACHE_MAGIC      "LCDC"
+#define CACHE_VERSION    4
+
+// flags in cache_header_type.flags
+#define CF_STRICT        1
+#define CF_ASMOUT        2
+#define CF_BIOS          4
+#define CF_FLASH         8
+#define CF_XREF          16
+
+// A cache file: this header, then the directives (each NUL-terminated),
+// the image (memsize bytes, then hisize), mem_use and mem_bnk (mapsize
+// bytes each), ctx->outside, ctx->seen, ctx->effect, and the text that
+// was printed.
+typedef struct
+{
+   char     magic[4];          // CACHE_MAGIC
+   uint32_t version;           // CACHE_VERSION
+   uint64_t imagehash;
+   uint64_t opthash;
+   uint32_t memsize;
+   uint32_t hisize;
+   uint32_t mapsize;
+   uint32_t flags;             // CF_xxx
+   uint32_t noptions;
+   uint32_t optlen;            // bytes of directives
+   uint32_t textlen;           // bytes of text printed
+} cache_header_type;
+
+// A cache file read into memory, with pointers to its parts.
+typedef struct
+{
+   cache_header_type * h;
+   char *          options;
+   unsigned char * image;
+   unsigned char * use;
+   unsigned char * bnk;
+   unsigned char * outside;
+   unsigned char * seen;
+   unsigned char * effect;
+   char *          text;
+} cache_type;
+
+
+// FNV-1a, carried on from h (start with CACHE_HASH_START). server.c keys
+// its images with it too.
+
+uint64_t cache_hash (uint64_t h, const unsigned char * p, size_t n)
+{
+   while (n--)
+   {  h ^= *p++;
+      h *= 0x100000001b3ull;
+   }
+   return h;
+}
+
+
+static uint64_t image_hash (lcdis_type * ctx)
+{
+   uint64_t h = CACHE_HASH_START;
+
+   h = cache_hash (h, ctx->mem, ctx->memsize);
+   if (ctx->hisize)
+      h = cache_hash (h, ctx->hibank, ctx->hisize);
+   return h;
+}
+
+
+static uint64_t options_hash (char ** options, int noptions)
+{
+   uint64_t h = CACHE_HASH_START;
+   int i;
+
+   for (i=0; i<noptions; i++)
+      h = cache_hash (h, (const unsigned char *) options[i], strlen (options[i]) + 1);
+   return h;
+}
+
+
+// Reads a whole cache file for this image.
+//
+// Returns: 0=ok (free c->h afterwards)
+//          1=not there, or not a cache file for this image (the image it
+//            holds isn't byte for byte the one loaded)
+
+static int read_cache (lcdis_type * ctx, char * filename, cache_type * c)
+{
+   struct stat st;
+   cache_header_type * h;
+   size_t need;
+   char * p;
+   int fd;
+   ssize_t n;
+   size_t got=0;
+   uint32_t i;
+
+   if ((fd = open (filename, O_RDONLY)) < 0)
+      return 1;
+   if ((fstat (fd, &st) != 0) || (st.st_size < (off_t) sizeof (cache_header_type))
+       || ((p = (char *) malloc (st.st_size)) == NULL))
+   {  close (fd);
+      return 1;
+   }
+   while ((got < (size_t) st.st_size) && ((n = read (fd, p + got, st.st_size - got)) > 0))
+      got += n;
+   close (fd);
+
+   h = (cache_header_type *) p;
+   need = sizeof (cache_header_type) + (size_t) h->optlen + (size_t) ctx->memsize + (size_t) ctx->hisize
+        + 2 * (size_t) h->mapsize + 0x10000/8 + SEEN_BYTES + 0x10000 + h->textlen;
+   if (   (got != (size_t) st.st_size) || memcmp (h->magic, CACHE_MAGIC, 4)
+       || (h->version != CACHE_VERSION) || (need != got)
+       || (h->memsize != (uint32_t) ctx->memsize) || (h->hisize != (uint32_t) ctx->hisize)
+       || (h->mapsize != (uint32_t) ctx->mapsize))
+   {  free (p);
+      return 1;
+   }
+   for (i=0, n=0; i<h->optlen; i++)            // noptions strings, nothing after
+      n += (p[sizeof (cache_header_type) + i] == 0);
+   if ((n != h->noptions) || (h->optlen && p[sizeof (cache_header_type) + h->optlen - 1]))
+   {  free (p);
+      return 1;
+   }
+
+   c->h       = h;
+   c->options = p + sizeof (cache_header_type);
+   c->image   = (unsigned char *) c->options + h->optlen;
+   c->use     = c->image + ctx->memsize + ctx->hisize;
+   c->bnk     = c->use + h->mapsize;
+   c->outside = c->bnk + h->mapsize;
+   c->seen    = c->outside + 0x10000/8;
+   c->effect  = c->seen + SEEN_BYTES;
+   c->text    = (char *) c->effect + 0x10000;
+   if (   memcmp (c->image, ctx->mem, ctx->memsize)
+       || (ctx->hisize && memcmp (c->image + ctx->memsize, ctx->hibank, ctx->hisize)))
+   {  free (p);
+      return 1;
+   }
+   return 0;
+}
+
+
+// Writes the maps and text of the run just done. The file is written under
+// a temporary name and renamed, so a reader never sees half of one.
+
+static void write_cache (lcdis_type * ctx, char * filename, uint64_t imagehash, uint64_t opthash,
+                         char ** options, int noptions, char * text, int textlen)
+{
+   cache_header_type h;
+   char temp[4096+16];
+   out_type o;
+   int fd;
+   int i;
+
+   memset (&h, 0, sizeof (h));
+   memcpy (h.magic, CACHE_MAGIC, 4);
+   h.version   = CACHE_VERSION;
+   h.imagehash = imagehash;
+   h.opthash   = opthash;
+   h.memsize   = ctx->memsize;
+   h.hisize    = ctx->hisize;
+   h.mapsize   = ctx->mapsize;
+   h.flags     = (ctx->strictmode ? CF_STRICT : 0) | (ctx->asmout ? CF_ASMOUT : 0)
+               | (ctx->biosmode ? CF_BIOS : 0) | (ctx->flashmode ? CF_FLASH : 0)
+               | (ctx->xrefmode ? CF_XREF : 0);
+   h.noptions  = noptions;
+   for (i=0; i<noptions; i++)
+      h.optlen += strlen (options[i]) + 1;
+   h.textlen   = textlen;
+
+   snprintf (temp, sizeof (temp), "%s.%d", filename, (int) getpid ());
+   if ((fd = open (temp, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0)
+      return;
+   if (out_open (&o, fd))
+   {  close (fd);
+      unlink (temp);
+      return;
+   }
+   out_mem (&o, (char *) &h, sizeof (h));
+   for (i=0; i<noptions; i++)
+      out_mem (&o, options[i], strlen (options[i]) + 1);
+   out_mem (&o, (char *) ctx->mem, ctx->memsize);
+   if (ctx->hisize)
+      out_mem (&o, (char *) ctx->hibank, ctx->hisize);
+   out_mem (&o, (char *) ctx->mem_use, ctx->mapsize);
+   out_mem (&o, (char *) ctx->mem_bnk, ctx->mapsize);
+   out_mem (&o, (char *) ctx->outside, 0x10000/8);
+   out_mem (&o, (char *) ctx->seen, SEEN_BYTES);
+   out_mem (&o, (char *) ctx->effect, 0x10000);
+   out_mem (&o, text, textlen);
+   out_close (&o);
+   close (fd);
+   if (o.error || rename (temp, filename))
+      unlink (temp);
+}
+
+
+// Returns: 1 if the cache file's directives are exactly options
+
+static int same_options (cache_type * c, char ** options, int noptions)
+{
+   char * p = c->options;
+   int i;
+
+   if (c->h->noptions != (uint32_t) noptions)
+      return 0;
+   for (i=0; i<noptions; i++)
+   {  if (strcmp (p, options[i]))
+         return 0;
+      p += strlen (p) + 1;
+   }
+   return 1;
+}
+
+
+static void restore_flags (lcdis_type * ctx, uint32_t flags)
+{
+   ctx->strictmode = (flags & CF_STRICT) != 0;
+   ctx->asmout     = (flags & CF_ASMOUT) != 0;
+   ctx->biosmode   = (flags & CF_BIOS)   != 0;
+   ctx->flashmode  = (flags & CF_FLASH)  != 0;
+   ctx->xrefmode   = (flags & CF_XREF)   != 0;
+}
+
+
+// Does what applying options (with lcdis_option) and then lcdis_map would
+// do, using and updating the cache in cachedir (see top of file). The
+// image must be loaded and no other directives applied yet.
+//
+// Returns: 0=done from the cache
+//          1=traced
+
+int lcdis_map_cached (lcdis_type * ctx, char * cachedir, char ** options, int noptions)
+{
+   uint64_t imagehash, opthash;
+   cache_type c;
+   char filename[4096];
+   int i;
+
+   imagehash = image_hash (ctx);
+   opthash   = options_hash (options, noptions);
+   snprintf (filename, sizeof (filename), "%s/%016llx-%016llx.lcc", cachedir,
+             (unsigned long long) imagehash, (unsigned long long) opthash);
+
+   if (!read_cache (ctx, filename, &c) && same_options (&c, options, noptions))
+   {
+      restore_flags (ctx, c.h->flags);
+      memcpy (ctx->mem_use, c.use, ctx->mapsize);
+      memcpy (ctx->mem_bnk, c.bnk, ctx->mapsize);
+      memcpy (ctx->outside, c.outside, 0x10000/8);
+      memcpy (ctx->seen, c.seen, SEEN_BYTES);
+      memcpy (ctx->effect, c.effect, 0x10000);
+      out_mem (&ctx->out, c.text, c.h->textlen);
+      free (c.h);
+      return 0;
+   }
+
+   out_keep (&ctx->out);      // what's printed from here on goes in the cache too
+   for (i=0; i<noptions; i++)
+      lcdis_option (ctx, options[i]);
+   lcdis_map (ctx);
+
+   if (!ctx->gaveup)
+   {  mkdir (cachedir, 0777);      // fine if it's already there
+      write_cache (ctx, filename, imagehash, opthash, options, noptions,
+                   ctx->out.buf + ctx->out.keep, ctx->out.len - ctx->out.keep);
+   }
+   out_release (&ctx->out);
+   return 1;
+}
@@ -0,0 +1,448 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, control-flow graph
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Splits the traced code into basic blocks, joins them with typed edges and
+ * groups them into functions, all in flat arrays indexed by number (see
+ * cfg_type in lcdis.h), so an analysis can walk the graph without tracing
+ * the image again.
+ *
+ * A block starts at a label, at a call/jump/branch target, after any
+ * instruction that changes the flow, and where the code isn't contiguous.
+ * A function starts at every call target, every named code label
+ * (LABELS[], which has the reset and interrupt vectors) and every block
+ * nothing in the graph reaches (an ENTRYn, a computed jump's target), and
+ * owns the blocks reached from there by falling through and branching
+ * without running into another function's start. A block reached from two
+ * functions belongs to the one with the lower address.
+ *
+ * Edges: CFG_FALLTHROUGH to the next block (also after a call, to where
+ * it returns), CFG_BRANCH to the target of a jump or branch, CFG_CALL to
+ * the called function, and CFG_RETURN from every block of a function that
+ * ends in RET/RETI to every place the function returns to.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lcdis.h"
+
+// a growing list of edges, before they are sorted
+typedef struct
+{
+   cfg_edge_type * list;
+   int    n, room;
+} edges_type;
+
+
+static int add_edge (edges_type * e, int from, int to, int kind)
+{
+   cfg_edge_type * p;
+
+   if (e->n == e->room)
+   {  p = (cfg_edge_type *) realloc (e->list, (e->room ? e->room * 2 : 1024) * sizeof (cfg_edge_type));
+      if (p == NULL)
+         return 1;
+      e->list = p;
+      e->room = e->room ? e->room * 2 : 1024;
+   }
+   e->list[e->n].from = from;
+   e->list[e->n].to   = to;
+   e->list[e->n].kind = kind;
+   e->n++;
+   return 0;
+}
+
+
+static int is_code (lcdis_type * ctx, int pin)
+{
+   switch (ctx->mem_use[pin])
+   {
+      case MEM_CODE:
+      case MEM_CODE_LABELED:
+      case MEM_INVALID:
+         return 1;
+   }
+   return 0;
+}
+
+
+// Marks the instruction starts (as the listing shows them) in insn[] and
+// the block leaders in leader[].
+
+static void find_leaders (lcdis_type * ctx, unsigned char * insn, unsigned char * leader)
+{
+   decode_type * d;
+   int pin, target;
+   int next=-1;               // where the instruction before ends, if it falls through
+
+   for (pin=0; (pin>=0) && (pin<ctx->memsize); pin=next_line (ctx, pin))
+      if (is_code (ctx, pin))
+         insn[pin] = 1;
+
+   for (pin=0; (pin>=0) && (pin<ctx->memsize); pin=next_line (ctx, pin))
+   {
+      if (!insn[pin])
+      {  next = -1;
+         continue;
+      }
+      d = &decode[ctx->mem[pin]];
+      if ((pin != next) || (ctx->mem_use[pin] == MEM_CODE_LABELED))
+         leader[pin] = 1;
+      if (d->target != TGT_NONE)
+      {  target = get_target (ctx, pin);
+         if ((target >= 0) && (target < ctx->memsize) && insn[target])
+            leader[target] = 1;
+      }
+      next = (d->flow == FLOW_NEXT) ? pin + d->len : -1;
+      if ((d->flow != FLOW_NEXT) && (pin + d->len < ctx->memsize))
+         leader[pin + d->len] = 1;    // whatever comes next starts a block, if it's code
+   }
+}
+
+
+// Makes the blocks and block_at[].
+//
+// Returns: 0=ok
+//          1=out of memory
+
+static int make_blocks (lcdis_type * ctx, cfg_type * g, unsigned char * insn, unsigned char * leader)
+{
+   cfg_block_type * b = NULL;
+   int pin, room=0;
+   void * p;
+
+   for (pin=0; (pin>=0) && (pin<ctx->memsize); pin=next_line (ctx, pin))
+   {
+      if (!insn[pin])
+      {  b = NULL;
+         continue;
+      }
+      if (leader[pin] || (b == NULL))
+      {
+         if (g->nblocks == room)
+         {  p = realloc (g->blocks, (room ? room * 2 : 1024) * sizeof (cfg_block_type));
+            if (p == NULL)
+               return 1;
+            g->blocks = (cfg_block_type *) p;
+            room = room ? room * 2 : 1024;
+         }
+         b = &g->blocks[g->nblocks++];
+         memset (b, 0, sizeof (cfg_block_type));
+         b->start = pin;
+         b->func  = -1;
+         b->bnk   = ctx->mem_bnk[pin];
+      }
+      b->last = pin;
+      b->end  = pin + decode[ctx->mem[pin]].len;
+      b->ninsns++;
+      b->exit = decode[ctx->mem[pin]].flow;
+   }
+
+   for (pin=0; pin<ctx->memsize; pin++)
+      g->block_at[pin] = -1;
+   for (pin=0; pin<g->nblocks; pin++)
+      for (room=g->blocks[pin].start; (room<g->blocks[pin].end) && (room<ctx->memsize); room++)
+         g->block_at[room] = pin;
+   return 0;
+}
+
+
+// block starting at addr, or -1
+
+static int block_starting (lcdis_type * ctx, cfg_type * g, int addr)
+{
+   int k;
+
+   if ((addr < 0) || (addr >= ctx->memsize) || ((k = g->block_at[addr]) < 0))
+      return -1;
+   return (g->blocks[k].start == addr) ? k : -1;
+}
+
+
+// Every edge but the returns, which need the functions first.
+
+static int local_edges (lcdis_type * ctx, cfg_type * g, edges_type * e)
+{
+   cfg_block_type * b;
+   int k, to, next;
+
+   for (k=0; k<g->nblocks; k++)
+   {
+      b = &g->blocks[k];
+      next = block_starting (ctx, g, b->end);
+      to = (decode[ctx->mem[b->last]].target != TGT_NONE)
+           ? block_starting (ctx, g, get_target (ctx, b->last)) : -1;
+      switch (b->exit)
+      {
+         case FLOW_CALL:
+            if ((to >= 0) && add_edge (e, k, to, CFG_CALL))
+               return 1;
+            break;
+         case FLOW_JUMP:
+         case FLOW_BRANCH:
+            if ((to >= 0) && add_edge (e, k, to, CFG_BRANCH))
+               return 1;
+            break;
+      }
+      if (   ((b->exit == FLOW_NEXT) || (b->exit == FLOW_CALL) || (b->exit == FLOW_BRANCH))
+          && (next >= 0) && add_edge (e, k, next, CFG_FALLTHROUGH))
+         return 1;
+   }
+   return 0;
+}
+
+
+// Finds the function entries and gives each one the blocks it reaches
+// (see top of file).
+//
+// Returns: 0=ok
+//          1=out of memory
+
+static int make_functions (lcdis_type * ctx, cfg_type * g, edges_type * e)
+{
+   unsigned char * entry;
+   int * stack;
+   int * first;               // local edges out of each block: e->list[first[k]..first[k+1]-1]
+   int sp, k, i, f, n;
+
+   entry = (unsigned char *) calloc (g->nblocks + 1, 1);
+   stack = (int *) malloc ((g->nblocks + 1) * sizeof (int));
+   first = (int *) calloc (g->nblocks + 1, sizeof (int));
+   if (!entry || !stack || !first)
+   {  free (entry);
+      free (stack);
+      free (first);
+      return 1;
+   }
+
+   for (i=0; i<e->n; i++)     // local_edges made them in block order
+      first[e->list[i].from + 1]++;
+   for (k=0; k<g->nblocks; k++)
+      first[k+1] += first[k];
+
+   for (i=0; i<e->n; i++)     // 1=called, 2=reached some other way
+      entry[e->list[i].to] |= (e->list[i].kind == CFG_CALL) ? 1 : 2;
+   for (k=0; k<g->nblocks; k++)
+      entry[k] = (entry[k] & 1) || !entry[k] || find_label (g->blocks[k].start);
+   for (k=0, n=0; k<g->nblocks; k++)
+      n += entry[k];
+
+   g->funcs = (cfg_func_type *) calloc (n + 1, sizeof (cfg_func_type));
+   g->func_blocks = (int *) malloc ((g->nblocks + 1) * sizeof (int));
+   if (!g->funcs || !g->func_blocks)
+   {  free (entry);
+      free (stack);
+      free (first);
+      return 1;
+   }
+
+   for (k=0; k<g->nblocks; k++)        // blocks are in address order, so are the functions
+   {
+      if (!entry[k] || (g->blocks[k].func >= 0))
+         continue;
+      f = g->nfuncs++;
+      g->funcs[f].entry = g->blocks[k].start;
+      g->funcs[f].block = k;
+      g->blocks[k].func = f;
+      stack[0] = k;
+      for (sp=1; sp; )
+      {
+         n = stack[--sp];
+         for (i=first[n]; i<first[n+1]; i++)
+            if (   (e->list[i].kind != CFG_CALL)
+                && !entry[e->list[i].to] && (g->blocks[e->list[i].to].func < 0))
+            {  g->blocks[e->list[i].to].func = f;
+               stack[sp++] = e->list[i].to;
+            }
+      }
+   }
+
+   // func_blocks: each function's blocks together, in address order
+   for (k=0; k<g->nblocks; k++)
+      if (g->blocks[k].func >= 0)
+         g->funcs[g->blocks[k].func].count++;
+   for (f=0, n=0; f<g->nfuncs; f++)
+   {  g->funcs[f].first = n;
+      n += g->funcs[f].count;
+      g->funcs[f].count = 0;
+   }
+   for (k=0; k<g->nblocks; k++)
+      if ((f = g->blocks[k].func) >= 0)
+         g->func_blocks[g->funcs[f].first + g->funcs[f].count++] = k;
+
+   free (entry);
+   free (stack);
+   free (first);
+   return 0;
+}
+
+
+// From every RET/RETI block of a function to the fall-through of every
+// call to it.
+
+static int return_edges (cfg_type * g, edges_type * e)
+{
+   int * sites;               // blocks that return to somewhere after a call to the function,
+   int * first;               //    for function f: sites[first[f]..first[f+1]-1]
+   int * fill;
+   int nlocal = e->n;
+   int i, j, f, k, b, site;
+   int failed=0;
+
+   sites = (int *) malloc ((nlocal + 1) * sizeof (int));
+   first = (int *) calloc (g->nfuncs + 1, sizeof (int));
+   fill  = (int *) calloc (g->nfuncs + 1, sizeof (int));
+   if (!sites || !first || !fill)
+   {  free (sites);
+      free (first);
+      free (fill);
+      return 1;
+   }
+
+   // the fall-through after a call block is the edge after its call edge
+   for (i=0; i<nlocal; i++)
+      if ((e->list[i].kind == CFG_CALL) && ((f = g->blocks[e->list[i].to].func) >= 0)
+          && (i+1 < nlocal) && (e->list[i+1].from == e->list[i].from))
+         first[f+1]++;
+   for (f=0; f<g->nfuncs; f++)
+   {  first[f+1] += first[f];
+      fill[f] = first[f];
+   }
+   for (i=0; i<nlocal; i++)
+      if ((e->list[i].kind == CFG_CALL) && ((f = g->blocks[e->list[i].to].func) >= 0)
+          && (i+1 < nlocal) && (e->list[i+1].from == e->list[i].from))
+         sites[fill[f]++] = e->list[i+1].to;
+
+   for (f=0; (f<g->nfuncs) && !failed; f++)
+      for (j=0; (j<g->funcs[f].count) && !failed; j++)
+      {
+         b = g->func_blocks[g->funcs[f].first + j];
+         if (g->blocks[b].exit != FLOW_RETURN)
+            continue;
+         for (k=first[f]; (k<first[f+1]) && !failed; k++)
+         {  site = sites[k];
+            failed = add_edge (e, b, site, CFG_RETURN);
+         }
+      }
+
+   free (sites);
+   free (first);
+   free (fill);
+   return failed;
+}
+
+
+// Sorts the edges by block and indexes them both ways.
+
+static int index_edges (cfg_type * g, edges_type * e)
+{
+   int * count;
+   int k, i;
+
+   g->edges = (cfg_edge_type *) malloc ((e->n + 1) * sizeof (cfg_edge_type));
+   g->preds = (int *) malloc ((e->n + 1) * sizeof (int));
+   count = (int *) calloc (g->nblocks + 1, sizeof (int));
+   if (!g->edges || !g->preds || !count)
+   {  free (count);
+      return 1;
+   }
+   g->nedges = e->n;
+
+   for (i=0; i<e->n; i++)
+      g->blocks[e->list[i].from].nsucc++;
+   for (k=0, i=0; k<g->nblocks; k++)
+   {  g->blocks[k].succ = i;
+      count[k] = i;
+      i += g->blocks[k].nsucc;
+   }
+   for (i=0; i<e->n; i++)               // stable: local edges, then returns
+      g->edges[count[e->list[i].from]++] = e->list[i];
+
+   for (i=0; i<e->n; i++)
+      g->blocks[e->list[i].to].npred++;
+   for (k=0, i=0; k<g->nblocks; k++)
+   {  g->blocks[k].pred = i;
+      count[k] = i;
+      i += g->blocks[k].npred;
+   }
+   for (i=0; i<g->nedges; i++)
+      g->preds[count[g->edges[i].to]++] = i;
+
+   free (count);
+   return 0;
+}
+
+
+// Builds (or rebuilds) ctx->cfg from the maps. Call it after mapping.
+//
+// Returns: 0=ok
+//          1=out of memory (ctx->cfg is NULL)
+
+int cfg_build (lcdis_type * ctx)
+{
+   cfg_type * g;
+   edges_type e;
+   unsigned char * insn;
+   unsigned char * leader;
+   int failed;
+
+   cfg_free (ctx);
+   trace_entries (ctx);
+   if ((g = (cfg_type *) calloc (1, sizeof (cfg_type))) == NULL)
+      return 1;
+   ctx->cfg = g;
+   memset (&e, 0, sizeof (e));
+   insn     = (unsigned char *) calloc (ctx->memsize + 1, 1);
+   leader   = (unsigned char *) calloc (ctx->memsize + 1, 1);
+   g->block_at = (int *) malloc ((ctx->memsize + 1) * sizeof (int));
+
+   failed =    !insn || !leader || !g->block_at;
+   if (!failed)
+   {  find_leaders (ctx, insn, leader);
+      failed =    make_blocks (ctx, g, insn, leader)
+               || local_edges (ctx, g, &e)
+               || make_functions (ctx, g, &e)
+               || return_edges (g, &e)
+               || index_edges (g, &e);
+   }
+
+   free (insn);
+   free (leader);
+   free (e.list);
+   if (failed)
+      cfg_free (ctx);
+   return failed;
+}
+
+
+void cfg_free (lcdis_type * ctx)
+{
+   cfg_type * g = ctx->cfg;
+
+   if (g == NULL)
+      return;
+   free (g->blocks);
+   free (g->edges);
+   free (g->preds);
+   free (g->funcs);
+   free (g->func_blocks);
+   free (g->block_at);
+   free (g);
+   ctx->cfg = NULL;
+}
+
+
+// Returns: the block with the instruction at (or operand byte in) addr, or -1
+
+int cfg_block_at (lcdis_type * ctx, int addr)
+{
+   if ((ctx->cfg == NULL) || (addr < 0) || (addr >= ctx->memsize))
+      return -1;
+   return ctx->cfg->block_at[addr];
+}
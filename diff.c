@@ -0,0 +1,546 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, comparing two images
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Two revisions of a game or BIOS are mostly the same code at different
+ * addresses, so a diff of their listings is nothing but changed lines.
+ * lcdis_diff compares them function by function (cfg.c) instead.
+ *
+ * Every instruction gets a hash that doesn't depend on where it is: the
+ * a12, a16 and r16 operands are left out, and a jump or branch to
+ * somewhere in its own function counts as which of its blocks (in address
+ * order) and how far into it. A block's hash is its instructions', a function's is
+ * its blocks' in address order. Functions are then matched:
+ *
+ *    1. the same hash, found once in each image: unchanged (maybe moved)
+ *    2. the most instructions in blocks with the same hash, best pairs
+ *       first, as long as they're at least DIFF_SIMILAR% of the two
+ *    3. whatever's left at the same entry address
+ *
+ * Matched functions whose hashes differ are listed side by side, lined up
+ * on the instructions they have in common; the rest of the unmatched
+ * functions are listed as removed or added.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lcdis.h"
+
+#define DIFF_SIMILAR     30        // % of instructions in common to call it the same function
+#define DIFF_WIDTH       64        // columns for the old side of a listing
+#define DIFF_ALIGN_MAX   0x400000  // cells in the line-up table; past that, line by line
+
+typedef struct
+{
+   lcdis_type * ctx;
+   cfg_type *   g;
+   uint64_t *   bhash;         // each block's hash
+   uint64_t *   fhash;         // each function's hash
+   int *        ninsns;        // instructions in each function
+   uint64_t **  sorted;        // each function's block hashes, sorted (weights in sortw)
+   int **       sortw;         // ...and the instructions in each
+   int *        match;         // the other image's function, -1=none
+} side_type;
+
+typedef struct
+{
+   int a, b;                   // function indices
+   int score;                  // instructions in common * 2 * 100 / both
+} pair_type;
+
+
+// Returns: which of function f's blocks (in address order) block k is
+
+static int block_number (cfg_type * g, int f, int k)
+{
+   int * list = &g->func_blocks[g->funcs[f].first];
+   int lo=0, hi=g->funcs[f].count-1, mid;
+
+   while (lo < hi)
+   {  mid = (lo + hi) / 2;
+      if (g->blocks[list[mid]].start < g->blocks[k].start)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+
+// Carries an FNV-1a hash on with one instruction, minus where it is.
+
+static uint64_t hash_insn (side_type * s, int pin, int entry)
+{
+   lcdis_type * ctx = s->ctx;
+   decode_type * d = &decode[ctx->mem[pin]];
+   unsigned char key[8];       // up to 3 bytes of instruction, 4 of target
+   int target, k, f, n=0;
+
+   switch (d->target)
+   {
+      case TGT_A12:  key[n++] = ctx->mem[pin] & 0xE8;   // the opcode without a11-a8
+                     break;
+      case TGT_A16:
+      case TGT_R16:  key[n++] = ctx->mem[pin];
+                     break;
+      default:       for (n=0; n<d->len; n++)
+                        key[n] = ctx->mem[pin+n];
+   }
+   if ((d->target != TGT_NONE) && ((target = get_target (ctx, pin)) >= 0) && (target < ctx->memsize))
+   {  k = s->g->block_at[target];
+      if ((k >= 0) && ((f = s->g->blocks[k].func) >= 0) && (s->g->funcs[f].entry == entry))
+      {  f = block_number (s->g, f, k);             // somewhere in the same function
+         key[n++] = f & 0xFF;
+         key[n++] = f >> 8;
+         key[n++] = (target - s->g->blocks[k].start) & 0xFF;
+         key[n++] = (target - s->g->blocks[k].start) >> 8;
+      }
+   }
+   return cache_hash (CACHE_HASH_START, key, n);
+}
+
+
+// Renders the listing line for the instruction at pin into o (without
+// the newline, or the blank line after a jump).
+
+static void render (lcdis_type * ctx, int pin, out_type * o)
+{
+   out_type save;
+   char * nl;
+   int next;
+
+   save     = ctx->out;
+   ctx->out = *o;
+   dis_code (ctx, pin, &next);
+   *o       = ctx->out;
+   ctx->out = save;
+   nl = memchr (o->buf, '\n', o->len);
+   if (nl)
+      o->len = nl - o->buf;
+   while ((o->len > 0) && (o->buf[o->len-1] == ' '))
+      o->len--;
+}
+
+
+static int by_hash (const void * x, const void * y)
+{
+   uint64_t a = *(const uint64_t *) x, b = *(const uint64_t *) y;
+
+   return (a > b) - (a < b);
+}
+
+
+static int by_score (const void * x, const void * y)
+{
+   const pair_type * a = (const pair_type *) x;
+   const pair_type * b = (const pair_type *) y;
+
+   if (a->score != b->score)
+      return b->score - a->score;
+   return (a->a != b->a) ? a->a - b->a : a->b - b->b;
+}
+
+
+// Hashes the blocks and functions of one image (already mapped).
+//
+// Returns: 0=ok
+//          1=out of memory
+
+static int hash_side (side_type * s, lcdis_type * ctx)
+{
+   cfg_type * g;
+   cfg_block_type * b;
+   uint64_t h;
+   uint64_t * pairs;
+   int f, j, k, pin, n;
+
+   memset (s, 0, sizeof (*s));
+   s->ctx = ctx;
+   if (cfg_build (ctx))
+      return 1;
+   s->g = g = ctx->cfg;
+   s->bhash  = (uint64_t *) calloc (g->nblocks + 1, sizeof (uint64_t));
+   s->fhash  = (uint64_t *) calloc (g->nfuncs + 1, sizeof (uint64_t));
+   s->ninsns = (int *) calloc (g->nfuncs + 1, sizeof (int));
+   s->sorted = (uint64_t **) calloc (g->nfuncs + 1, sizeof (uint64_t *));
+   s->sortw  = (int **) calloc (g->nfuncs + 1, sizeof (int *));
+   s->match  = (int *) malloc ((g->nfuncs + 1) * sizeof (int));
+   if (!s->bhash || !s->fhash || !s->ninsns || !s->sorted || !s->sortw || !s->match)
+      return 1;
+
+   for (k=0; k<g->nblocks; k++)
+   {  b = &g->blocks[k];
+      if (b->func < 0)
+         continue;
+      h = CACHE_HASH_START;
+      for (pin=b->start; pin<b->end; pin+=decode[ctx->mem[pin]].len)
+      {  uint64_t ih = hash_insn (s, pin, g->funcs[b->func].entry);
+         h = cache_hash (h, (const unsigned char *) &ih, sizeof (ih));
+      }
+      s->bhash[k] = h;
+   }
+
+   for (f=0; f<g->nfuncs; f++)
+   {  s->match[f] = -1;
+      n = g->funcs[f].count;
+      h = CACHE_HASH_START;
+      pairs = (uint64_t *) malloc ((2 * n + 1) * sizeof (uint64_t));
+      s->sorted[f] = (uint64_t *) malloc ((n + 1) * sizeof (uint64_t));
+      s->sortw[f]  = (int *) malloc ((n + 1) * sizeof (int));
+      if (!pairs || !s->sorted[f] || !s->sortw[f])
+      {  free (pairs);
+         return 1;
+      }
+      for (j=0; j<n; j++)            // func_blocks are in address order
+      {  k = g->func_blocks[g->funcs[f].first + j];
+         h = cache_hash (h, (const unsigned char *) &s->bhash[k], sizeof (uint64_t));
+         s->ninsns[f] += g->blocks[k].ninsns;
+         pairs[2*j]   = s->bhash[k];
+         pairs[2*j+1] = g->blocks[k].ninsns;
+      }
+      s->fhash[f] = h;
+      qsort (pairs, n, 2 * sizeof (uint64_t), by_hash);
+      for (j=0; j<n; j++)
+      {  s->sorted[f][j] = pairs[2*j];
+         s->sortw[f][j]  = (int) pairs[2*j+1];
+      }
+      free (pairs);
+   }
+   return 0;
+}
+
+
+static void free_side (side_type * s)
+{
+   int f;
+
+   if (s->g)
+      for (f=0; f<s->g->nfuncs; f++)
+      {  if (s->sorted)
+            free (s->sorted[f]);
+         if (s->sortw)
+            free (s->sortw[f]);
+      }
+   free (s->bhash);
+   free (s->fhash);
+   free (s->ninsns);
+   free (s->sorted);
+   free (s->sortw);
+   free (s->match);
+}
+
+
+// Returns: instructions in blocks that are the same in function fa of a
+//          and fb of b
+
+static int in_common (side_type * a, int fa, side_type * b, int fb)
+{
+   int i=0, j=0, na, nb, same=0;
+
+   na = a->g->funcs[fa].count;
+   nb = b->g->funcs[fb].count;
+   while ((i < na) && (j < nb))
+      if (a->sorted[fa][i] < b->sorted[fb][j])
+         i++;
+      else
+      if (a->sorted[fa][i] > b->sorted[fb][j])
+         j++;
+      else
+      {  same += (a->sortw[fa][i] < b->sortw[fb][j]) ? a->sortw[fa][i] : b->sortw[fb][j];
+         i++;
+         j++;
+      }
+   return same;
+}
+
+
+static void pair (side_type * a, int fa, side_type * b, int fb)
+{
+   a->match[fa] = fb;
+   b->match[fb] = fa;
+}
+
+
+// Matches the functions of a and b (see the top of the file).
+//
+// Returns: 0=ok
+//          1=out of memory
+
+static int match (side_type * a, side_type * b)
+{
+   uint64_t * ha, * hb;
+   pair_type * pairs=NULL;
+   int npairs=0, room=0;
+   int fa, fb, i, j, same;
+
+   // 1. hashes found once on each side
+   ha = (uint64_t *) malloc ((a->g->nfuncs + 1) * sizeof (uint64_t));
+   hb = (uint64_t *) malloc ((b->g->nfuncs + 1) * sizeof (uint64_t));
+   if (!ha || !hb)
+   {  free (ha);
+      free (hb);
+      return 1;
+   }
+   memcpy (ha, a->fhash, a->g->nfuncs * sizeof (uint64_t));
+   memcpy (hb, b->fhash, b->g->nfuncs * sizeof (uint64_t));
+   qsort (ha, a->g->nfuncs, sizeof (uint64_t), by_hash);
+   qsort (hb, b->g->nfuncs, sizeof (uint64_t), by_hash);
+   for (fa=0; fa<a->g->nfuncs; fa++)
+   {  uint64_t * p = bsearch (&a->fhash[fa], ha, a->g->nfuncs, sizeof (uint64_t), by_hash);
+      uint64_t * q = bsearch (&a->fhash[fa], hb, b->g->nfuncs, sizeof (uint64_t), by_hash);
+      if (   !q || ((p > ha) && (p[-1] == *p)) || ((p < ha + a->g->nfuncs - 1) && (p[1] == *p))
+          || ((q > hb) && (q[-1] == *q)) || ((q < hb + b->g->nfuncs - 1) && (q[1] == *q)))
+         continue;
+      for (fb=0; b->fhash[fb] != *q; fb++)
+         ;
+      pair (a, fa, b, fb);
+   }
+   free (ha);
+   free (hb);
+
+   // 2. blocks in common, best first
+   for (fa=0; fa<a->g->nfuncs; fa++)
+      for (fb=0; (a->match[fa] < 0) && (fb<b->g->nfuncs); fb++)
+         if ((b->match[fb] < 0) && ((same = in_common (a, fa, b, fb)) > 0)
+             && (same * 200 >= DIFF_SIMILAR * (a->ninsns[fa] + b->ninsns[fb])))
+         {  if (npairs == room)
+            {  pair_type * grown;
+               room = room ? room * 2 : 256;
+               if ((grown = (pair_type *) realloc (pairs, room * sizeof (pair_type))) == NULL)
+               {  free (pairs);
+                  return 1;
+               }
+               pairs = grown;
+            }
+            pairs[npairs].a = fa;
+            pairs[npairs].b = fb;
+            pairs[npairs].score = same * 200 / (a->ninsns[fa] + b->ninsns[fb]);
+            npairs++;
+         }
+   qsort (pairs, npairs, sizeof (pair_type), by_score);
+   for (i=0; i<npairs; i++)
+      if ((a->match[pairs[i].a] < 0) && (b->match[pairs[i].b] < 0))
+         pair (a, pairs[i].a, b, pairs[i].b);
+   free (pairs);
+
+   // 3. the same entry address
+   for (fa=0, j=0; fa<a->g->nfuncs; fa++)
+   {  while ((j < b->g->nfuncs) && (b->g->funcs[j].entry < a->g->funcs[fa].entry))
+         j++;
+      if (   (a->match[fa] < 0) && (j < b->g->nfuncs) && (b->match[j] < 0)
+          && (b->g->funcs[j].entry == a->g->funcs[fa].entry))
+         pair (a, fa, b, j);
+   }
+   return 0;
+}
+
+
+// The instruction addresses of function f, in address order.
+//
+// Returns: how many (*list is malloc'ed), or -1 if out of memory
+
+static int insns_of (side_type * s, int f, int ** list)
+{
+   cfg_block_type * b;
+   int j, pin, n=0;
+
+   if ((*list = (int *) malloc ((s->ninsns[f] + 1) * sizeof (int))) == NULL)
+      return -1;
+   for (j=0; j<s->g->funcs[f].count; j++)
+   {  b = &s->g->blocks[s->g->func_blocks[s->g->funcs[f].first + j]];
+      for (pin=b->start; pin<b->end; pin+=decode[s->ctx->mem[pin]].len)
+         (*list)[n++] = pin;
+   }
+   return n;
+}
+
+
+// One line of a side-by-side listing: old (padded to DIFF_WIDTH), a
+// marker and new. Either address can be -1 for nothing on that side.
+
+static void side_by_side (side_type * a, int pa, side_type * b, int pb, char mark, out_type * o)
+{
+   out_type line;
+   int n=0;
+
+   if (out_open_mem (&line))
+      return;
+   if (pa >= 0)
+   {  render (a->ctx, pa, &line);
+      n = (line.len > DIFF_WIDTH) ? DIFF_WIDTH : line.len;
+      out_mem (o, line.buf, n);
+   }
+   for (; n<DIFF_WIDTH; n++)
+      out_char (o, ' ');
+   out_char (o, ' ');
+   out_char (o, mark);
+   if (pb >= 0)
+   {  line.len = 0;
+      render (b->ctx, pb, &line);
+      out_char (o, ' ');
+      out_mem (o, line.buf, line.len);
+   }
+   out_char (o, '\n');
+   free (line.buf);
+}
+
+
+// Lines functions fa and fb up on their longest run of instructions in
+// common (by hash) and lists them side by side: ' ' the same, '|'
+// changed, '<' only in the old one, '>' only in the new one.
+
+static void list_changed (side_type * a, int fa, side_type * b, int fb, out_type * o)
+{
+   int * ia=NULL, * ib=NULL;
+   uint64_t * ka=NULL, * kb=NULL;
+   int * lcs=NULL;
+   int na, nb, i, j;
+
+   na = insns_of (a, fa, &ia);
+   nb = insns_of (b, fb, &ib);
+   if ((na < 0) || (nb < 0))
+      na = nb = 0;
+   ka = (uint64_t *) malloc ((na + 1) * sizeof (uint64_t));
+   kb = (uint64_t *) malloc ((nb + 1) * sizeof (uint64_t));
+   if ((double) (na + 1) * (nb + 1) <= DIFF_ALIGN_MAX)
+      lcs = (int *) calloc ((na + 1) * (nb + 1), sizeof (int));
+   if (!ka || !kb)
+      na = nb = 0;
+
+   for (i=0; i<na; i++)
+      ka[i] = hash_insn (a, ia[i], a->g->funcs[fa].entry);
+   for (j=0; j<nb; j++)
+      kb[j] = hash_insn (b, ib[j], b->g->funcs[fb].entry);
+
+   #define LCS(i,j) lcs[(i) * (nb + 1) + (j)]    // in common from ia[i..], ib[j..]
+   if (lcs)
+      for (i=na-1; i>=0; i--)
+         for (j=nb-1; j>=0; j--)
+            LCS(i,j) = (ka[i] == kb[j]) ? LCS(i+1,j+1) + 1
+                     : (LCS(i+1,j) > LCS(i,j+1)) ? LCS(i+1,j) : LCS(i,j+1);
+
+   for (i=0, j=0; (i < na) || (j < nb); )
+   {
+      if ((i < na) && (j < nb) && (ka[i] == kb[j]))
+         side_by_side (a, ia[i++], b, ib[j++], ' ', o);
+      else
+      if ((i < na) && (j < nb) && (!lcs || (LCS(i+1,j+1) == LCS(i,j))))
+         side_by_side (a, ia[i++], b, ib[j++], '|', o);   // pairing them loses nothing
+      else
+      if ((i < na) && ((j >= nb) || (LCS(i+1,j) >= LCS(i,j+1))))
+         side_by_side (a, ia[i++], b, -1, '<', o);
+      else
+         side_by_side (a, -1, b, ib[j++], '>', o);
+   }
+   #undef LCS
+
+   free (lcs);
+   free (ka);
+   free (kb);
+   free (ia);
+   free (ib);
+}
+
+
+static void print_name (side_type * s, int f, out_type * o)
+{
+   out_type save;
+
+   save = s->ctx->out;
+   s->ctx->out = *o;
+   print_code_label (s->ctx, s->g->funcs[f].entry, 0);
+   *o = s->ctx->out;
+   s->ctx->out = save;
+}
+
+
+static void list_one (side_type * s, int f, int left, out_type * o)
+{
+   int * list;
+   int n, i;
+
+   n = insns_of (s, f, &list);
+   for (i=0; i<n; i++)
+      if (left)
+         side_by_side (s, list[i], NULL, -1, '<', o);
+      else
+         side_by_side (NULL, -1, s, list[i], '>', o);
+   free (list);
+}
+
+
+// Compares the functions of a and b (both mapped) and writes a report to o:
+// a summary, then each changed function side by side, then the removed and
+// added ones.
+//
+// Returns: 0=ok
+//          1=out of memory
+
+int lcdis_diff (lcdis_type * a, lcdis_type * b, out_type * o)
+{
+   side_type sa, sb;
+   int f, moved=0, same=0, changed=0, removed=0, added=0;
+   int failed;
+   static const char rule[] = ";------------------------------------------------------------------\n";
+
+   memset (&sb, 0, sizeof (sb));
+   failed = hash_side (&sa, a) || hash_side (&sb, b) || match (&sa, &sb);
+   if (!failed)
+   {
+      for (f=0; f<sa.g->nfuncs; f++)
+         if (sa.match[f] < 0)
+            removed++;
+         else
+         if (sa.fhash[f] != sb.fhash[sa.match[f]])
+            changed++;
+         else
+         {  same++;
+            moved += (sa.g->funcs[f].entry != sb.g->funcs[sa.match[f]].entry);
+         }
+      for (f=0; f<sb.g->nfuncs; f++)
+         added += (sb.match[f] < 0);
+
+      out_printf (o, "; %d functions in the old image, %d in the new one\n", sa.g->nfuncs, sb.g->nfuncs);
+      out_printf (o, "; %d the same (%d of them moved), %d changed, %d removed, %d added\n\n",
+                  same, moved, changed, removed, added);
+
+      for (f=0; f<sa.g->nfuncs; f++)
+         if ((sa.match[f] >= 0) && (sa.fhash[f] != sb.fhash[sa.match[f]]))
+         {  out_str (o, rule);
+            out_str (o, "; changed: ");
+            print_name (&sa, f, o);
+            out_str (o, " -> ");
+            print_name (&sb, sa.match[f], o);
+            out_printf (o, " (%d -> %d instructions)\n", sa.ninsns[f], sb.ninsns[sa.match[f]]);
+            list_changed (&sa, f, &sb, sa.match[f], o);
+            out_char (o, '\n');
+         }
+      for (f=0; f<sa.g->nfuncs; f++)
+         if (sa.match[f] < 0)
+         {  out_str (o, rule);
+            out_str (o, "; removed: ");
+            print_name (&sa, f, o);
+            out_printf (o, " (%d instructions)\n", sa.ninsns[f]);
+            list_one (&sa, f, 1, o);
+            out_char (o, '\n');
+         }
+      for (f=0; f<sb.g->nfuncs; f++)
+         if (sb.match[f] < 0)
+         {  out_str (o, rule);
+            out_str (o, "; added: ");
+            print_name (&sb, f, o);
+            out_printf (o, " (%d instructions)\n", sb.ninsns[f]);
+            list_one (&sb, f, 0, o);
+            out_char (o, '\n');
+         }
+   }
+   free_side (&sa);
+   free_side (&sb);
+   return failed;
+}
@@ -0,0 +1,450 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, exporting the analysis
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Writes what the listing shows (instructions, what every byte is used
+ * for, labels and ram banks) and the control-flow graph (cfg.c) in a form
+ * other programs don't have to parse out of the listing: newline-delimited
+ * JSON, or fixed-size binary records that can be mmap'ed and used in place
+ * (see export_header_type in lcdis.h).
+ *
+ * Both are made from the same tables, built by walking the image line by
+ * line exactly like lcdis_listing does. Operand text and label names come
+ * from the listing's own print functions, pointed at the string table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lcdis.h"
+
+typedef struct
+{
+   export_insn_type *   insns;
+   int                  ninsns, insnroom;
+   export_region_type * regions;
+   int                  nregions, regionroom;
+   export_label_type *  labels;
+   int                  nlabels, labelroom;
+   export_bank_type *   banks;
+   int                  nbanks, bankroom;
+   out_type             strings;
+} export_type;
+
+static const char * region_names[] =
+   { "code", "data", "graphics", "font", "text", "icon", "unused" };
+
+static const char * bank_names[] =
+   { "bank0", "bank1", "unknown", "various" };
+
+static const char * flow_names[] =
+   { "next", "call", "jump", "branch", "return", "illegal" };
+
+static const char * edge_names[] =
+   { "fallthrough", "branch", "call", "return" };
+
+
+// Makes room for one more record in *list.
+//
+// Returns: 0=ok
+//          1=out of memory
+
+static int grow (void ** list, int n, int * room, size_t size)
+{
+   void * p;
+
+   if (n < *room)
+      return 0;
+   p = realloc (*list, (*room ? *room * 2 : 1024) * size);
+   if (p == NULL)
+      return 1;
+   *list = p;
+   *room = *room ? *room * 2 : 1024;
+   return 0;
+}
+
+
+// Adds a string to the table and returns its offset.
+
+static uint32_t add_string (export_type * x, const char * s, int n)
+{
+   uint32_t at = x->strings.len;
+
+   out_mem (&x->strings, s, n);
+   out_char (&x->strings, 0);
+   return at;
+}
+
+
+// Runs one of the listing's print functions with its output going into the
+// string table, and returns the offset of what it printed.
+
+static uint32_t add_printed (export_type * x, lcdis_type * ctx, int pin, int label)
+{
+   out_type save;
+   uint32_t at = x->strings.len;
+
+   save     = ctx->out;
+   ctx->out = x->strings;
+   if (label)
+      print_code_label (ctx, pin, 0);
+   else
+      print_operands (ctx, pin);
+   out_char (&ctx->out, 0);
+   x->strings = ctx->out;
+   ctx->out   = save;
+   return at;
+}
+
+
+static int region_kind (lcdis_type * ctx, int pin)
+{
+   switch (ctx->mem_use[pin])
+   {
+      case MEM_UNKNOWN:
+      case MEM_DATA:      return is_icon (ctx, pin) ? REGION_ICON : REGION_DATA;
+      case MEM_GRAPHICS:  return REGION_GRAPHICS;
+      case MEM_FONT8:     return REGION_FONT;
+      case MEM_TEXT:      return REGION_TEXT;
+      case MEM_UNUSED:    return REGION_UNUSED;
+   }
+   return REGION_CODE;    // MEM_CODE, MEM_CODE_LABELED, MEM_INVALID (operand bytes)
+}
+
+
+static int add_insn (export_type * x, lcdis_type * ctx, int pin)
+{
+   decode_type * d = &decode[ctx->mem[pin]];
+   export_insn_type * r;
+   export_bank_type * b;
+   char hex[4];
+   int n, i;
+
+   if (grow ((void **) &x->insns, x->ninsns, &x->insnroom, sizeof (export_insn_type)))
+      return 1;
+   r = &x->insns[x->ninsns++];
+   memset (r, 0, sizeof (export_insn_type));
+   r->addr = pin;
+   r->len  = d->len;
+   r->use  = ctx->mem_use[pin];
+   r->bnk  = ctx->mem_bnk[pin];
+   r->flow = d->flow;
+   for (i=0; i<d->len; i++)
+      r->bytes[i] = ctx->mem[pin+i];
+   r->target = (d->target != TGT_NONE) ? (uint32_t) get_target (ctx, pin) : EXPORT_NONE;
+
+   for (n=5; (n > 0) && (d->model[n-1] == ' '); n--)
+      ;
+   r->mnemonic = add_string (x, d->model, n);
+   if (d->operand == '!')               // print_operands adds a comment to these
+   {  snprintf (hex, sizeof (hex), "$%02x", ctx->mem[pin]);
+      r->operands = add_string (x, hex, 3);
+   }
+   else
+      r->operands = add_printed (x, ctx, pin, 0);
+
+   r->label = EXPORT_NONE;
+   if (ctx->mem_use[pin] == MEM_CODE_LABELED)
+   {  if (grow ((void **) &x->labels, x->nlabels, &x->labelroom, sizeof (export_label_type)))
+         return 1;
+      r->label = add_printed (x, ctx, pin, 1);
+      x->labels[x->nlabels].addr = pin;
+      x->labels[x->nlabels].name = r->label;
+      x->nlabels++;
+   }
+
+   // a bank run goes on while the instructions follow on with the same bank
+   b = x->nbanks ? &x->banks[x->nbanks-1] : NULL;
+   if (b && (b->end == (uint32_t) pin) && (b->bnk == r->bnk))
+      b->end = pin + d->len;
+   else
+   {  if (grow ((void **) &x->banks, x->nbanks, &x->bankroom, sizeof (export_bank_type)))
+         return 1;
+      b = &x->banks[x->nbanks++];
+      b->start = pin;
+      b->end   = pin + d->len;
+      b->bnk   = r->bnk;
+   }
+   return 0;
+}
+
+
+// Fills in the tables from the maps.
+//
+// Returns: 0=ok
+//          1=out of memory
+
+static int build (export_type * x, lcdis_type * ctx)
+{
+   export_region_type * r;
+   int pin, kind;
+
+   for (pin=0; pin<ctx->memsize; pin++)
+   {
+      kind = region_kind (ctx, pin);
+      if (x->nregions && (x->regions[x->nregions-1].kind == (uint32_t) kind))
+         x->regions[x->nregions-1].end = pin+1;
+      else
+      {  if (grow ((void **) &x->regions, x->nregions, &x->regionroom, sizeof (export_region_type)))
+            return 1;
+         r = &x->regions[x->nregions++];
+         r->start = pin;
+         r->end   = pin+1;
+         r->kind  = kind;
+      }
+   }
+
+   for (pin=0; (pin>=0) && (pin<ctx->memsize); pin=next_line (ctx, pin))
+      switch (ctx->mem_use[pin])
+      {
+         case MEM_CODE:
+         case MEM_CODE_LABELED:
+         case MEM_INVALID:
+            if (add_insn (x, ctx, pin))
+               return 1;
+            break;
+      }
+   return 0;
+}
+
+
+// s as a JSON string
+
+static void json_str (out_type * o, const char * s)
+{
+   out_char (o, '"');
+   for (; *s; s++)
+      if ((*s == '"') || (*s == '\\'))
+      {  out_char (o, '\\');
+         out_char (o, *s);
+      }
+      else
+      if ((unsigned char) *s < 0x20)
+      {  out_str (o, "\\u00");
+         out_hex (o, (unsigned char) *s, 2);
+      }
+      else
+         out_char (o, *s);
+   out_char (o, '"');
+}
+
+
+// One object per line:
+//   {"type":"image","size":4096,"flash":0}
+//   {"type":"region","start":0,"end":96,"kind":"code"}
+//   {"type":"insn","addr":1427,"bytes":"230000","mnemonic":"MOV","operands":"#$00,ACC",
+//    "bank":"bank1","label":"L0593","target":null}
+//   {"type":"label","addr":1427,"name":"L0593"}
+//   {"type":"bank","start":1427,"end":1500,"bank":"bank1"}
+//   {"type":"block","start":1427,"end":1440,"func":1427,"exit":"branch","bank":"bank1"}
+//   {"type":"edge","from":1427,"to":1440,"kind":"fallthrough"}
+//   {"type":"function","entry":1427,"blocks":5}
+// (blocks, edges and functions refer to each other by start address)
+
+static void write_json (export_type * x, lcdis_type * ctx, out_type * o)
+{
+   char * strings = x->strings.buf;
+   export_insn_type * r;
+   cfg_type * g = ctx->cfg;
+   int i, k;
+
+   out_str (o, "{\"type\":\"image\",\"size\":");
+   out_dec (o, ctx->memsize);
+   out_str (o, ",\"flash\":");
+   out_dec (o, ctx->hisize);
+   out_str (o, "}\n");
+
+   for (i=0; i<x->nregions; i++)
+   {  out_str (o, "{\"type\":\"region\",\"start\":");
+      out_dec (o, x->regions[i].start);
+      out_str (o, ",\"end\":");
+      out_dec (o, x->regions[i].end);
+      out_str (o, ",\"kind\":\"");
+      out_str (o, region_names[x->regions[i].kind]);
+      out_str (o, "\"}\n");
+   }
+
+   for (i=0; i<x->ninsns; i++)
+   {
+      r = &x->insns[i];
+      out_str (o, "{\"type\":\"insn\",\"addr\":");
+      out_dec (o, r->addr);
+      out_str (o, ",\"bytes\":\"");
+      for (k=0; k<r->len; k++)
+         out_hex (o, r->bytes[k], 2);
+      out_str (o, "\",\"mnemonic\":");
+      json_str (o, strings + r->mnemonic);
+      out_str (o, ",\"operands\":");
+      json_str (o, strings + r->operands);
+      out_str (o, ",\"bank\":\"");
+      out_str (o, bank_names[r->bnk & 3]);
+      out_str (o, "\",\"label\":");
+      if (r->label == EXPORT_NONE)
+         out_str (o, "null");
+      else
+         json_str (o, strings + r->label);
+      out_str (o, ",\"target\":");
+      if (r->target == EXPORT_NONE)
+         out_str (o, "null");
+      else
+         out_dec (o, r->target);
+      out_str (o, "}\n");
+   }
+
+   for (i=0; i<x->nlabels; i++)
+   {  out_str (o, "{\"type\":\"label\",\"addr\":");
+      out_dec (o, x->labels[i].addr);
+      out_str (o, ",\"name\":");
+      json_str (o, strings + x->labels[i].name);
+      out_str (o, "}\n");
+   }
+
+   for (i=0; i<x->nbanks; i++)
+   {  out_str (o, "{\"type\":\"bank\",\"start\":");
+      out_dec (o, x->banks[i].start);
+      out_str (o, ",\"end\":");
+      out_dec (o, x->banks[i].end);
+      out_str (o, ",\"bank\":\"");
+      out_str (o, bank_names[x->banks[i].bnk & 3]);
+      out_str (o, "\"}\n");
+   }
+
+   for (i=0; i<g->nblocks; i++)
+   {  out_str (o, "{\"type\":\"block\",\"start\":");
+      out_dec (o, g->blocks[i].start);
+      out_str (o, ",\"end\":");
+      out_dec (o, g->blocks[i].end);
+      out_str (o, ",\"func\":");
+      if (g->blocks[i].func < 0)
+         out_str (o, "null");
+      else
+         out_dec (o, g->funcs[g->blocks[i].func].entry);
+      out_str (o, ",\"exit\":\"");
+      out_str (o, flow_names[g->blocks[i].exit]);
+      out_str (o, "\",\"bank\":\"");
+      out_str (o, bank_names[g->blocks[i].bnk & 3]);
+      out_str (o, "\"}\n");
+   }
+
+   for (i=0; i<g->nedges; i++)
+   {  out_str (o, "{\"type\":\"edge\",\"from\":");
+      out_dec (o, g->blocks[g->edges[i].from].start);
+      out_str (o, ",\"to\":");
+      out_dec (o, g->blocks[g->edges[i].to].start);
+      out_str (o, ",\"kind\":\"");
+      out_str (o, edge_names[g->edges[i].kind]);
+      out_str (o, "\"}\n");
+   }
+
+   for (i=0; i<g->nfuncs; i++)
+   {  out_str (o, "{\"type\":\"function\",\"entry\":");
+      out_dec (o, g->funcs[i].entry);
+      out_str (o, ",\"blocks\":");
+      out_dec (o, g->funcs[i].count);
+      out_str (o, "}\n");
+   }
+}
+
+
+static void write_binary (export_type * x, lcdis_type * ctx, out_type * o)
+{
+   export_header_type h;
+   export_block_type b;
+   export_edge_type e;
+   export_func_type f;
+   cfg_type * g = ctx->cfg;
+   uint32_t at;
+   int i;
+
+   while (x->strings.len & 3)           // keeps the file a whole number of words
+      out_char (&x->strings, 0);
+
+   memset (&h, 0, sizeof (h));
+   memcpy (h.magic, EXPORT_MAGIC, 4);
+   h.version = EXPORT_VERSION;
+   h.memsize = ctx->memsize;
+   h.hisize  = ctx->hisize;
+   at = sizeof (h);
+   h.insns.offset   = at;  h.insns.count   = x->ninsns;    at += x->ninsns   * sizeof (export_insn_type);
+   h.regions.offset = at;  h.regions.count = x->nregions;  at += x->nregions * sizeof (export_region_type);
+   h.labels.offset  = at;  h.labels.count  = x->nlabels;   at += x->nlabels  * sizeof (export_label_type);
+   h.banks.offset   = at;  h.banks.count   = x->nbanks;    at += x->nbanks   * sizeof (export_bank_type);
+   h.strings.offset = at;  h.strings.count = x->strings.len;     at += x->strings.len;
+   h.blocks.offset  = at;  h.blocks.count  = g->nblocks;   at += g->nblocks  * sizeof (export_block_type);
+   h.edges.offset   = at;  h.edges.count   = g->nedges;    at += g->nedges   * sizeof (export_edge_type);
+   h.funcs.offset   = at;  h.funcs.count   = g->nfuncs;
+
+   out_mem (o, (char *) &h, sizeof (h));
+   out_mem (o, (char *) x->insns,   x->ninsns   * sizeof (export_insn_type));
+   out_mem (o, (char *) x->regions, x->nregions * sizeof (export_region_type));
+   out_mem (o, (char *) x->labels,  x->nlabels  * sizeof (export_label_type));
+   out_mem (o, (char *) x->banks,   x->nbanks   * sizeof (export_bank_type));
+   out_mem (o, x->strings.buf, x->strings.len);
+
+   for (i=0; i<g->nblocks; i++)
+   {  memset (&b, 0, sizeof (b));
+      b.start = g->blocks[i].start;
+      b.end   = g->blocks[i].end;
+      b.func  = (g->blocks[i].func < 0) ? EXPORT_NONE : (uint32_t) g->blocks[i].func;
+      b.succ  = g->blocks[i].succ;
+      b.nsucc = g->blocks[i].nsucc;
+      b.exit  = g->blocks[i].exit;
+      b.bnk   = g->blocks[i].bnk;
+      out_mem (o, (char *) &b, sizeof (b));
+   }
+   for (i=0; i<g->nedges; i++)
+   {  e.from = g->edges[i].from;
+      e.to   = g->edges[i].to;
+      e.kind = g->edges[i].kind;
+      out_mem (o, (char *) &e, sizeof (e));
+   }
+   for (i=0; i<g->nfuncs; i++)
+   {  f.entry   = g->funcs[i].entry;
+      f.block   = g->funcs[i].block;
+      f.nblocks = g->funcs[i].count;
+      out_mem (o, (char *) &f, sizeof (f));
+   }
+}
+
+
+// Writes the analysis of the loaded image to fd as EXPORT_JSON or
+// EXPORT_BINARY. Call it after lcdis_map (and any ENTRYn directives).
+//
+// Returns: 0=ok
+//          1=out of memory or couldn't write
+
+int lcdis_export (lcdis_type * ctx, int fd, int format)
+{
+   export_type x;
+   out_type o;
+   int failed;
+
+   trace_entries (ctx);     // in case anything is still queued
+   memset (&x, 0, sizeof (x));
+   if (out_open_mem (&x.strings))
+      return 1;
+   failed = build (&x, ctx) || (!ctx->cfg && cfg_build (ctx));
+   if (!failed && !out_open (&o, fd))
+   {
+      if (format == EXPORT_BINARY)
+         write_binary (&x, ctx, &o);
+      else
+         write_json (&x, ctx, &o);
+      out_close (&o);
+      failed = o.error;
+   }
+   else
+      failed = 1;
+
+   free (x.insns);
+   free (x.regions);
+   free (x.labels);
+   free (x.banks);
+   free (x.strings.buf);
+   return failed;
+}
@@ -0,0 +1,205 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, 128K flash dumps (FLASH)
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * A VMU's flash is 128K, but code only ever runs from the first 64K. The
+ * upper 64K is data that LDF and STF reach with bit 0 of FLASHA16 set; the
+ * rest of the address comes from TRH:TRL. In FLASH mode the listing tracks
+ * those three registers through straight runs of code and notes the flash
+ * address at each LDF and STF, and the upper 64K is listed as data after
+ * the code space.
+ *
+ * The tracking is only as good as a straight read of the listing: whatever
+ * isn't set by the instructions just before (since the last label, call,
+ * jump or data) is unknown and shown as '?'.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "lcdis.h"
+
+#define OP_LDF        0x50
+#define OP_STF        0x51
+
+#define SFR_TRL       0x104
+#define SFR_TRH       0x105
+#define SFR_FLASHA16  0x154
+
+
+// Forgets FLASHA16, TRL and TRH.
+
+void flash_reset (lcdis_type * ctx)
+{
+   ctx->flash_a16 = -1;
+   ctx->flash_trl = -1;
+   ctx->flash_trh = -1;
+}
+
+
+// Applies SET1/CLR1/NOT1 (opcode) of bit b to a tracked register.
+
+static void flash_bit (int * reg, int opcode, int b)
+{
+   if (*reg < 0)
+      return;
+   switch (opcode & 0xE8)
+   {
+      case 0xE8:  *reg |=  (1 << b);  break;    // SET1
+      case 0xC8:  *reg &= ~(1 << b);  break;    // CLR1
+      case 0xA8:  *reg ^=  (1 << b);  break;    // NOT1
+   }
+}
+
+
+// Where an instruction that stores to addr leaves the tracked registers.
+
+static void flash_store (lcdis_type * ctx, int pin, int addr)
+{
+   int * reg;
+
+   switch (addr)
+   {
+      case SFR_TRL:       reg = &ctx->flash_trl; break;
+      case SFR_TRH:       reg = &ctx->flash_trh; break;
+      case SFR_FLASHA16:  reg = &ctx->flash_a16; break;
+      default:            return;
+   }
+
+   switch (decode[ctx->mem[pin]].operand)
+   {
+      case '^':   // MOV #i8,d9
+         *reg = ctx->mem[pin+2];
+         break;
+
+      case 'b':   // SET1, CLR1, NOT1 d9,b3
+         flash_bit (reg, ctx->mem[pin], ctx->mem[pin]&7);
+         break;
+
+      case '9':
+         if ((*reg >= 0) && ((ctx->mem[pin] & 0xFE) == 0x62))        // INC d9
+         {  *reg = (*reg + 1) & 0xFF;
+            break;
+         }
+         if ((*reg >= 0) && ((ctx->mem[pin] & 0xFE) == 0x72))        // DEC d9
+         {  *reg = (*reg - 1) & 0xFF;
+            break;
+         }
+         *reg = -1;          // ST, POP, XCH: whatever was in ACC/memory
+         break;
+
+      default:    // DBNZ: the loop count
+         *reg = -1;
+         break;
+   }
+   if (reg == &ctx->flash_a16)    // only bit 0 (A16) matters; bit 1 is write enable
+      if (*reg >= 0)
+         *reg &= 1;
+}
+
+
+// Called by dis_code for every instruction in FLASH mode, where the
+// auto-comments go: notes the flash address of an LDF or STF
+// ("      ;flash $1a2b3") and keeps track of FLASHA16, TRL and TRH.
+
+void flash_note (lcdis_type * ctx, int pin)
+{
+   decode_type * d;
+   int use;
+
+   d = &decode[ctx->mem[pin]];
+   use = ctx->mem_use[pin];
+   if ((pin != ctx->flash_next) || (use == MEM_CODE_LABELED) || (use == MEM_INVALID))
+      flash_reset (ctx);     // anything could have happened before we got here
+
+   if (   ((ctx->mem[pin] == OP_LDF) || (ctx->mem[pin] == OP_STF))
+       && ((ctx->flash_a16 >= 0) || (ctx->flash_trl >= 0) || (ctx->flash_trh >= 0)))
+   {
+      out_str (&ctx->out, "      ;flash $");
+      if (ctx->flash_a16 >= 0)
+         out_hex (&ctx->out, ctx->flash_a16, 1);
+      else
+         out_char (&ctx->out, '?');
+      if (ctx->flash_trh >= 0)
+         out_hex (&ctx->out, ctx->flash_trh, 2);
+      else
+         out_str (&ctx->out, "??");
+      if (ctx->flash_trl >= 0)
+         out_hex (&ctx->out, ctx->flash_trl, 2);
+      else
+         out_str (&ctx->out, "??");
+   }
+
+   if (d->writes)
+      switch (d->operand)
+      {
+         case '9':   // d9
+         case '^':   // #i8,d9
+         case 'x':   // d9,r8 (DBNZ)
+            flash_store (ctx, pin, get_d9 (ctx, pin));
+            break;
+
+         case 'b':   // d9,b3
+            flash_store (ctx, pin, get_d9bit (ctx, pin));
+            break;
+
+         default:    // @Ri: R2 and R3 point at the SFRs
+            if (get_reg (ctx, pin) >= 2)
+               flash_reset (ctx);
+            break;
+      }
+
+   if ((d->flow == FLOW_NEXT) || (d->flow == FLOW_BRANCH))
+      ctx->flash_next = pin + d->len;
+   else
+      ctx->flash_next = -1;      // calls may change anything; jumps don't come back
+}
+
+
+// Lists the upper 64K of a flash dump as data, 8 bytes to a line:
+//   "10000-          |              BYTE   $xx,... ;ascii "...""
+
+void flash_listing (lcdis_type * ctx)
+{
+   int pin, i, n;
+   int printable;
+   unsigned char * p;
+
+   out_printf (&ctx->out, "\n\n;------------------------------------------------------------------\n"
+           "; FLASH bank 1 ($10000-$%05x), read by LDF/STF with FLASHA16 bit 0 set\n\n",
+           0x10000 + ctx->hisize - 1);
+
+   for (pin=0; pin<ctx->hisize; pin+=8)
+   {
+      p = ctx->hibank + pin;
+      n = (ctx->hisize - pin < 8) ? ctx->hisize - pin : 8;
+      if (!ctx->asmout)
+      {  out_hex (&ctx->out, 0x10000 + pin, 4);
+         out_str (&ctx->out, "-          | ");
+      }
+      out_str (&ctx->out, "             BYTE   $");
+      out_hex (&ctx->out, p[0], 2);
+      printable = isprint (p[0] & 0x7F);
+      for (i=1; i<n; i++)
+      {  out_str (&ctx->out, ",$");
+         out_hex (&ctx->out, p[i], 2);
+         printable |= isprint (p[i] & 0x7F);
+      }
+
+      if (printable)   // same as dis_data: ascii only if there's something to see
+      {  for (i=8-n; i; i--)
+            out_str (&ctx->out, "    ");
+         out_str (&ctx->out, "  ;ascii \"");
+         for (i=0; i<n; i++)
+            out_char (&ctx->out, isprint (p[i] & 0x7F) ? (p[i] & 0x7F) : '.');
+         out_char (&ctx->out, '"');
+      }
+      out_char (&ctx->out, '\n');
+   }
+}
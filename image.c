@@ -0,0 +1,235 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, loading images
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The image is mapped straight from the file instead of being copied into a
+ * 64K buffer, and the usage maps are only as big as the image (plus
+ * MAP_SLACK for operand and string look-ahead). The mapping is read-only;
+ * nothing ever writes ctx->mem.
+ *
+ * Code only runs from the first 64K; anything after that (the upper bank of a
+ * 128K flash dump) goes into ctx->hibank for FLASH mode.
+ *
+ * A filename of "-" is stdin. A pipe can't be mapped, so it's read like
+ * anything else that can't be, in order: the first 64K, then the upper bank.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lcdis.h"
+
+
+// Maps up to 64K of fd read-only, followed by zeros up to MAP_SLACK bytes
+// past the end: a zero-filled anonymous region is reserved first and the
+// file is mapped over the start of it.
+//
+// Returns: 0=ok
+//          1=can't be mapped (not a regular file, ...)
+
+static int map_image (lcdis_type * ctx, int fd)
+{
+   struct stat st;
+   unsigned char * base;
+   long page;
+   size_t filelen, len;
+
+   if ((fstat (fd, &st) != 0) || !S_ISREG (st.st_mode) || (st.st_size == 0))
+      return 1;
+   filelen = (st.st_size > 0x10000) ? 0x10000 : st.st_size;
+
+   page = sysconf (_SC_PAGESIZE);
+   len  = (filelen + MAP_SLACK + page - 1) / page * page;
+   base = (unsigned char *) mmap (NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (base == MAP_FAILED)
+      return 1;
+   if (mmap (base, filelen, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+   {  munmap (base, len);
+      return 1;
+   }
+
+   ctx->mem       = base;
+   ctx->memmaplen = len;
+   ctx->memsize   = filelen;
+
+   if (st.st_size > 0x10000)      // 64K is a whole number of pages
+   {  filelen = (st.st_size > 0x20000) ? 0x10000 : st.st_size - 0x10000;
+      base = (unsigned char *) mmap (NULL, filelen, PROT_READ, MAP_PRIVATE, fd, 0x10000);
+      if (base != MAP_FAILED)
+      {  ctx->hibank   = base;
+         ctx->himaplen = filelen;
+         ctx->hisize   = filelen;
+      }
+   }
+   return 0;
+}
+
+
+// For anything that can't be mapped: reads it into a buffer instead.
+//
+// Returns: 0=ok
+//          1=out of memory
+
+static int read_image (lcdis_type * ctx, int fd)
+{
+   int n;
+
+   ctx->mem = (unsigned char *) calloc (0x10000+MAP_SLACK, 1);
+   if (ctx->mem == NULL)
+      return 1;
+   ctx->memmaplen = 0;
+   ctx->memsize   = 0;
+   while ((ctx->memsize < 0x10000) && ((n = read (fd, ctx->mem + ctx->memsize, 0x10000 - ctx->memsize)) > 0))
+      ctx->memsize += n;
+   return 0;
+}
+
+
+// Reads the upper bank, if there is one and map_image didn't get it.
+// fd is left just after the first 64K, so a pipe is read on from there.
+
+static void read_hibank (lcdis_type * ctx, int fd)
+{
+   int n;
+   int seekable = (lseek (fd, 0, SEEK_CUR) >= 0) || (errno != ESPIPE);
+
+   if (ctx->hibank || (ctx->memsize < 0x10000))
+      return;
+   if ((ctx->hibank = (unsigned char *) malloc (0x10000)) == NULL)
+      return;
+   ctx->himaplen = 0;
+   ctx->hisize   = 0;
+   while ((ctx->hisize < 0x10000)
+          && ((n = seekable ? pread (fd, ctx->hibank + ctx->hisize, 0x10000 - ctx->hisize, 0x10000 + ctx->hisize)
+                            : read (fd, ctx->hibank + ctx->hisize, 0x10000 - ctx->hisize)) > 0))
+      ctx->hisize += n;
+   if (ctx->hisize == 0)
+   {  free (ctx->hibank);
+      ctx->hibank = NULL;
+   }
+}
+
+
+// Sizes mem_use/mem_bnk for the image just loaded: the image is all
+// MEM_UNKNOWN, the slack after it MEM_UNUSED.
+//
+// Returns: 0=ok
+//          1=out of memory
+
+static int size_maps (lcdis_type * ctx)
+{
+   int size = ctx->memsize + MAP_SLACK;
+
+   if (size > ctx->maproom)
+   {
+      free (ctx->mem_use);
+      free (ctx->mem_bnk);
+      ctx->mem_use = (unsigned char *) malloc (size);
+      ctx->mem_bnk = (unsigned char *) malloc (size);
+      ctx->maproom = size;
+      if (!ctx->mem_use || !ctx->mem_bnk)
+      {  ctx->maproom = 0;
+         return 1;
+      }
+   }
+   ctx->mapsize = size;
+   memset (ctx->mem_use, MEM_UNKNOWN, ctx->memsize);
+   memset (ctx->mem_use + ctx->memsize, MEM_UNUSED, MAP_SLACK);
+   memset (ctx->mem_bnk, BNK_UNKNOWN, size);
+   return 0;
+}
+
+
+// Loads the image in filename (the first 64K, and the next 64K into hibank);
+// "-" reads stdin.
+//
+// Returns: 0=loaded
+//          1=can't open file or out of memory
+
+int image_open (lcdis_type * ctx, char * filename)
+{
+   int fd;
+   int failed;
+
+   image_close (ctx);
+   if (strcmp (filename, "-") == 0)
+      fd = 0;
+   else
+   if ((fd = open (filename, O_RDONLY)) < 0)
+      return 1;
+   failed = map_image (ctx, fd) && read_image (ctx, fd);
+   if (!failed)
+      read_hibank (ctx, fd);
+   if (fd != 0)
+      close (fd);
+   if (!failed && size_maps (ctx))
+   {  image_close (ctx);
+      failed = 1;
+   }
+   return failed;
+}
+
+
+// Loads len bytes of image from data (server.c); they're copied, so data
+// can go away afterwards.
+//
+// Returns: 0=loaded
+//          1=out of memory
+
+int image_open_mem (lcdis_type * ctx, const unsigned char * data, int len)
+{
+   image_close (ctx);
+   if ((ctx->mem = (unsigned char *) calloc (0x10000+MAP_SLACK, 1)) == NULL)
+      return 1;
+   ctx->memsize = (len > 0x10000) ? 0x10000 : len;
+   memcpy (ctx->mem, data, ctx->memsize);
+   if (len > 0x10000)
+   {  ctx->hisize = (len > 0x20000) ? 0x10000 : len - 0x10000;
+      if ((ctx->hibank = (unsigned char *) malloc (ctx->hisize)) == NULL)
+         ctx->hisize = 0;
+      else
+         memcpy (ctx->hibank, data + 0x10000, ctx->hisize);
+   }
+   if (size_maps (ctx))
+   {  image_close (ctx);
+      return 1;
+   }
+   return 0;
+}
+
+
+// Lets go of the image. The maps are kept for the next one, but nothing
+// in them is used any more (ctx->mapsize is 0).
+
+void image_close (lcdis_type * ctx)
+{
+   if (ctx->mem)
+   {  if (ctx->memmaplen)
+         munmap (ctx->mem, ctx->memmaplen);
+      else
+         free (ctx->mem);
+   }
+   if (ctx->hibank)
+   {  if (ctx->himaplen)
+         munmap (ctx->hibank, ctx->himaplen);
+      else
+         free (ctx->hibank);
+   }
+   ctx->mem       = NULL;
+   ctx->memmaplen = 0;
+   ctx->memsize   = 0;
+   ctx->mapsize   = 0;
+   ctx->hibank    = NULL;
+   ctx->himaplen  = 0;
+   ctx->hisize    = 0;
+}
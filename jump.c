@@ -0,0 +1,487 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, computed jumps
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The LC86K has no indirect jump, so a dispatch through a table is done by
+ * reading the two halves of the target with LDC, pushing them (low byte
+ * first, the way CALL does) and executing RET. mapmem can't follow that;
+ * the code it goes to stays unknown unless it's given as ENTRYn.
+ *
+ * After tracing, every RET is looked at together with the run of code
+ * leading up to it (its block, and the blocks before it as long as each has
+ * a single way in). That code is run symbolically: ACC and the memory it
+ * touches hold a constant, "the index" (whatever was in ACC or a variable
+ * when the run started) times a scale plus an offset, or a byte read with
+ * LDC from a known TRH:TRL at such an index. A RET that pops two bytes the
+ * run pushed itself is a computed jump, and if both bytes come from tables
+ * (or are constants) the targets can be read out of the image.
+ *
+ * The number of entries comes from the run: a compare (BE/BNE #n, or
+ * SUB #n and a test of the carry) or an AND #mask on the index. Without
+ * one, entries are taken as long as they point at plausible code that
+ * isn't mapped yet (the zeros after a table point at the reset code) and
+ * the table doesn't run into anything already mapped, up to JUMP_MAX;
+ * an entry that repeats an earlier target, or that an earlier round
+ * already read, doesn't end it. Each new
+ * target is traced as an entry point, which may turn up more dispatches;
+ * the tables are marked MEM_DATA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lcdis.h"
+
+#define OP_RET        0xA0
+#define OP_LDC        0xC1
+
+#define SFR_ACC       0x100
+#define SFR_PSW       0x101
+#define SFR_TRL       0x104
+#define SFR_TRH       0x105
+
+#define JUMP_RUN      64       // instructions looked at before a RET
+#define JUMP_MAX      64       // entries in a table with no bound in the code
+#define JUMP_ROUNDS   8        // trace, look again, ...
+#define JUMP_VARS     16       // memory locations a run keeps track of
+#define JUMP_STACK    8
+
+#define SYM_UNKNOWN   0
+#define SYM_CONST     1        // off
+#define SYM_INDEX     2        // scale*X[v] + off
+#define SYM_TABLE     3        // the byte at base + scale*X[v] + off
+
+typedef struct
+{
+   int    kind;                // SYM_xxx
+   int    v;                   // which index: where it was when the run started
+   int    base;
+   int    scale, off;
+} sym_type;
+
+typedef struct
+{
+   sym_type acc;
+   int      addr[JUMP_VARS];   // memory that's been stored to, loaded from
+   sym_type val[JUMP_VARS];
+   int      nvars;
+   sym_type stack[JUMP_STACK];
+   int      sp;
+   int      bound;             // entries, as far as a compare says; 0=don't know
+   int      subbed;            // SUB #n just done on the index: n, else -1
+} run_type;
+
+
+static void sym_unknown (sym_type * s)
+{
+   memset (s, 0, sizeof (sym_type));
+}
+
+
+static void sym_const (sym_type * s, int c)
+{
+   sym_unknown (s);
+   s->kind = SYM_CONST;
+   s->off  = c & 0xFF;
+}
+
+
+// what's at d9 address addr (a fresh index if the run hasn't touched it)
+static sym_type * var (run_type * r, int addr)
+{
+   int i;
+
+   if (addr == SFR_ACC)
+      return &r->acc;
+   for (i=0; i<r->nvars; i++)
+      if (r->addr[i] == addr)
+         return &r->val[i];
+   if (r->nvars == JUMP_VARS)           // forget the oldest
+   {  memmove (r->addr, r->addr + 1, (JUMP_VARS-1) * sizeof (int));
+      memmove (r->val, r->val + 1, (JUMP_VARS-1) * sizeof (sym_type));
+      r->nvars--;
+   }
+   i = r->nvars++;
+   r->addr[i] = addr;
+   sym_unknown (&r->val[i]);
+   r->val[i].kind  = SYM_INDEX;
+   r->val[i].v     = addr;
+   r->val[i].scale = 1;
+   return &r->val[i];
+}
+
+
+// the index can be 0 to n-1
+static void bound (run_type * r, int n)
+{
+   if ((n > 0) && ((r->bound == 0) || (n < r->bound)))
+      r->bound = n;
+}
+
+
+static void add (sym_type * s, int c)
+{
+   if ((s->kind == SYM_CONST) || (s->kind == SYM_INDEX))
+      s->off += c;
+   else
+      sym_unknown (s);
+   if (s->kind == SYM_CONST)
+      s->off &= 0xFF;
+}
+
+
+// Runs one instruction.
+
+static void run_step (lcdis_type * ctx, run_type * r, int pin)
+{
+   unsigned char * m = &ctx->mem[pin];
+   decode_type * d = &decode[m[0]];
+   sym_type * s;
+   sym_type t;
+   int addr, base;
+   int subbed = r->subbed;
+
+   r->subbed = -1;
+   if (d->flow == FLOW_CALL)            // registers and memory could be anything after
+   {  sym_unknown (&r->acc);
+      r->nvars = 0;
+      return;
+   }
+
+   switch (m[0])
+   {
+      case 0x02: case 0x03:                       // LD d9
+         r->acc = *var (r, get_d9 (ctx, pin));
+         return;
+
+      case 0x12: case 0x13:                       // ST d9
+         *var (r, get_d9 (ctx, pin)) = r->acc;
+         return;
+
+      case 0x22: case 0x23:                       // MOV #i8,d9
+         sym_const (var (r, get_d9 (ctx, pin)), m[2]);
+         return;
+
+      case 0x60: case 0x61:                       // PUSH d9
+         if (r->sp == JUMP_STACK)
+         {  memmove (r->stack, r->stack + 1, (JUMP_STACK-1) * sizeof (sym_type));
+            r->sp--;
+         }
+         r->stack[r->sp++] = *var (r, get_d9 (ctx, pin));
+         return;
+
+      case 0x70: case 0x71:                       // POP d9
+         s = var (r, get_d9 (ctx, pin));
+         if (r->sp)
+            *s = r->stack[--r->sp];
+         else
+            sym_unknown (s);
+         return;
+
+      case 0x62: case 0x63:                       // INC d9
+         add (var (r, get_d9 (ctx, pin)), 1);
+         return;
+
+      case 0x72: case 0x73:                       // DEC d9
+         add (var (r, get_d9 (ctx, pin)), -1);
+         return;
+
+      case 0x81:                                  // ADD #i8
+         add (&r->acc, m[1]);
+         return;
+
+      case 0xA1:                                  // SUB #i8
+         if ((r->acc.kind == SYM_INDEX) && (r->acc.scale == 1))
+            r->subbed = m[1] - r->acc.off;
+         add (&r->acc, -m[1]);
+         return;
+
+      case 0xE1:                                  // AND #i8
+         if (r->acc.kind == SYM_CONST)
+            r->acc.off &= m[1];
+         else
+         if ((r->acc.kind == SYM_INDEX) && (r->acc.scale == 1) && (r->acc.off == 0)
+             && !(m[1] & (m[1] + 1)))             // a mask of low bits
+            bound (r, m[1] + 1);
+         else
+            sym_unknown (&r->acc);
+         return;
+
+      case 0x82: case 0x83:                       // ADD d9
+         s = var (r, get_d9 (ctx, pin));
+         if ((r->acc.kind == SYM_INDEX) && (s->kind == SYM_INDEX) && (r->acc.v == s->v))
+         {  t = *s;                               // ADD ACC, or the index again
+            r->acc.scale += t.scale;
+            r->acc.off   += t.off;
+         }
+         else
+         if (s->kind == SYM_CONST)
+            add (&r->acc, s->off);
+         else
+            sym_unknown (&r->acc);
+         return;
+
+      case 0xE0: case 0xF0:                       // ROL, ROLC: twice (the carry's usually clear)
+         if (r->acc.kind == SYM_INDEX)
+         {  r->acc.scale *= 2;
+            r->acc.off   *= 2;
+         }
+         else
+         if (r->acc.kind == SYM_CONST)
+            r->acc.off = (r->acc.off << 1) & 0xFF;
+         else
+            sym_unknown (&r->acc);
+         return;
+
+      case OP_LDC:                                // LDC: the byte at TRH:TRL+ACC
+         s = var (r, SFR_TRL);
+         t = *var (r, SFR_TRH);
+         if ((s->kind != SYM_CONST) || (t.kind != SYM_CONST))
+         {  sym_unknown (&r->acc);
+            return;
+         }
+         base = (t.off << 8) | s->off;
+         if (r->acc.kind == SYM_CONST)
+            sym_const (&r->acc, ctx->mem[(base + r->acc.off) & 0xFFFF]);
+         else
+         if (r->acc.kind == SYM_INDEX)
+         {  r->acc.kind = SYM_TABLE;
+            r->acc.base = base;
+         }
+         else
+            sym_unknown (&r->acc);
+         return;
+
+      case 0x31: case 0x41:                       // BE, BNE #i8,r8: compares ACC
+         if ((r->acc.kind == SYM_INDEX) && (r->acc.scale == 1))
+            bound (r, m[1] - r->acc.off);
+         return;
+   }
+
+   if ((d->operand == 'r') && (get_d9bit (ctx, pin) == SFR_PSW) && ((m[0] & 7) == 7) && (subbed > 0))
+   {  bound (r, subbed);                          // BN/BP PSW,7 (carry) after SUB #n
+      return;
+   }
+
+   if (d->writes)                                 // anything else stored somewhere
+   {  switch (d->operand)
+      {
+         case '9':
+         case '^':
+         case 'x':
+            addr = get_d9 (ctx, pin);
+            break;
+         case 'b':
+            addr = get_d9bit (ctx, pin);
+            if (addr == SFR_PSW)                  // the carry or the bank
+               return;
+            break;
+         default:                                 // @Ri: could be anywhere
+            r->nvars = 0;
+            sym_unknown (&r->acc);
+            return;
+      }
+      if ((m[0] & 0xF0) == 0xC0)                  // XCH: ACC gets the old value
+      {  t = *var (r, addr);
+         *var (r, addr) = r->acc;
+         r->acc = t;
+         return;
+      }
+      sym_unknown (var (r, addr));
+      return;
+   }
+
+   // anything else that leaves something new in ACC
+   if (   (m[0] == 0x30) || (m[0] == 0x40) || (m[0] == 0x50)          // MUL, DIV, LDF
+       || ((m[0] >= 0xC0) && ((m[0] & 0x0F) == 0))                    // ROR, RORC
+       || ((m[0] < 0x10) && ((m[0] & 0x0F) >= 4) && ((m[0] & 0x0F) < 8))   // LD @Ri
+       || ((m[0] >= 0x80) && ((m[0] & 0x0F) >= 1) && ((m[0] & 0x0F) < 8)))  // ALU
+      sym_unknown (&r->acc);
+}
+
+
+// The byte of table symbol s for entry k, or -1 if it's somewhere that
+// can't be a table.
+
+static int table_byte (lcdis_type * ctx, sym_type * s, int k)
+{
+   int addr;
+
+   if (s->kind == SYM_CONST)
+      return s->off;
+   addr = s->base + s->scale * k + s->off;
+   if ((addr < 0) || (addr >= ctx->memsize)
+       || ((ctx->mem_use[addr] != MEM_UNKNOWN) && (ctx->mem_use[addr] != MEM_DATA)))
+      return -1;
+   return ctx->mem[addr];
+}
+
+
+// Could execution start at t?
+
+static int code_at (lcdis_type * ctx, int t)
+{
+   if ((t < 0) || (t >= ctx->memsize))
+      return 0;
+   if (!ctx->biosmode && ((t >= 0x200) && ((t < 0x280) || is_icon (ctx, t))))
+      return 0;                          // the file header and icons
+   switch (ctx->mem_use[t])
+   {
+      case MEM_UNKNOWN:
+         return decode[ctx->mem[t]].flow != FLOW_ILLEGAL;
+      case MEM_CODE:
+      case MEM_CODE_LABELED:
+         return 1;
+   }
+   return 0;
+}
+
+
+// Was entry k of table symbol s read in an earlier round (and marked)?
+
+static int table_marked (lcdis_type * ctx, sym_type * s, int k)
+{
+   if (s->kind != SYM_TABLE)
+      return 1;
+   return ctx->mem_use[s->base + s->scale * k + s->off] == MEM_DATA;
+}
+
+
+static void mark_table (lcdis_type * ctx, sym_type * s, int n)
+{
+   int k, addr;
+
+   if (s->kind != SYM_TABLE)
+      return;
+   for (k=0; k<n; k++)
+   {  addr = s->base + s->scale * k + s->off;
+      if (ctx->mem_use[addr] == MEM_UNKNOWN)
+         ctx->mem_use[addr] = MEM_DATA;   // a table of words is marked half by half
+   }
+}
+
+
+// Looks at the RET that ends block k.
+//
+// Returns: targets queued for tracing
+
+static int dispatch (lcdis_type * ctx, int k)
+{
+   cfg_type * g = ctx->cfg;
+   cfg_block_type * b;
+   cfg_edge_type * e;
+   run_type r;
+   sym_type hi, lo;
+   int chain[JUMP_RUN];
+   int nchain=0, ninsns=0;
+   int mine[JUMP_MAX];        // targets this table has given so far
+   int i, j, n, t, h, l, pin;
+   int queued=0;
+   char header[80];
+
+   // the run: back through blocks with one way in, to the function's start at most
+   for (i=k; ; i=e->from)
+   {  chain[nchain++] = i;
+      ninsns += g->blocks[i].ninsns;
+      if ((nchain == JUMP_RUN) || (ninsns >= JUMP_RUN) || (g->blocks[i].npred != 1))
+         break;
+      e = &g->edges[g->preds[g->blocks[i].pred]];
+      if ((e->kind == CFG_CALL) || (e->kind == CFG_RETURN) || (e->from == k))
+         break;
+   }
+
+   memset (&r, 0, sizeof (r));
+   r.acc.kind  = SYM_INDEX;              // whatever ACC had before the run
+   r.acc.v     = SFR_ACC;
+   r.acc.scale = 1;
+   r.subbed    = -1;
+   while (nchain)
+   {  b = &g->blocks[chain[--nchain]];
+      for (pin=b->start; pin<b->last; pin+=decode[ctx->mem[pin]].len)
+         run_step (ctx, &r, pin);
+      if (nchain)
+         run_step (ctx, &r, b->last);
+   }
+   if (r.sp < 2)
+      return 0;                          // an ordinary return
+   hi = r.stack[r.sp-1];
+   lo = r.stack[r.sp-2];
+   if (   ((hi.kind != SYM_TABLE) && (hi.kind != SYM_CONST))
+       || ((lo.kind != SYM_TABLE) && (lo.kind != SYM_CONST))
+       || ((hi.kind == SYM_TABLE) && (lo.kind == SYM_TABLE) && (hi.v != lo.v)))
+      return 0;
+
+   n = ((hi.kind == SYM_CONST) && (lo.kind == SYM_CONST)) ? 1
+     : r.bound ? r.bound : JUMP_MAX;
+   if ((hi.kind == SYM_TABLE) && (lo.kind == SYM_TABLE) && (hi.scale == 1) && (lo.scale == 1))
+   {  t = (hi.base + hi.off) - (lo.base + lo.off);      // one table straight after the other
+      if ((t < 0) && (-t < n))
+         n = -t;
+      if ((t > 0) && (t < n))
+         n = t;
+   }
+   for (i=0; i<n; i++)
+   {
+      h = table_byte (ctx, &hi, i);
+      l = table_byte (ctx, &lo, i);
+      t = (h << 8) | l;
+      if ((h < 0) || (l < 0) || !code_at (ctx, t))
+         break;
+      if (!r.bound && (n > 1) && (ctx->mem_use[t] != MEM_UNKNOWN)
+          && !(table_marked (ctx, &hi, i) && table_marked (ctx, &lo, i)))
+      {  for (j=0; (j<i) && (mine[j] != t); j++)
+            ;
+         if (j == i)
+            break;               // no bound: mapped code here means we're past the end
+      }
+      mine[i] = t;
+      if ((ctx->mem_use[t] == MEM_UNKNOWN) && !ctx->gaveup)
+      {  header[0] = 0;
+         if (!queued)
+            snprintf (header, sizeof (header), "; Mapping memory...   computed jump at $%04x\n",
+                      g->blocks[k].last);
+         queue_entry (ctx, t, (ctx->mem_bnk[g->blocks[k].last] == BNK_VARIOUS)
+                              ? BNK_UNKNOWN : ctx->mem_bnk[g->blocks[k].last], header);
+         ctx->mem_use[t] = MEM_CODE_LABELED;   // not queued twice; tracing labels it anyway
+         queued++;
+      }
+   }
+   mark_table (ctx, &hi, i);
+   mark_table (ctx, &lo, i);
+   return queued;
+}
+
+
+// Finds computed jumps and traces where they go (see top of file). Part of
+// lcdis_map_tables, before the LDC tables are marked.
+
+void jump_map (lcdis_type * ctx)
+{
+   int round, k, queued, pin, start;
+
+   for (round=0; round<JUMP_ROUNDS; round++)
+   {
+      // only worth a graph if there's both an LDC and a RET in the code
+      for (pin=0, start=0; (pin>=0) && (pin<ctx->memsize); pin=next_line (ctx, pin))
+         if ((ctx->mem_use[pin] == MEM_CODE) || (ctx->mem_use[pin] == MEM_CODE_LABELED))
+            start |= (ctx->mem[pin] == OP_LDC) ? 1 : (ctx->mem[pin] == OP_RET) ? 2 : 0;
+      if ((start != 3) || cfg_build (ctx))
+         return;
+
+      queued = 0;
+      for (k=0; k<ctx->cfg->nblocks; k++)
+         if (ctx->mem[ctx->cfg->blocks[k].last] == OP_RET)
+            queued += dispatch (ctx, k);
+      if (!queued)
+         return;
+      for (k=ctx->nentries-queued; k<ctx->nentries; k++)
+         ctx->mem_use[ctx->entries[k].pin] = MEM_UNKNOWN;   // for mapmem to find
+      trace_entries (ctx);
+      cfg_free (ctx);
+   }
+}
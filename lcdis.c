@@ -39,7 +39,7 @@
  *   Beta 0.7 - mapmem thought that "BR" was a conditional branch; it's really always taken.
  *            - mapmem deals with jump to other banks more realistically (FIRMWARECALL)
  *            - mapmem doesn't continue to follow code once it hits an illegal instruction
- *            - removed legacy mem_use[branchaddr]=MEM_CODE_LABELED instructions
+ *            - removed legacy ctx->mem_use[branchaddr]=MEM_CODE_LABELED instructions
  *            - changed "*** WARNING: used as both code and data:" error to more accurate
  *              "*** WARNING: this is the target of a possibly misaligned jump:"
  *              The general behavior here is a bit better.
@@ -94,6 +94,71 @@
  *              source. This respects the object code writer's copyright while
  *              allowing people to distribute their annotations.
  *   Rel 1.04 - A few more autocomments relating to the serial port.
+ *   Rel 1.05 - Opcodes are decoded once into decode[] (length, operand, flow class and
+ *              branch target); mapmem, dis_code and opcode_len no longer compare model strings.
+ *            - All state moved into an lcdis_type context, so several images can be disassembled
+ *              in one process. The disassembler is now a library (liblcdis.a, lcdis.h); main.c
+ *              is the command-line program and the tables moved to lcdistab.h.
+ *            - Added batch mode (--batch): disassembles a directory or list of images on a
+ *              pool of worker threads, one listing per image.
+ *            - mapmem no longer recurses: branch targets go on a trace stack that grows
+ *              as needed, so deep code can't overflow the C stack and trace stacks in
+ *              warnings are complete past 200 levels. A misaligned-code warning no
+ *              longer leaves a stale entry in later trace stacks.
+ *            - The standard entry points and ENTRYn points are queued up and traced
+ *              together (trace.c).
+ *            - Output goes through a buffered writer (output.c) with hand-rolled hex and
+ *              decimal, written out in large blocks to a file descriptor or kept in memory.
+ *            - SFR and MEM names are looked up in direct-indexed tables and code labels
+ *              in a hash table (init_symbols) instead of walking the lists.
+ *            - CODECMTS[] is grouped by opcode, so only the patterns for the instruction's
+ *              opcode are tried, and every pattern that fits is printed (not just the first).
+ *            - The image file is mmap'ed read-only (image.c) instead of read into a 64K buffer,
+ *              and mem_use/mem_bnk are only as big as the image; addresses past the end are
+ *              handled by get_use/set_use.
+ *            - Added FLASH mode for 128K flash dumps (flash.c): code is still traced in the
+ *              first 64K, the upper 64K is listed as data, and LDF/STF are annotated with
+ *              the flash address as far as FLASHA16 bit 0, TRH and TRL can be followed.
+ *            - search_text moved to text.c and reads the image once, 16 bytes at a time
+ *              (SSE2 where there is one); it finds exactly the strings it used to.
+ *            - Added --json and --binary (export.c): the analysis as JSON lines or as
+ *              mmap-able fixed records, with instructions, regions, labels and banks.
+ *            - Added --cache dir (cache.c): the memory map is kept on disk by image and
+ *              options; a rerun loads it instead of tracing.
+ *            - Added XREF (xref.c): a cross-reference index of code and data addresses,
+ *              made once mapping is done, with "; xref:" lines at labels.
+ *            - Added a control-flow graph (cfg.c): basic blocks, typed edges and functions
+ *              in flat arrays, built from the maps by cfg_build.
+ *            - Added make bench: vmugen writes synthetic images (long code runs, deep call
+ *              chains, dense branches, text and graphics, 128K flash) and lcdisbench times
+ *              mapmem, search_text and the listing separately in ns/instruction and MB/s.
+ *            - Added --stats (stats.c): time per phase and per entry point, and tracer
+ *              counters, to stderr as text or JSON; also per image in batch mode. The
+ *              counters are only compiled in with LCDIS_STATS.
+ *            - mapmem traces code again when it is reached with a bank it hasn't been
+ *              traced with (a bitmap of traced instructions per bank), so mem_bnk no
+ *              longer depends on which path got there first; an unknown bank no longer
+ *              turns a known one into BNK_VARIOUS. Warnings aren't repeated.
+ *            - POP PSW restores the bank of the matching PUSH PSW, and each function gets a
+ *              summary of what it does to the bank (keeps it, sets it, pops the caller's
+ *              PSW) from its RETs, applied after each call to it. A call to a function
+ *              already traced with that bank uses the summary instead of tracing it again.
+ *            - Added ldc.c: constants in TRL, TRH, ACC, B and C are followed through the
+ *              control-flow graph; LDCs are commented with their table address and the
+ *              tables are marked MEM_DATA before search_text.
+ *            - Added jump.c: dispatches through tables (LDC the target, PUSH it, RET) are
+ *              found by running the code before each RET symbolically; the table size
+ *              comes from a compare or mask of the index, and the targets are traced.
+ *            - An input file of "-" is read from stdin (the upper 64K of a flash dump too).
+ *              --stream writes the listing out a region at a time instead of in 64K chunks.
+ *            - Added server.c (--serve, --client): images are analysed once and kept in
+ *              memory, least recently used thrown out first, to answer listing, label and
+ *              xref questions over a Unix socket.
+ *            - Added annot.c (--annotate): labels, comments and directives from an annotation
+ *              file, held in a sorted index that --compile-annotations writes out to be mmap'ed.
+ *            - Added diff.c (--diff): matches the functions of two images by position-free
+ *              hashes and lists the changed ones side by side. cfg.c also starts a function
+ *              at code nothing else in the graph reaches (ENTRYn, computed jump targets).
  *
  */
 
@@ -102,6 +167,7 @@
 #include <string.h>
 #include <memory.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "lcdis.h"
 
 // This define needed for SUN environments:
@@ -109,183 +175,427 @@
 #define strncmp(x,y,z) strncasecmp(x,y,z)
 #endif
 
-// big ugly global variables:
-unsigned char mem[0x10000];     // 64K of memory max.
-unsigned char mem_use[0x10000]; // memory usage:
-unsigned char mem_bnk[0x10000]; // memory usage:
-int strictmode=0;               // strict mode that stops at first sign of memmap going amok.
-int asmout=0;                   // for compiler-compatible output.
-int biosmode=0;                 // for disassembling bios
+#include "lcdistab.h"
 
-int main (int argc, char * argv[])
+// The only globals left are the decode table and the symbol indexes; they
+// are built once by init_decode and init_symbols (whichever thread gets to
+// lcdis_new first) and are read-only afterwards, so any number of contexts
+// can share them.
+decode_type decode[256];        // per-opcode decode table, see init_decode
+static pthread_once_t decode_once = PTHREAD_ONCE_INIT;
+
+static char * mem_name[0x200];  // MEM[] text by banked address (0x000-0x1FF)
+static char * sfr_name[0x200];  // SFR[] text by address
+static int  * label_hash;       // LABELS[] index by address; -1=empty slot
+static unsigned int label_mask; // label_hash size-1 (a power of two)
+static int    cmt_first[257];   // CODECMTS[] for opcode x: cmt_list[cmt_first[x]..cmt_first[x+1]-1]
+static int  * cmt_list;         // CODECMTS[] indices, by opcode then list order
+
+
+//------------------------------------------------------------------------------------
+// Library entry points. A caller (see main.c) does:
+//
+//    ctx = lcdis_new();                     // output goes to stdout by default
+//    lcdis_banner(ctx);
+//    lcdis_load(ctx, "game.vms");
+//    lcdis_option(ctx, "ENTRY0x139");       // as many as wanted, in order
+//    lcdis_map(ctx);                        // trace the standard entry points
+//    lcdis_listing(ctx);
+//    lcdis_free(ctx);
+//
+// ctx->out is buffered (see output.c). To send the listing elsewhere,
+// out_close it and out_open it on another file descriptor, or out_open_mem it.
+//
+// Every bit of state lives in the lcdis_type, so separate contexts can be used
+// at the same time (from different threads, too).
+//------------------------------------------------------------------------------------
+
+static void init_tables (void)
 {
-  FILE * fin;
-  int memsize;
-  int pin, p1;    // address counters
-  int count;
-  int i;
+   init_decode();
+   init_symbols();
+}
+
+
+lcdis_type * lcdis_new (void)
+{
+   lcdis_type * ctx;
+
+   pthread_once (&decode_once, init_tables);
+
+   ctx = (lcdis_type *) calloc (1, sizeof (lcdis_type));
+   if (ctx == NULL)
+      return NULL;
+
+   // mem, mem_use and mem_bnk come with the image (lcdis_load)
+   ctx->outside = (unsigned char *) calloc (0x10000/8, 1);   // lcdis_reset only clears
+   ctx->seen    = (unsigned char *) calloc (SEEN_BYTES, 1);  //    what an image used
+   ctx->effect  = (unsigned char *) calloc (0x10000, 1);
+   ctx->tracesize = 256;
+   ctx->trace   = (trace_type *) malloc (ctx->tracesize * sizeof (trace_type));
+   if (!ctx->outside || !ctx->seen || !ctx->effect || !ctx->trace || out_open (&ctx->out, 1))
+   {  lcdis_free (ctx);
+      return NULL;
+   }
+
+   lcdis_reset (ctx);
+   return ctx;
+}
+
+
+// Forgets the loaded image and all options so the context can be reused
+// for another file (ctx->out is left alone).
+
+void lcdis_reset (lcdis_type * ctx)
+{
+   int used;
+   int bnk;
+
+   // A trace only marks seen and effect inside the maps and outside past
+   // them, so a small image leaves little to clear for the next one.
+   used = (ctx->mapsize < 0x10000) ? ctx->mapsize : 0x10000;
+   memset(ctx->outside + used/8, 0, 0x10000/8 - used/8);
+   for (bnk=BNK_BANK0; bnk<=BNK_UNKNOWN; bnk++)
+      memset(ctx->seen + bnk * 0x2000, 0, (used+7)/8);
+   memset(ctx->effect, 0, used);
+   image_close (ctx);
+   ctx->strictmode = 0;
+   ctx->asmout     = 0;
+   ctx->biosmode   = 0;
+   ctx->flashmode  = 0;
+   ctx->xrefmode   = 0;
+   xref_free (ctx);
+   cfg_free (ctx);
+   ldc_free (ctx);
+   ctx->nentries   = 0;
+   ctx->gaveup     = 0;
+   stats_reset (ctx);
+}
+
+
+// Also flushes the output, and frees it if it's a memory buffer.
 
-  printf ("; LC86104C/108C disassembler. (C) 1999-2000 John Maushammer.\n"
+void lcdis_free (lcdis_type * ctx)
+{
+   if (ctx == NULL)
+      return;
+   out_close (&ctx->out);
+   if (ctx->out.fd < 0)
+      free (ctx->out.buf);
+   image_close (ctx);
+   xref_free (ctx);
+   cfg_free (ctx);
+   ldc_free (ctx);
+   annot_free (ctx);
+   free (ctx->mem_use);
+   free (ctx->mem_bnk);
+   free (ctx->outside);
+   free (ctx->seen);
+   free (ctx->effect);
+   free (ctx->trace);
+   free (ctx->entries);
+   free (ctx->stats.entries);
+   free (ctx);
+}
+
+
+void lcdis_banner (lcdis_type * ctx)
+{
+  out_printf (&ctx->out, "; LC86104C/108C disassembler. (C) 1999-2000 John Maushammer.\n"
           ";  Version 1.04                             john@maushammer.com\n"
           ";  GNU public liscense - see www.gnu.org\n;\n;\n");
+}
+
+
+// Returns: 0=loaded
+//          1=can't open file
 
-  if (argc < 2)
-  {  printf ("lcdis inputfile.vms {[entrypoint] ...}> outputfile\n\n"
-             "  STRICT         - kills bad 'veins'; helps prevent disassembly of bad code and\n"
-             "                   finds errors, but stops before all good code is disassembled\n"
-             "  ASMOUT         - outputs cleaner code for use with an assembler\n"
-             "  BIOS           - interpret file as a BIOS (use before ENTRY)\n"
-             "  ENTRYn         - define code starting at address n\n"
-             "  GRAPHBYTESn,b  - define b bytes of graphics at address n\n"
-             "  FONT8,n,b      - define b bytes of 8-bit wide fonts at address n\n"
-             "  GRAPHPAGESn,p  - define p pages (=0xC0 bytes) of graphics at address n\n\n"
-             "In addition to the standard entry points, other points can be disassembled.\n"
-             "Enter these as parameters after the input file. Use decimal or the 0x notation.\n"
-             "Example:\n"
-             "    lcdis football.vms ENTRY0x139 > football.lst\n\n");
+int lcdis_load (lcdis_type * ctx, char * filename)
+{
+  STAT_START (start);
+
+  out_printf (&ctx->out, "; Source file=%s, ", filename);
+  if (image_open (ctx, filename))
+  {  out_printf (&ctx->out, "can not open!\n");
      return (1);
   }
 
-  printf ("; Source file=%s, ", argv[1]);
-  if ( (fin = fopen(argv[1],"rb")) == NULL)
-  {  printf ("can not open!\n");
+  out_printf (&ctx->out, "%d (0x%04x) bytes.\n", ctx->memsize, ctx->memsize);
+  STAT_TIME (ctx, load, start);
+  return (0);
+}
+
+
+// The same for an image that's already in memory; name is only printed.
+//
+// Returns: 0=loaded
+//          1=out of memory
+
+int lcdis_load_mem (lcdis_type * ctx, char * name, const unsigned char * data, int len)
+{
+  STAT_START (start);
+
+  out_printf (&ctx->out, "; Source file=%s, ", name);
+  if (image_open_mem (ctx, data, len))
+  {  out_printf (&ctx->out, "out of memory!\n");
      return (1);
   }
 
-  memset(mem,     0x00,       0x10000); // clear memory
-  memset(mem_use, MEM_UNUSED, 0x10000); // clear memory
-  memset(mem_bnk, BNK_UNKNOWN,0x10000); // clear memory
+  out_printf (&ctx->out, "%d (0x%04x) bytes.\n", ctx->memsize, ctx->memsize);
+  STAT_TIME (ctx, load, start);
+  return (0);
+}
 
-  memsize=fread((void *) mem, sizeof (char), 0x10000, fin);
-  fclose(fin);
-  printf ("%d (0x%04x) bytes.\n", memsize, memsize);
-  memset(mem_use, MEM_UNKNOWN, memsize); // clear memory
 
-  if (argc >= 3)  // if extra command-line arguments, then parse here
-  {
-    for (i=2; i<argc; i++)
-    {
-       if (strcmp(argv[i], "STRICT")==0)
-       {
-           printf ("; Strict mode enabled.\n");
-           strictmode=1;
+// Applies one command-line directive (STRICT, ENTRYn, ...). Directives take
+// effect in order, just like they always have; ENTRYn points are traced a
+// little later (see trace_entries) but print as if they were traced here.
+//
+// Returns: 0=ok
+//          1=couldn't parse or unknown (a warning has been printed)
+
+int lcdis_option (lcdis_type * ctx, char * arg)
+{
+   int pin, count;
+   char header[80];
+
+   // ENTRY points are only queued; anything else sees all the entry points
+   // before it traced first.
+   if ((strncmp(arg, "ENTRY", 5)!=0) || (1!=sscanf(& (arg[5]), "%i", &pin)))
+      trace_entries (ctx);
+
+   if (strcmp(arg, "STRICT")==0)
+   {
+       out_printf (&ctx->out, "; Strict mode enabled.\n");
+       ctx->strictmode=1;
+   }
+   else
+   if (strcmp(arg, "ASMOUT")==0)
+   {
+       out_printf (&ctx->out, "; Assembler output mode output enabled.\n");
+       ctx->asmout=1;
+   }
+   else
+   if (strcmp(arg, "BIOS")==0)
+   {
+       out_printf (&ctx->out, "; BIOS disassembly mode enabled.\n");
+       ctx->biosmode=1;
+   }
+   else
+   if (strcmp(arg, "FLASH")==0)
+   {
+       out_printf (&ctx->out, "; Flash mode enabled: %d (0x%05x) bytes of flash.\n",
+                   ctx->memsize + ctx->hisize, ctx->memsize + ctx->hisize);
+       ctx->flashmode=1;
+   }
+   else
+   if (strcmp(arg, "XREF")==0)
+   {
+       out_printf (&ctx->out, "; Cross references enabled.\n");
+       ctx->xrefmode=1;
+   }
+   else
+   if (strncmp(arg, "ENTRY", 5)==0)
+   {
+       if (1==sscanf(& (arg[5]), "%i", &pin))
+       {  snprintf (header, sizeof (header), "; Mapping memory...   user-defined point $%04x\n", pin);
+          queue_entry (ctx, pin, BNK_BANK1, header);
        }
        else
-       if (strcmp(argv[i], "ASMOUT")==0)
-       {
-           printf ("; Assembler output mode output enabled.\n");
-           asmout=1;
+       {  out_printf (&ctx->out, "WARNING: cannot parse value in '%s'. Must use decimal or 0x notation.\n", arg);
+          return (1);
        }
-       else
-       if (strcmp(argv[i], "BIOS")==0)
-       {
-           printf ("; BIOS disassembly mode enabled.\n");
-           biosmode=1;
+   }
+   else
+   if (strncmp(arg, "GRAPHBYTES", 10)==0)
+   {
+       if (2==sscanf(& (arg[10]), "%i,%i", &pin, &count))
+       {  out_printf (&ctx->out, "; Mapping graphics... user-defined point $%04x-$%04x ($%04x bytes)\n", pin, pin+count-1, count);
+          while (count-- && (pin>=0) && (pin < ctx->mapsize))
+             ctx->mem_use[pin++]=MEM_GRAPHICS;
        }
        else
-       if (strncmp(argv[i], "ENTRY", 5)==0)
-       {
-           if (1==sscanf(& (argv[i][5]), "%i", &pin))
-           {  printf ("; Mapping memory...   user-defined point $%04x\n", pin);
-              mapmem (pin, BNK_BANK1);
-           }
-           else
-              printf ("WARNING: cannot parse value in '%s'. Must use decimal or 0x notation.\n", argv[i]);
-
+       {  out_printf (&ctx->out, "WARNING: cannot parse value in '%s'. Must use decimal or 0x notation.\n", arg);
+          return (1);
        }
-       else
-       if (strncmp(argv[i], "GRAPHBYTES", 10)==0)
-       {
-           if (2==sscanf(& (argv[i][10]), "%i,%i", &pin, &count))
-           {  printf ("; Mapping graphics... user-defined point $%04x-$%04x ($%04x bytes)\n", pin, pin+count-1, count);
-              while (count-- && (pin>=0) && (pin <= 0xFFFF))
-                 mem_use[pin++]=MEM_GRAPHICS;
-           }
-           else
-              printf ("WARNING: cannot parse value in '%s'. Must use decimal or 0x notation.\n", argv[i]);
-
+   }
+   else
+   if (strncmp(arg, "FONT8,", 6)==0)
+   {
+       if (2==sscanf(& (arg[6]), "%i,%i", &pin, &count))
+       {  out_printf (&ctx->out, "; Mapping 8-bit-wide font... user-defined point $%04x-$%04x ($%04x bytes)\n", pin, pin+count-1, count);
+          while (count-- && (pin>=0) && (pin < ctx->mapsize))
+             ctx->mem_use[pin++]=MEM_FONT8;
        }
        else
-       if (strncmp(argv[i], "FONT8,", 6)==0)
-       {
-           if (2==sscanf(& (argv[i][6]), "%i,%i", &pin, &count))
-           {  printf ("; Mapping 8-bit-wide font... user-defined point $%04x-$%04x ($%04x bytes)\n", pin, pin+count-1, count);
-              while (count-- && (pin>=0) && (pin <= 0xFFFF))
-                 mem_use[pin++]=MEM_FONT8;
-           }
-           else
-              printf ("WARNING: cannot parse value in '%s'. Must use decimal or 0x notation.\n", argv[i]);
-
+       {  out_printf (&ctx->out, "WARNING: cannot parse value in '%s'. Must use decimal or 0x notation.\n", arg);
+          return (1);
        }
-       else
-       if (strncmp(argv[i], "GRAPHPAGES", 10)==0)
+   }
+   else
+   if (strncmp(arg, "GRAPHPAGES", 10)==0)
+   {
+       if (2==sscanf(& (arg[10]), "%i,%i", &pin, &count))
        {
-           if (2==sscanf(& (argv[i][10]), "%i,%i", &pin, &count))
-           {
-              printf ("; Mapping graphics... user-defined point $%04x-$%04x ($%04x pages) \n", pin, pin+(0xC0*count)-1, count);
-              count *= 0xC0;    // packed format
-              while (count-- && (pin>=0) && (pin <= 0xFFFF))
-                 mem_use[pin++]=MEM_GRAPHICS;
-           }
-           else
-              printf ("WARNING: cannot parse value in '%s'. Must use decimal or 0x notation.\n", argv[i]);
-
+          out_printf (&ctx->out, "; Mapping graphics... user-defined point $%04x-$%04x ($%04x pages) \n", pin, pin+(0xC0*count)-1, count);
+          count *= 0xC0;    // packed format
+          while (count-- && (pin>=0) && (pin < ctx->mapsize))
+             ctx->mem_use[pin++]=MEM_GRAPHICS;
        }
        else
-       {   printf ("WARNING: unknown command line directive %s\n", argv[i]);
+       {  out_printf (&ctx->out, "WARNING: cannot parse value in '%s'. Must use decimal or 0x notation.\n", arg);
+          return (1);
        }
-    }
-  }
+   }
+   else
+   {   out_printf (&ctx->out, "WARNING: unknown command line directive %s\n", arg);
+       return (1);
+   }
+   return (0);
+}
 
 
-  printf ("; Mapping memory...   reset/start entry point\n");
+// Traces the standard entry points and looks for text.
+
+void lcdis_map (lcdis_type * ctx)
+{
+  lcdis_trace (ctx);
+  lcdis_map_tables (ctx);
+  lcdis_map_text (ctx);
+}
+
+
+// The first part of lcdis_map: traces the standard entry points (and any
+// ENTRYn still queued).
+
+void lcdis_trace (lcdis_type * ctx)
+{
   // actually the bios probably starts with bank0, but it's code
   // sets it, so it's irrelevant.
-  mapmem (0x00, BNK_BANK1);  // reset/start
+  queue_entry (ctx, 0x00, BNK_BANK1, "; Mapping memory...   reset/start entry point\n");  // reset/start
 
-  printf ("; Mapping memory...   interrupt entry points\n");
   // bank is unknown unless the programmer only uses one bank or takes
   // special precautions
-  mapmem (0x03, BNK_UNKNOWN);  // external interrupt 0?
-  mapmem (0x0b, BNK_UNKNOWN);  // timer/counter 0 interrupt
-  mapmem (0x13, BNK_UNKNOWN);  // external interrupt 1?
-  mapmem (0x1b, BNK_UNKNOWN);  // timer/counter 1 interrupt
-  mapmem (0x23, BNK_UNKNOWN);  // divider circuit/port 1/port 3 interrupt?
-  mapmem (0x2b, BNK_UNKNOWN);  // interrupt
-  mapmem (0x33, BNK_UNKNOWN);  // interrupt
-  mapmem (0x3b, BNK_UNKNOWN);  // interrupt
-  mapmem (0x43, BNK_BANK0);    // interrupt (only acted on by BIOS, not chao nor football, so I guess it's bank0)
-  mapmem (0x4b, BNK_UNKNOWN);  // interrupt
-
-  if (biosmode)
+  queue_entry (ctx, 0x03, BNK_UNKNOWN, "; Mapping memory...   interrupt entry points\n");  // external interrupt 0?
+  queue_entry (ctx, 0x0b, BNK_UNKNOWN, "");  // timer/counter 0 interrupt
+  queue_entry (ctx, 0x13, BNK_UNKNOWN, "");  // external interrupt 1?
+  queue_entry (ctx, 0x1b, BNK_UNKNOWN, "");  // timer/counter 1 interrupt
+  queue_entry (ctx, 0x23, BNK_UNKNOWN, "");  // divider circuit/port 1/port 3 interrupt?
+  queue_entry (ctx, 0x2b, BNK_UNKNOWN, "");  // interrupt
+  queue_entry (ctx, 0x33, BNK_UNKNOWN, "");  // interrupt
+  queue_entry (ctx, 0x3b, BNK_UNKNOWN, "");  // interrupt
+  queue_entry (ctx, 0x43, BNK_BANK0,   "");  // interrupt (only acted on by BIOS, not chao nor football, so I guess it's bank0)
+  queue_entry (ctx, 0x4b, BNK_UNKNOWN, "");  // interrupt
+
+  if (ctx->biosmode)
   {
-     printf ("; Mapping memory...   BIOS entry points\n");
-     mapmem (0x100, BNK_BANK1); // writeFlash
-     mapmem (0x108, BNK_BANK1); // writeFlash2
-     mapmem (0x110, BNK_BANK1); // readFlash
-     mapmem (0x120, BNK_BANK1); // int120link
-     mapmem (0x130, BNK_BANK1); // intT1link    (ROM's T1 interrupt code)
-     mapmem (0x140, BNK_BANK1); // unknown
-     mapmem (0x1f0, BNK_BANK1); // quit
+     queue_entry (ctx, 0x100, BNK_BANK1, "; Mapping memory...   BIOS entry points\n"); // writeFlash
+     queue_entry (ctx, 0x108, BNK_BANK1, ""); // writeFlash2
+     queue_entry (ctx, 0x110, BNK_BANK1, ""); // readFlash
+     queue_entry (ctx, 0x120, BNK_BANK1, ""); // int120link
+     queue_entry (ctx, 0x130, BNK_BANK1, ""); // intT1link    (ROM's T1 interrupt code)
+     queue_entry (ctx, 0x140, BNK_BANK1, ""); // unknown
+     queue_entry (ctx, 0x1f0, BNK_BANK1, ""); // quit
   }
+  trace_entries (ctx);
+}
+
+
+// The second part: follows computed jumps and marks the tables LDC reads.
+
+void lcdis_map_tables (lcdis_type * ctx)
+{
+  STAT_START (start);
+
+  jump_map(ctx);
+  ldc_map(ctx);
+  STAT_TIME (ctx, tables, start);
+}
+
+
+// The last part: looks for text in what's left.
 
-  search_text(memsize);
-  printf ("; Done mapping memory.\n");
+void lcdis_map_text (lcdis_type * ctx)
+{
+  STAT_START (start);
+
+  search_text(ctx);
+  STAT_TIME (ctx, text, start);
+  out_printf (&ctx->out, "; Done mapping memory.\n");
+}
+
+
+// Prints the disassembly of the whole image. With ctx->stream, each region
+// (up to the next label or change of use) is written out as soon as it's
+// listed instead of when the output buffer fills.
+
+void lcdis_listing (lcdis_type * ctx)
+{
+  int pin, p1;    // address counters
 
-  printf ("\n\n;------------------------------------------------------------------\n\n");
+  trace_entries (ctx);     // in case lcdis_map wasn't called
+  STAT_START (start);
+  STAT_ADD (ctx, outbytes, -out_tell (&ctx->out));
+  if (ctx->xrefmode)
+     xref_build (ctx);
+  out_printf (&ctx->out, "\n\n;------------------------------------------------------------------\n\n");
 
-  if (asmout)
-    printf ("             .include \"sfr.i\"\n\n"
+  if (ctx->asmout)
+    out_printf (&ctx->out, "             .include \"sfr.i\"\n\n"
             "             .org 0\n\n\n");
 
   // simple straight-through disassembly: (all code)
-  for (pin=0; pin<memsize; )
+  flash_reset (ctx);
+  ctx->flash_next = -1;
+  if (ctx->lineat)
+     for (pin=0; pin<ctx->memsize; pin++)
+        ctx->lineat[pin] = -1;
+  for (pin=0; pin<ctx->memsize; )
   {
-     dis(pin, &p1);
+     if (ctx->lineat)
+        ctx->lineat[pin] = out_tell (&ctx->out);
+     dis(ctx, pin, &p1);
+     if (ctx->stream && (ctx->mem_use[p1] != ctx->mem_use[pin]))
+        out_flush (&ctx->out);    // a label, or code turning into data, ...
      pin = p1;
   }
 
-  return(0);
+  if (ctx->lineat)
+     ctx->lineat[ctx->memsize] = out_tell (&ctx->out);
+
+  if (ctx->flashmode && ctx->hisize)
+     flash_listing (ctx);
+  STAT_ADD (ctx, outbytes, out_tell (&ctx->out));
+  STAT_TIME (ctx, output, start);
+}
+
+
+// "0593-          | " in front of data lines
+
+static void print_address (lcdis_type * ctx, int pin)
+{
+   out_hex (&ctx->out, pin, 4);
+   out_str (&ctx->out, "-          | ");
+}
+
+
+// one byte of graphics or font as 8 pixels, "#" for set bits
+
+static void print_pixels (lcdis_type * ctx, int data)
+{
+   int bit;
+
+   for (bit=0x80; bit; bit>>=1)
+      out_char (&ctx->out, (data & bit) ? '#' : '.');
+}
+
+
+// "#$xx"
+
+static void print_immediate (lcdis_type * ctx, int data)
+{
+   out_str (&ctx->out, "#$");
+   out_hex (&ctx->out, data, 2);
 }
 
 
@@ -304,22 +614,22 @@ int main (int argc, char * argv[])
 //   "0593- 23 00 00 |              MOV    #$00,ACC"
 
 
-void dis (int pin, int * b1)
+void dis (lcdis_type * ctx, int pin, int * b1)
 {
    int i;
    unsigned char opcode;
    int quoteopen;
 
-   opcode = mem[pin];
+   opcode = ctx->mem[pin];
 
 // Debug code to force all memory to be interpreted as code or data:
-//   mem_use[pin] = MEM_DATA;
-//   mem_use[pin] = MEM_CODE;   // it's executable
+//   ctx->mem_use[pin] = MEM_DATA;
+//   ctx->mem_use[pin] = MEM_CODE;   // it's executable
 
    if (pin <0 || pin>0xFFFF)
-      printf ("ERROR: attempted to dissassemble illegal address %04x!\n", pin);
+      out_printf (&ctx->out, "ERROR: attempted to dissassemble illegal address %04x!\n", pin);
 
-   switch (mem_use[pin])
+   switch (ctx->mem_use[pin])
    {
      case MEM_UNUSED:    // not loaded from file
         *b1=-1;          // can't branch anywhere
@@ -327,117 +637,164 @@ void dis (int pin, int * b1)
 
      case MEM_UNKNOWN:   // if unknown, then assume it's data
      case MEM_DATA:
-          dis_data (pin, b1);
+          dis_data (ctx, pin, b1);
         break;
 
       case MEM_GRAPHICS:
-        if (!asmout)
-          printf ("%04x-          | ", pin);
+        if (!ctx->asmout)
+          print_address (ctx, pin);
 
-        print_code_label(pin,2);  // print label if possible
-        printf ("BYTE   ");
+        print_code_label(ctx, pin,2);  // print label if possible
+        out_str (&ctx->out, "BYTE   ");
 
-        printf ("$%02x", mem[pin]);
+        out_char (&ctx->out, '$');
+        out_hex (&ctx->out, ctx->mem[pin], 2);
         for (i=1; i<6; i++)    /* 6 bytes per line */
-           printf (",$%02x", mem[pin+i]);
+        {  out_str (&ctx->out, ",$");
+           out_hex (&ctx->out, ctx->mem[pin+i], 2);
+        }
 
-        printf ("          ;graphics \"");
+        out_str (&ctx->out, "          ;graphics \"");
         for (i=0; i<6; i++)    /* 6 bytes per line */
-           printf ("%c%c%c%c%c%c%c%c",
-                               mem[pin+i] & 128 ? '#' : '.',
-                               mem[pin+i] & 64 ? '#' : '.',
-                               mem[pin+i] & 32 ? '#' : '.',
-                               mem[pin+i] & 16? '#' : '.',
-                               mem[pin+i] & 8 ? '#' : '.',
-                               mem[pin+i] & 4 ? '#' : '.',
-                               mem[pin+i] & 2 ? '#' : '.',
-                               mem[pin+i] & 1 ? '#' : '.');
-
-        printf ("\"\n");
+           print_pixels (ctx, ctx->mem[pin+i]);
+
+        out_char (&ctx->out, '"');
         *b1=pin+6;
+        annot_comments (ctx, pin, *b1);
+        out_char (&ctx->out, '\n');
         break;
 
       case MEM_FONT8:
-        if (!asmout)
-          printf ("%04x-          | ", pin);
-
-        print_code_label(pin,2);  // print label if possible
-        printf ("BYTE   $%02x               ;font \"%c%c%c%c%c%c%c%c\"\n",
-                      mem[pin],
-                      mem[pin] & 128 ? '#' : '.',
-                      mem[pin] & 64 ? '#' : '.',
-                      mem[pin] & 32 ? '#' : '.',
-                      mem[pin] & 16? '#' : '.',
-                      mem[pin] & 8 ? '#' : '.',
-                      mem[pin] & 4 ? '#' : '.',
-                      mem[pin] & 2 ? '#' : '.',
-                      mem[pin] & 1 ? '#' : '.');
+        if (!ctx->asmout)
+          print_address (ctx, pin);
+
+        print_code_label(ctx, pin,2);  // print label if possible
+        out_str (&ctx->out, "BYTE   $");
+        out_hex (&ctx->out, ctx->mem[pin], 2);
+        out_str (&ctx->out, "               ;font \"");
+        print_pixels (ctx, ctx->mem[pin]);
+        out_char (&ctx->out, '"');
         *b1=pin+1;
+        annot_comments (ctx, pin, *b1);
+        out_char (&ctx->out, '\n');
         break;
 
      case MEM_TEXT:
-         if (!asmout)
-            printf ("%04x-          | ", pin);
-         printf ("             BYTE   \"");
+         if (!ctx->asmout)
+            print_address (ctx, pin);
+         out_str (&ctx->out, "             BYTE   \"");
          quoteopen=1;
          i=0;
-         while (mem_use[pin] == MEM_TEXT)   // or until broken by a $00
+         while (ctx->mem_use[pin] == MEM_TEXT)   // or until broken by a $00
          {
 
 // This output must be compatible with fixup_string in lexar.c of Marcus's assembler.
 // that function supports most c escape sequences, but not \\ nor \", so we just
 // print the hex byte equivalents.
 
-           if (   !isprint (mem[pin]) // print as hex byte 
-               || (mem[pin]=='\\')    // vmuasm has no escape sequence for this
-               || (mem[pin]=='\"'))   // vmuasm has no escape sequence for this
+           if (   !isprint (ctx->mem[pin]) // print as hex byte 
+               || (ctx->mem[pin]=='\\')    // vmuasm has no escape sequence for this
+               || (ctx->mem[pin]=='\"'))   // vmuasm has no escape sequence for this
            {
               if (quoteopen)
-              {  printf ("\"");
+              {  out_char (&ctx->out, '"');
                  quoteopen=0;
               }
               if (i!=0)
-                printf (",");  // use a comma only if we've added something to the string.
-              printf ("$%02x", (unsigned int) ((unsigned char) mem[pin]));
+                out_char (&ctx->out, ',');  // use a comma only if we've added something to the string.
+              out_char (&ctx->out, '$');
+              out_hex (&ctx->out, ctx->mem[pin], 2);
            }
            else   // print quoted text
            {
               if (!quoteopen)
-              {  printf (",\"");
+              {  out_str (&ctx->out, ",\"");
                  quoteopen=1;
               }
-              printf ("%c", mem[pin]);
+              out_char (&ctx->out, ctx->mem[pin]);
            }
 
-           if (mem[pin++] == 0)  // end-of-line?
+           if (ctx->mem[pin++] == 0)  // end-of-line?
              break;              // then break out of it
            i++;  // count chars so we can use ',' only if needed
          }  
          if (quoteopen)
-         {  printf ("\"");
+         {  out_char (&ctx->out, '"');
             quoteopen=0;
          }
-         printf ("\n");
+         out_char (&ctx->out, '\n');
          *b1=pin;
         break;
 
      case MEM_INVALID:
-        printf ("*** WARNING: this is the target of a possibly misaligned jump:\n");
+        out_printf (&ctx->out, "*** WARNING: this is the target of a possibly misaligned jump:\n");
         // fall into code section
 
      case MEM_CODE:
      case MEM_CODE_LABELED:
-          dis_code (pin, b1);
+          dis_code (ctx, pin, b1);
         break;
 
       default:
-          printf ("FATAL INTERNAL ERROR: unknown type of memory\n");
+          out_printf (&ctx->out, "FATAL INTERNAL ERROR: unknown type of memory\n");
+          out_flush (&ctx->out);
           exit(-1);
         break;
    }
 }
 
 
+// Returns: 1 if data at pin is part of the game's icons (listed 16 bytes to a line)
+
+int is_icon (lcdis_type * ctx, int pin)
+{
+   return ((pin >= 0x280) && (pin < 0x280+ctx->mem[0x240]*0x200) && !ctx->biosmode);
+}
+
+
+// Returns: address of the listing line after the one dis prints at pin
+//          (-1 if it prints nothing). Must step exactly the way dis does.
+
+int next_line (lcdis_type * ctx, int pin)
+{
+   int i;
+
+   switch (ctx->mem_use[pin])
+   {
+      case MEM_UNUSED:
+         return -1;
+
+      case MEM_UNKNOWN:
+      case MEM_DATA:
+         if (is_icon (ctx, pin))
+            return pin+16;
+         if ((pin == 0x200) || (pin == 0x210))
+         {  for (i=0; i<((pin==0x200) ? 16 : 32); i++)
+               if (!isprint (ctx->mem[pin+i]) || (ctx->mem[pin+i] & 0x80))
+                  break;
+            if (i == ((pin==0x200) ? 16 : 32))
+               return pin+i;
+         }
+         for (i=pin+1; (i & 0x7) && (ctx->mem_use[i]==ctx->mem_use[pin]); i++)
+            ;
+         return i;
+
+      case MEM_GRAPHICS:
+         return pin+6;
+
+      case MEM_FONT8:
+         return pin+1;
+
+      case MEM_TEXT:
+         while (ctx->mem_use[pin] == MEM_TEXT)
+            if (ctx->mem[pin++] == 0)
+               break;
+         return pin;
+   }
+   return pin + decode[ctx->mem[pin]].len;    // code
+}
+
+
 // FUNCTION dis_data
 //
 // inputs
@@ -452,50 +809,58 @@ void dis (int pin, int * b1)
 //    0210-  |     BYTE   "TRICKSTYLE JR. VMU GAME.        " ;File comment on Dreamcast (32 bytes)
 
 
-void dis_data (int pin, int * b1)
+void dis_data (lcdis_type * ctx, int pin, int * b1)
 {
    int i,i2;
    int valid;
    int textsize;
+   int next;
    int printdefault=0;   // set if we don't have a special way to display the data.
                          // Sometimes set if the special data can't print the data correctly.
    unsigned char opcode;
-   opcode = mem[pin];
+   opcode = ctx->mem[pin];
 
 
    // Handle game icon data:
-   if ((pin >= 0x280) && (pin < 0x280+mem[0x240]*0x200) && !biosmode)
+   if (is_icon (ctx, pin))
    {           // icon data for display on dreamcast
       if (((pin-0x280) & 0x1FF) == 0x0)   // in icon boundry?
-      {  if (!asmout)
-            printf ("%04x-          |   ;icon #%d\n", pin, (pin-0x280)/0x200);
+      {  if (!ctx->asmout)
+         {  print_address (ctx, pin);
+            out_str (&ctx->out, "  ;icon #");
+         }
          else
-            printf ("  ;icon #%d\n", (pin-0x280)/0x200);
+            out_str (&ctx->out, "  ;icon #");
+         out_dec (&ctx->out, (pin-0x280)/0x200);
+         out_char (&ctx->out, '\n');
       }
 
-      if (!asmout)
-         printf ("%04x-          | ", pin);
-      printf ("             BYTE   $%02x", opcode);
+      if (!ctx->asmout)
+         print_address (ctx, pin);
+      out_str (&ctx->out, "             BYTE   $");
+      out_hex (&ctx->out, opcode, 2);
 
       for (i=1; i<16; i++)
-         printf (",$%02x", mem[pin+i]);
-      printf ("    ");            // pad to make comment align
-      printf ("  ;icon \"");
+      {  out_str (&ctx->out, ",$");
+         out_hex (&ctx->out, ctx->mem[pin+i], 2);
+      }
+      out_str (&ctx->out, "    ");            // pad to make comment align
+      out_str (&ctx->out, "  ;icon \"");
 
       for (i=0; i<16; i++)
       {
-        if (mem[pin+i] & 0xF0)
-           printf ("%x", mem[pin+i]>>4);  // print hex digit 1-F
+        if (ctx->mem[pin+i] & 0xF0)
+           out_hex (&ctx->out, ctx->mem[pin+i]>>4, 1);  // print hex digit 1-F
         else
-           printf (" ");                  // print space instead of '0'
+           out_char (&ctx->out, ' ');                  // print space instead of '0'
 
-        if (mem[pin+i] & 0x0F)
-           printf ("%x", mem[pin+i]&0xf);  // print hex digit 1-F
+        if (ctx->mem[pin+i] & 0x0F)
+           out_hex (&ctx->out, ctx->mem[pin+i]&0xf, 1);  // print hex digit 1-F
         else
-           printf (" ");                  // print space instead of '0'
+           out_char (&ctx->out, ' ');                  // print space instead of '0'
       }
 
-      printf ("\"");
+      out_char (&ctx->out, '"');
       *b1=pin+16;   // icons are always lines of 16 bytes
    }
    else        // handle game name fields
@@ -504,17 +869,16 @@ void dis_data (int pin, int * b1)
       textsize = (pin==0x200) ? 16 : 32;
       valid=1;   // check validity
       for (i=0; (i<textsize) && valid; i++)
-         if (!isprint (mem[pin+i]) || (mem[pin+i] & 0x80))  // not valid if not printable or has most significant bit set
+         if (!isprint (ctx->mem[pin+i]) || (ctx->mem[pin+i] & 0x80))  // not valid if not printable or has most significant bit set
            valid=0;
 
       if (valid)
       {
-        if (!asmout)
-           printf ("%04x-          | ", pin);
-        printf ("             BYTE   \"");
-        for (i=0; i<textsize; i++)
-          printf ("%c", mem[pin+i]);
-        printf ((pin==0x200) ? "\"                 ;File comment on VM (16 bytes)"
+        if (!ctx->asmout)
+           print_address (ctx, pin);
+        out_str (&ctx->out, "             BYTE   \"");
+        out_mem (&ctx->out, (char *) &ctx->mem[pin], textsize);
+        out_str (&ctx->out, (pin==0x200) ? "\"                 ;File comment on VM (16 bytes)"
                              : "\" ;File comment on Dreamcast (32 bytes)");
         *b1=pin+textsize;   // icons are always lines of 16 bytes
       }
@@ -527,194 +891,264 @@ void dis_data (int pin, int * b1)
 
    if (printdefault)   // general data
    {           
-      if (!asmout)
-         printf ("%04x-          | ", pin);
-      printf ("             BYTE   $%02x", opcode);
+      if ((ctx->mem_use[pin] == MEM_DATA) && ((pin == 0) || (ctx->mem_use[pin-1] != MEM_DATA)))
+      {  for (i=pin; ctx->mem_use[i] == MEM_DATA; i++)   // a table found by ldc_map
+            ;
+         if (!ctx->asmout)
+            print_address (ctx, pin);
+         out_printf (&ctx->out, "  ;table read with LDC ($%04x bytes)\n", i-pin);
+      }
+      if (!ctx->asmout)
+         print_address (ctx, pin);
+      if (annot_label (ctx, pin))
+         print_code_label (ctx, pin, 1);
+      else
+         out_str (&ctx->out, "             ");
+      out_str (&ctx->out, "BYTE   $");
+      out_hex (&ctx->out, opcode, 2);
       i=pin+1;
       i2=!isprint (opcode & 0x7F);  // i2 is true as long as bytes are nonprintable
+      next=annot_next (ctx, i);     // annotations start a line of their own
 
       while ( (i & 0x7) &&
-              ( (mem_use[i]==MEM_UNKNOWN) || (mem_use[i]==MEM_UNKNOWN)) )
-      {  i2 &= !isprint (mem[i] & 0x7F); // i2 is true as long as bytes are all 0xFF
-         printf (",$%02x", mem[i++]);
+              (ctx->mem_use[i]==ctx->mem_use[pin]) && (i != next) )
+      {  i2 &= !isprint (ctx->mem[i] & 0x7F); // i2 is true as long as bytes are all 0xFF
+         out_str (&ctx->out, ",$");
+         out_hex (&ctx->out, ctx->mem[i++], 2);
       }
 
       if (!i2) // if all data isn't 0xFF, then
       {        // print ASCII representation
          for (i2=8-(i-pin); i2; i2--)
-           printf ("    ");            // pad to make comment align
-         printf ("  ;ascii \"");
+           out_str (&ctx->out, "    ");            // pad to make comment align
+         out_str (&ctx->out, "  ;ascii \"");
          for (i2=pin; i2<i; i2++)
-           printf ("%c", (isprint (mem[i2] & 0x7F)) ? (mem[i2] & 0x7F) : '.');
-         printf ("\"");
+           out_char (&ctx->out, (isprint (ctx->mem[i2] & 0x7F)) ? (ctx->mem[i2] & 0x7F) : '.');
+         out_char (&ctx->out, '"');
       }
       *b1=i;
    }
 
-   printf ("\n");           // end of line
+   annot_comments (ctx, pin, *b1);
+   out_char (&ctx->out, '\n');           // end of line
 }
 
 
 
-// FUNCTION dis_code
+// FUNCTION print_operands
 //
 // inputs
-//   pin = address counter to disassemble
-//
-// outputs
-//   b1 = address of next instruction (or -1 if RETURN)
+//   pin = address of an instruction
 //
-// Model line:
-//   "0593- 23 00 00 |              MOV    #$00,ACC"
+// Prints its operands the way the listing shows them ("#$00,ACC"): labels
+// for code addresses, names for data addresses.
 
-void dis_code (int pin, int * b1)
+void print_operands (lcdis_type * ctx, int pin)
 {
-   char * model;
-   int found;
-   int i,i2;
+   decode_type * d;
    unsigned char opcode;
 
-   opcode = mem[pin];
-
-//Debug code: insert this to see what bank each line was calculated to be in
-//            (BNK0, BNK1, BNK2=unknown)
-//printf ("BNK%d ", mem_bnk[pin]);
-
-   if (!asmout)
-   {
-      printf ("%04x- ", pin);
-
-      for (i=0; i<3; i++)
-         if (i<opcode_len(opcode))// print raw bytes:
-            printf ("%02x ", mem[pin+i]);
-         else
-            printf ("   ");
-
-      printf ("| ");
-   }
-
-   // print label if wanted
-   if (mem_use[pin] == MEM_CODE_LABELED)
-      print_code_label(pin,1);  // formatted
-   else
-      printf ("             ");
-
-   model = get_opcode_model(opcode);
-   printf ("%5.5s  ", model);
-
-   // calculate next word
-   *b1 = pin + opcode_len (opcode);
+   opcode = ctx->mem[pin];
+   d = &decode[opcode];
 
-   switch (model[5])
+   switch (d->operand)
    {
       case ' ':   // no parameters
          break;
 
       case '2':   // a12   absolute
-         print_code_label (get_a12(pin),0);
-         // printf ("$%04x", get_a12(pin));
+         print_code_label (ctx, get_a12(ctx, pin),0);
+         // out_printf (&ctx->out, "$%04x", get_a12(ctx, pin));
          break;
 
       case '6':   // r16   relative
-         print_code_label (get_r16(pin),0);
-         // printf ("$%04x", get_r16(pin));
+         print_code_label (ctx, get_r16(ctx, pin),0);
+         // out_printf (&ctx->out, "$%04x", get_r16(ctx, pin));
          break;
 
       case '7':   // a16   absolute
-         print_code_label (get_a16(pin),0);
-         // printf ("$%04x", get_a16(pin));
+         print_code_label (ctx, get_a16(ctx, pin),0);
+         // out_printf (&ctx->out, "$%04x", get_a16(ctx, pin));
          break;
 
       case '8':   // r8    relative
-         print_code_label (get_r8(pin),0);
-         // printf ("$%04x", get_r8(pin));
+         print_code_label (ctx, get_r8(ctx, pin),0);
+         // out_printf (&ctx->out, "$%04x", get_r8(ctx, pin));
          break;
 
       case '9':   // d9    direct
-         print_data_label (get_d9(pin), mem_bnk[pin]);
-         // printf ("$%03x", get_d9(pin));
+         print_data_label (ctx, get_d9(ctx, pin), ctx->mem_bnk[pin]);
+         // out_printf (&ctx->out, "$%03x", get_d9(ctx, pin));
          break;
 
       case '@':   // @Ri   indirect
-         printf ("@R%d", get_reg(pin));
+         out_str (&ctx->out, "@R");
+         out_dec (&ctx->out, get_reg(ctx, pin));
          break;
 
       case '#':   // #     immediate
-         printf ("#$%02x", mem[pin+1]);
+         print_immediate (ctx, ctx->mem[pin+1]);
          break;
 
       case '^':   // ^=#i8,d9 immediate
-         printf ("#$%02x,", mem[pin+2]);
-         print_data_label (get_d9(pin), mem_bnk[pin]);
-         // printf ("#$%02x,$%03x", mem[pin+2], get_d9(pin));
+         print_immediate (ctx, ctx->mem[pin+2]);
+         out_char (&ctx->out, ',');
+         print_data_label (ctx, get_d9(ctx, pin), ctx->mem_bnk[pin]);
+         // out_printf (&ctx->out, "#$%02x,$%03x", ctx->mem[pin+2], get_d9(ctx, pin));
          break;
 
       case '%':   // %=#i8,@Ri
-         printf ("#$%02x, @R%d", mem[pin+1], get_reg(pin));
+         print_immediate (ctx, ctx->mem[pin+1]);
+         out_str (&ctx->out, ", @R");
+         out_dec (&ctx->out, get_reg(ctx, pin));
          break;
 
       case 'b':   // b=d9,b3    bit manipulation
-         print_data_label(get_d9bit(pin), mem_bnk[pin]);
-         printf (", %d", mem[pin]&7);
-         // printf ("$%03x, %d", get_d9bit(pin), mem[pin]&7);
+         print_data_label(ctx, get_d9bit(ctx, pin), ctx->mem_bnk[pin]);
+         out_str (&ctx->out, ", ");
+         out_dec (&ctx->out, ctx->mem[pin]&7);
+         // out_printf (&ctx->out, "$%03x, %d", get_d9bit(ctx, pin), ctx->mem[pin]&7);
          break;
 
       case 'r':   // r=d9,b3,r8 bit branch
-         print_data_label (get_d9bit(pin), mem_bnk[pin]);
-         printf (", %d, ", mem[pin]&7);
-         print_code_label (get_r8(pin+1),0);
-         // printf ("$%03x, %d, $%04x", get_d9bit(pin), mem[pin]&7, get_r8(pin+1));
+         print_data_label (ctx, get_d9bit(ctx, pin), ctx->mem_bnk[pin]);
+         out_str (&ctx->out, ", ");
+         out_dec (&ctx->out, ctx->mem[pin]&7);
+         out_str (&ctx->out, ", ");
+         print_code_label (ctx, get_r8(ctx, pin+1),0);
+         // out_printf (&ctx->out, "$%03x, %d, $%04x", get_d9bit(ctx, pin), ctx->mem[pin]&7, get_r8(ctx, pin+1));
          break;
 
       case 'z':   // z=#i8,r8
-         printf ("#$%02x,", mem[pin+1]);
-         print_code_label (get_r8(pin+1),0);
-         // printf ("#$%02x,$%04x", mem[pin+1], get_r8(pin+1));
+         print_immediate (ctx, ctx->mem[pin+1]);
+         out_char (&ctx->out, ',');
+         print_code_label (ctx, get_r8(ctx, pin+1),0);
+         // out_printf (&ctx->out, "#$%02x,$%04x", ctx->mem[pin+1], get_r8(ctx, pin+1));
          break;
 
       case 'x':   // x=d9,r8
-         print_data_label (get_d9(pin), mem_bnk[pin]);
-         printf (",");
-         print_code_label (get_r8(pin+1),0);
-         // printf ("$%03x,$%04x", get_d9(pin), get_r8(pin+1));
+         print_data_label (ctx, get_d9(ctx, pin), ctx->mem_bnk[pin]);
+         out_char (&ctx->out, ',');
+         print_code_label (ctx, get_r8(ctx, pin+1),0);
+         // out_printf (&ctx->out, "$%03x,$%04x", get_d9(ctx, pin), get_r8(ctx, pin+1));
          break;
 
       case 'v':   // v=@Ri,#i8,r8
-         printf ("@R%d,#$%02x,", get_reg(pin), mem[pin+1]);
-         print_code_label (get_r8(pin+1),0);
-         // printf ("@R%d,#$%02x,$%04x", get_reg(pin), mem[pin+1], get_r8(pin+1));
+         out_str (&ctx->out, "@R");
+         out_dec (&ctx->out, get_reg(ctx, pin));
+         out_char (&ctx->out, ',');
+         print_immediate (ctx, ctx->mem[pin+1]);
+         out_char (&ctx->out, ',');
+         print_code_label (ctx, get_r8(ctx, pin+1),0);
+         // out_printf (&ctx->out, "@R%d,#$%02x,$%04x", get_reg(ctx, pin), ctx->mem[pin+1], get_r8(ctx, pin+1));
          break;
 
       case 'c':   // c=@Ri,r8
-         printf ("@R%d,", get_reg(pin));
-         print_code_label (get_r8(pin),0);
-         // printf ("@R%d,$%04x", get_reg(pin), get_r8(pin));
+         out_str (&ctx->out, "@R");
+         out_dec (&ctx->out, get_reg(ctx, pin));
+         out_char (&ctx->out, ',');
+         print_code_label (ctx, get_r8(ctx, pin),0);
+         // out_printf (&ctx->out, "@R%d,$%04x", get_reg(ctx, pin), get_r8(ctx, pin));
          break;
 
       case '!':   // illegal
-         printf ("$%02x                ;illegal opcode", (int) opcode);
+         out_printf (&ctx->out, "$%02x                ;illegal opcode", (int) opcode);
          break;
 
       default:
-         printf ("! ! !\nFATAL Error: unexpected model %c in op[] table!\n", model[5]);
+         out_printf (&ctx->out, "! ! !\nFATAL Error: unexpected model %c in op[] table!\n", d->operand);
+         out_flush (&ctx->out);
          exit (-1);  // not graceful
    }
+}
+
+
+// FUNCTION dis_code
+//
+// inputs
+//   pin = address counter to disassemble
+//
+// outputs
+//   b1 = address of next instruction (or -1 if RETURN)
+//
+// Model line:
+//   "0593- 23 00 00 |              MOV    #$00,ACC"
+
+void dis_code (lcdis_type * ctx, int pin, int * b1)
+{
+   decode_type * d;
+   codelist_type * c;
+   int found;
+   int i,i2;
+   unsigned char opcode;
+
+   opcode = ctx->mem[pin];
+   d = &decode[opcode];
+
+//Debug code: insert this to see what bank each line was calculated to be in
+//            (BNK0, BNK1, BNK2=unknown)
+//out_printf (&ctx->out, "BNK%d ", ctx->mem_bnk[pin]);
+
+   if (ctx->xref && (ctx->mem_use[pin] == MEM_CODE_LABELED))
+      xref_print (ctx, pin);
+
+   if (!ctx->asmout)
+   {
+      out_hex (&ctx->out, pin, 4);
+      out_str (&ctx->out, "- ");
+
+      for (i=0; i<3; i++)
+         if (i<d->len)            // print raw bytes:
+         {  out_hex (&ctx->out, ctx->mem[pin+i], 2);
+            out_char (&ctx->out, ' ');
+         }
+         else
+            out_str (&ctx->out, "   ");
+
+      out_str (&ctx->out, "| ");
+   }
+
+   // print label if wanted
+   if ((ctx->mem_use[pin] == MEM_CODE_LABELED) || annot_label (ctx, pin))
+      print_code_label(ctx, pin,1);  // formatted
+   else
+      out_str (&ctx->out, "             ");
+
+   out_mem (&ctx->out, d->model, 5);
+   out_str (&ctx->out, "  ");
 
-//   printf ("       [model %c] ", model[5]);  // helpful for debugging
+   // calculate next word
+   *b1 = pin + d->len;
+
+   print_operands (ctx, pin);
 
+//   out_printf (&ctx->out, "       [model %c] ", d->operand);  // helpful for debugging
 
-   // print pre-defined comments for particular instructions:
-   found=0;
-   for (i=0; (CODECMTS[i].code[0] != -1) && !found; i++)  // check whole list
+
+   // print pre-defined comments for particular instructions (every pattern
+   // that fits, in list order; only the ones for this opcode are looked at):
+   for (i=cmt_first[opcode]; i<cmt_first[opcode+1]; i++)
    {
+      c = &CODECMTS[cmt_list[i]];
       found = 1;
-      for (i2=0; (i2<3) && found; i2++)
-         if ((mem[pin+i2]!=CODECMTS[i].code[i2]) && CODECMTS[i].code[i2] != -1)
+      for (i2=1; (i2<3) && found; i2++)
+         if ((ctx->mem[pin+i2]!=c->code[i2]) && c->code[i2] != -1)
             found=0;   // didn't fit pattern
       if (found)
-         printf ("      %s", CODECMTS[i].text);
+      {  STAT_ADD (ctx, comments, 1);
+         out_str (&ctx->out, "      ");
+         out_str (&ctx->out, c->text);
+      }
    }
 
+   if (ctx->flashmode)
+      flash_note (ctx, pin);
+
+   if (opcode == 0xC1)    // LDC
+      ldc_note (ctx, pin);
+
+   annot_comments (ctx, pin, *b1);
+
 
    // add a comment for indirect variable names
 // *            - look up indirect variable names (ie. for "MOV #$xx,MEM000")
@@ -722,253 +1156,435 @@ void dis_code (int pin, int * b1)
 
 
 
-   printf ("\n");
+   out_char (&ctx->out, '\n');
 
    // add a blank line after some instructions:
-   if (    (strncmp(model, "JMP  ", 5) == 0)
-        || (strncmp(model, "JMPF ", 5) == 0)
-        || (strncmp(model, "RET", 3) == 0)      // RET and RETI
-        || (strncmp(model, "BR   ", 5) == 0)    // unconditional branches
-        || (strncmp(model, "BRF  ", 5) == 0))
-      printf (asmout ? "\n" : "               |\n");
+   if (    (d->flow == FLOW_JUMP)        // JMP, JMPF and unconditional branches
+        || (d->flow == FLOW_RETURN))     // RET and RETI
+      out_str (&ctx->out, ctx->asmout ? "\n" : "               |\n");
 }
 
 
 
 
-// input: executable address
-//        rambank (in future versions, this may expand to a system state)
-//
-// warning: is fooled by branches that cover both cases
-//          i.e. BZ followed by a BNZ will always go to one of those
-//          cases, but this code will think that the BNZ case may not
-//          execute and continue mapping. Nice programmers would use
-//          a BR instruction in the second case, but those that aren't
-//          used to such new-fangled technology might not (like me).
-//
-//          Also, computed gotos (if possible) are not honored
-//
-//          rambank problems:
-//
-//          rambank does not handle POP PSW (restoration). A complimentry
-//          bug is that calls don't affect rambank when they return, so if
-//          you assume that calls restore PSW after they are done with it,
-//          then missing POP PSW is ok. This does lead to some uncommented
-//          code at the end of routines (especially if push PSW is one of
-//          last things saved on the stack), but usually this matches up
-//          with the pushes quite nicely.
-//
-// Returns: 0=valid code
-//          1=invalid code
+// mem_use at any address $0000-$FFFF. Past the maps (i.e. well past the
+// end of the image) it's MEM_UNUSED, unless a trace has marked the address
+// MEM_INVALID, which is remembered in ctx->outside.
 
-int mapmem (int pin_in, int rambank)
+int get_use (lcdis_type * ctx, int pin)
 {
-   int    branchaddr;
-   char * model;
-   unsigned char opcode;
-   int    i;
-   int    pin;                // pc during trace
-   int    entry;
-   int    badvein;
+   if (pin < ctx->mapsize)
+      return ctx->mem_use[pin];
+   return (ctx->outside[pin>>3] & (1 << (pin&7))) ? MEM_INVALID : MEM_UNUSED;
+}
 
-   static int  level=0;       // static during recursion
-   static int  calltrace[200];
-// debug variables:
-// int x; char junk[200];
 
+void set_use (lcdis_type * ctx, int pin, int use)
+{
+   if (pin < ctx->mapsize)
+      ctx->mem_use[pin] = use;
+   else
+   if (use == MEM_INVALID)
+      ctx->outside[pin>>3] |= 1 << (pin&7);
+   else                                  // anything else out here acts like MEM_UNUSED
+      ctx->outside[pin>>3] &= ~(1 << (pin&7));
+}
 
-   pin=pin_in;                // start trace at passed parameter
 
-   //-- record mapmem recursion
-   if (level<200)
-      calltrace[level]=pin;
-   level++;
-   //--
+// The banks the instruction at pin has been traced with: bit 1<<BNK_xxx
+// for BNK_BANK0, BNK_BANK1 and BNK_UNKNOWN; 0=not traced. Kept as one
+// bitmap per bank so the three take 24K in all. Past $FFFF (the operands
+// of an instruction at the very end) nothing has been traced.
 
-   while (1)
-   {
+int get_seen (lcdis_type * ctx, int pin)
+{
+   int bit = 1 << (pin&7);
+
+   if (pin >= 0x10000)
+      return 0;
+   pin >>= 3;
+   return   ((ctx->seen[pin] & bit) ? 1 << BNK_BANK0 : 0)
+          | ((ctx->seen[0x2000 + pin] & bit) ? 1 << BNK_BANK1 : 0)
+          | ((ctx->seen[0x4000 + pin] & bit) ? 1 << BNK_UNKNOWN : 0);
+}
 
-      if (pin <0 || pin>0xFFFF)
-      {   printf ("FATAL INTERNAL ERROR: attempted to map illegal address %04x!\n", pin);
-          exit (-1);
-      }
 
-      if (    (mem_use[pin] == MEM_DATA)       // <- this is impossible so far because we don't mark any code data yet.
-           || (mem_use[pin] == MEM_GRAPHICS)
-           || (mem_use[pin] == MEM_UNUSED))
-      {
-         printf ("WARNING: branch exists to data/graphics/unused code at $%04x\n"
-                 "         trace stack: ", pin);
-         for (i=0; i<level; i++)
-           printf ("%04x ", calltrace[i]);
-         printf ("\n\n");
-         level--;
-         mem_use[pin_in] = MEM_INVALID;  // we'll label it invalid.
-         return 1;    // only explore the good stuff
-      }
-      if (mem_use[pin] == MEM_INVALID)
-      {
-         printf ("WARNING: branch exists to invalid code at $%04x\n"
-                 "         trace stack: ", pin);
-         for (i=0; i<level; i++)
-           printf ("%04x ", calltrace[i]);
-         printf ("\n\n");
-         level--;
-         return 1;    // only explore the good stuff
-      }
+void set_seen (lcdis_type * ctx, int pin, int seen)
+{
+   int bnk;
 
-      if (mem_use[pin] != MEM_UNKNOWN)
-      {
-         level--;
-         mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
+   if (pin >= 0x10000)
+      return;
+   for (bnk=BNK_BANK0; bnk<=BNK_UNKNOWN; bnk++)
+      if (seen & (1 << bnk))
+         ctx->seen[bnk * 0x2000 + (pin>>3)] |= 1 << (pin&7);
+      else
+         ctx->seen[bnk * 0x2000 + (pin>>3)] &= ~(1 << (pin&7));
+}
 
-         return 0;    // only explore the unknown
+
+// Prints the chain of veins that led to the one being traced (oldest first).
+// Every vein's parent is the one below it on ctx->trace, so the whole
+// stack is the chain, however deep it got.
+
+static void print_trace_stack (lcdis_type * ctx)
+{
+   int i;
+
+   out_str (&ctx->out, "         trace stack: ");
+   for (i=0; i<ctx->level; i++)
+   {  out_hex (&ctx->out, ctx->trace[i].pin_in, 4);
+      out_char (&ctx->out, ' ');
+   }
+   out_str (&ctx->out, "\n\n");
+}
+
+
+// Starts a new vein at pin on top of the trace stack. kind says what the
+// vein below does with its result (VEIN_xxx). A branch or jump stays in
+// the function it was taken in, with its PUSH PSWs; a call starts a new one.
+
+static void push_vein (lcdis_type * ctx, int pin, int rambank, int kind)
+{
+   trace_type * t;
+   trace_type * v;
+
+   if (ctx->level == ctx->tracesize)
+   {
+      t = (trace_type *) realloc (ctx->trace, 2 * ctx->tracesize * sizeof (trace_type));
+      if (t == NULL)
+      {  out_printf (&ctx->out, "FATAL INTERNAL ERROR: out of memory for a %d deep trace!\n", ctx->level);
+         out_flush (&ctx->out);
+         exit (-1);
       }
+      ctx->trace = t;
+      ctx->tracesize *= 2;
+   }
+   t = &ctx->trace[ctx->level++];
+   STAT_MAX (ctx, depth, ctx->level);
+   t->pin_in  = pin;
+   t->pin     = pin;
+   t->rambank = rambank;
+   t->kind    = kind;
+   t->resume  = 0;
+   t->again   = 0;
+   t->quiet   = 0;
+   t->entered = 0;
+   if ((kind == VEIN_BRANCH) || (kind == VEIN_JUMP))
+   {  v = &ctx->trace[ctx->level-2];
+      t->func   = v->func;
+      t->origin = v->origin;
+      t->npsw   = v->npsw;
+      memcpy (t->psw, v->psw, v->npsw);
+   }
+   else
+   {  t->func   = pin;
+      t->origin = ORIG_ENTRY;
+      t->npsw   = 0;
+   }
+}
 
-      // figure out if mode change
-      if ((mem[pin] == 0xf9) && (mem[pin+1] == 0x01))
-         rambank = BNK_BANK1;   // access game ram bank     SET1   PSW, 1
-      if ((mem[pin] == 0xd9) && (mem[pin+1] == 0x01))
-         rambank = BNK_BANK0;   // access OS ram bank       CLR1   PSW, 1
-      if ((mem[pin] == 0x71) && (mem[pin+1] == 0x01))
-         rambank = BNK_UNKNOWN; // restore bank from stack  POP    PSW
-
-      mem_use[pin] = MEM_CODE;   // it's executable
-      if (mem_bnk[pin] == BNK_UNKNOWN)
-        mem_bnk[pin] = rambank;
-      else
-        if (mem_bnk[pin] != rambank)   // if found a conflicting instance
-          mem_bnk[pin] = BNK_VARIOUS;
 
-///// use one or both of these for debugging:
-/////dis(pin, &x);
-/////gets (junk);
+// PUSH PSW: saves the bank (and where it came from) for a POP PSW in the
+// same function. Past PSW_DEPTH the oldest is forgotten.
 
-      opcode = mem[pin];
-      model = get_opcode_model(opcode);
+static void push_psw (trace_type * v)
+{
+   if (v->npsw == PSW_DEPTH)
+      memmove (v->psw, v->psw + 1, --v->npsw);
+   v->psw[v->npsw++] = v->rambank | (v->origin << 4);
+}
 
-      // Flag illegal code
-      if (model[5] == '!')
+
+// POP PSW: back to the bank of the matching PUSH PSW, or if the function
+// didn't push one, whatever its caller pushed.
+
+static void pop_psw (trace_type * v)
+{
+   if (v->npsw)
+   {  v->npsw--;
+      v->rambank = v->psw[v->npsw] & 0x0F;
+      v->origin  = v->psw[v->npsw] >> 4;
+   }
+   else
+   {  v->rambank = BNK_UNKNOWN;
+      v->origin  = ORIG_STACK;
+   }
+}
+
+
+// A RET (or the firmware's exit) of the function v is in: merges the bank
+// it returns with into the function's EFFECT_xxx.
+
+static void note_return (lcdis_type * ctx, trace_type * v)
+{
+   int effect, old;
+
+   switch (v->origin)
+   {
+      case ORIG_ENTRY: effect = EFFECT_KEEP;  break;
+      case ORIG_STACK: effect = EFFECT_STACK; break;
+      case ORIG_SET:   effect = (v->rambank == BNK_BANK0) ? EFFECT_BANK0
+                              : (v->rambank == BNK_BANK1) ? EFFECT_BANK1 : EFFECT_UNKNOWN;
+                       break;
+      default:         effect = EFFECT_UNKNOWN;
+   }
+   old = ctx->effect[v->func] & ~EFFECT_DONE;
+   if ((old != EFFECT_NONE) && (old != effect))
+      effect = EFFECT_UNKNOWN;
+   ctx->effect[v->func] = (ctx->effect[v->func] & EFFECT_DONE) | effect;
+}
+
+
+// Back from a call to target: the bank is whatever the function leaves it
+// as. One that hasn't been traced all the way yet (it's calling itself, or
+// the call came first) is taken to leave it alone, as all calls used to be.
+
+static void after_call (lcdis_type * ctx, trace_type * v, int target)
+{
+   if ((target < 0) || (target > 0xFFFF) || !(ctx->effect[target] & EFFECT_DONE))
+      return;
+   switch (ctx->effect[target] & ~EFFECT_DONE)
+   {
+      case EFFECT_BANK0:   v->rambank = BNK_BANK0;   v->origin = ORIG_SET; break;
+      case EFFECT_BANK1:   v->rambank = BNK_BANK1;   v->origin = ORIG_SET; break;
+      case EFFECT_STACK:   pop_psw (v);                                    break;
+      case EFFECT_UNKNOWN: v->rambank = BNK_UNKNOWN; v->origin = ORIG_UNKNOWN; break;
+   }
+}
+
+
+// A call to a function that's been traced all the way, with this bank:
+// tracing it again would find nothing new, so its effect is used instead.
+//
+// Returns: 1=done, carry on after the call
+//          0=the function has to be traced
+
+static int known_call (lcdis_type * ctx, trace_type * v, int target)
+{
+   int seen;
+
+   if ((target < 0) || (target > 0xFFFF))
+      return 0;
+   if (get_use (ctx, target) != MEM_CODE && get_use (ctx, target) != MEM_CODE_LABELED)
+      return 0;
+   seen = get_seen (ctx, target);
+   if (   !(ctx->effect[target] & EFFECT_DONE)
+       || ((v->rambank != BNK_UNKNOWN) && !(seen & (1 << v->rambank))))
+      return 0;
+   ctx->mem_use[target] = MEM_CODE_LABELED;   // as the call's vein would have
+   after_call (ctx, v, target);
+   STAT_ADD (ctx, summaries, 1);
+   return 1;
+}
+
+
+// Steps over the operand bytes of the instruction at v->pin, marking them
+// as places that can't be executed.
+//
+// Returns: 0=ok, v->pin is the next instruction
+//          1=ran into code that was already mapped (misaligned code)
+
+static int skip_operands (lcdis_type * ctx, trace_type * v)
+{
+   int len;
+   int pin;
+
+   len = decode[ctx->mem[v->pin]].len;
+   if (v->again)       // traced before: the operands are marked already
+   {  v->pin += len;
+      return 0;
+   }
+   pin = v->pin + 1;   // usage for pin has been marked as code already
+
+   // mark remaining bytes of this instruction as code
+   while (--len > 0)
+   {
+      if (ctx->mem_use[pin] != MEM_UNKNOWN)
       {
-         printf ("WARNING: illegal instruction found at $%04x\n"
-                 "         trace stack: ", pin);
-         for (i=0; i<level; i++)
-           printf ("%04x ", calltrace[i]);
-         printf ("\n\n");
-         level--;    // don't continue to follow this vein
-         return 1;   // and tell caller not to, either.
+         STAT_ADD (ctx, misaligned, 1);
+         out_printf (&ctx->out, "WARNING: misaligned code found at $%04x\n", pin);
+         print_trace_stack (ctx);
+
+         set_seen (ctx, v->pin, 0);   // never got past it: don't go past it for another bank either
+
+         ctx->mem_use[v->pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
+         return 1;    // don't continue in this vein because it's messed up (probably)
+                      // see example below
       }
 
-      if (strncmp(model, "CALL ", 5) == 0)
-      {
-         branchaddr = get_a12(pin);
-         badvein=mapmem(branchaddr, rambank);        // recurse
-         if (badvein && strictmode)
-         {  level--;
-            mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
-            return 1;                                  // end of the line
-         }
+      ctx->mem_use[pin++] = MEM_INVALID;
+        // mark 2nd through 3rd bytes of an instruction as invalid parts to start executing.
+        // This is a good assumption, but some people are really tricky and do this on purpose
+        //
+        // 6502 Example:      CMP #$13    ;return if A=13
+        //                    BEQ x1+1
+        //                X1: BEQ $60     ; this branch is never taken. $60 opcode is RET and is executed if A=13
+        //                                ; you could put a clear-carry there, instead, if you wanted C clear on A=13
+        //                    ...
+   }
+   v->pin = pin;
+   return 0;
+}
+
+
+// Follows the vein on top of the trace stack until it ends or branches
+// somewhere that has to be traced first.
+//
+// Returns: 0=valid code
+//          1=invalid code
+//          VEIN_PUSHED=a new vein was pushed; this one continues once it's done
+
+static int trace_vein (lcdis_type * ctx)
+{
+   trace_type * v;
+   decode_type * d;
+   int    i;
+   int    pin;                // pc during trace
+   int    use;
+   int    seen;
+   int    entry;
+   int    again;
+
+// debug variables:
+// int x; char junk[200];
+
+   v = &ctx->trace[ctx->level-1];
+
+   if (v->resume)             // back from a call or branch: step past it
+   {  v->resume=0;
+      if (decode[ctx->mem[v->pin]].flow == FLOW_CALL)
+         after_call (ctx, v, get_target (ctx, v->pin));
+      if (skip_operands (ctx, v))
+         return 1;
+   }
+
+   while (1)
+   {
+      pin = v->pin;
+
+      if (pin <0 || pin>0xFFFF)
+      {   ctx->gaveup=1;
+          out_printf (&ctx->out, "FATAL INTERNAL ERROR: attempted to map illegal address %04x!\n", pin);
+          if (ctx->keepgoing)     // batch.c: just give up on this image
+             return 1;
+          out_flush (&ctx->out);
+          exit (-1);
       }
-      else
-      if (strncmp(model, "CALLF", 5) == 0)
+      use = get_use (ctx, pin);   // pin may be anywhere; once it's MEM_UNKNOWN it's in the image
+
+      if (    (use == MEM_DATA)       // <- this is impossible so far because we don't mark any code data yet.
+           || (use == MEM_GRAPHICS)
+           || (use == MEM_UNUSED))
       {
-         branchaddr = get_a16(pin);
-         badvein=mapmem(branchaddr, rambank);        // recurse
-         if (badvein && strictmode)
-         {  level--;
-            mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
-            return 1;                                  // end of the line
+         if (!v->quiet)
+         {  out_printf (&ctx->out, "WARNING: branch exists to data/graphics/unused code at $%04x\n", pin);
+            print_trace_stack (ctx);
          }
+         set_use (ctx, v->pin_in, MEM_INVALID);  // we'll label it invalid.
+         return 1;    // only explore the good stuff
       }
-      else
-      if (strncmp(model, "CALLR", 5) == 0)
+      if (use == MEM_INVALID)
       {
-         branchaddr = get_r16(pin);
-         badvein=mapmem(branchaddr, rambank);       // recurse
-         if (badvein && strictmode)
-         {  level--;
-            mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
-            return 1;                                  // end of the line
+         if (!v->quiet)
+         {  out_printf (&ctx->out, "WARNING: branch exists to invalid code at $%04x\n", pin);
+            print_trace_stack (ctx);
          }
+         return 1;    // only explore the good stuff
       }
-      else
-      if (strncmp(model, "JMP  ", 5) == 0)
-      {
-         branchaddr = get_a12(pin);
-         badvein=mapmem(branchaddr, rambank);         // recurse
-         level--;
-         mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
-         return badvein;                                  // end of the line
+
+      // figure out if mode change
+      if ((ctx->mem[pin] == 0xf9) && (ctx->mem[pin+1] == 0x01))
+      {  v->rambank = BNK_BANK1;   // access game ram bank     SET1   PSW, 1
+         v->origin  = ORIG_SET;
       }
-      else
-      if (strncmp(model, "JMPF ", 5) == 0)
-      {
-         branchaddr = get_a16(pin);
-         badvein=mapmem(branchaddr, rambank);         // recurse
-         level--;
-         mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
-         return badvein;
+      if ((ctx->mem[pin] == 0xd9) && (ctx->mem[pin+1] == 0x01))
+      {  v->rambank = BNK_BANK0;   // access OS ram bank       CLR1   PSW, 1
+         v->origin  = ORIG_SET;
       }
-      else
-      if (strncmp(model, "RET", 3) == 0)     // RET and RETI
+      if ((ctx->mem[pin] == 0x61) && (ctx->mem[pin+1] == 0x01))
+         push_psw (v);             // save bank on stack       PUSH   PSW
+      if ((ctx->mem[pin] == 0x71) && (ctx->mem[pin+1] == 0x01))
+         pop_psw (v);              // restore bank from stack  POP    PSW
+
+      // Code that's been traced is only traced again for a bank it hasn't
+      // been traced with. Where it goes doesn't depend on the bank, so an
+      // unknown bank has nothing to add, and each instruction is traced at
+      // most once per bank.
+      v->again = 0;
+      if (use != MEM_UNKNOWN)
       {
-         level--;
-         mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
-         return 0;                            // a dead-end
+         seen = get_seen (ctx, pin);
+         if (!seen || (v->rambank == BNK_UNKNOWN) || (seen & (1 << v->rambank)))
+         {  ctx->mem_use[v->pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
+            return 0;    // only explore the unknown
+         }
+         v->again = 1;
       }
       else
-      if (strncmp(model, "BRF  ", 5) == 0)
-      {
-         branchaddr = get_r16(pin);
-         badvein=mapmem(branchaddr, rambank);       // recurse
-         level--;
-         mem_use[pin_in] = MEM_CODE_LABELED;        // we'll label the main entry point
-         return badvein;                                  // a dead end
+         ctx->mem_use[pin] = MEM_CODE;   // it's executable
+      v->quiet = v->again;               // what comes after code traced before has been too
+      v->entered = 1;
+      set_seen (ctx, pin, get_seen (ctx, pin) | (1 << v->rambank));
+      STAT_ADD (ctx, insns, 1);
+
+      // an unknown bank doesn't disagree with anything; two known ones do
+      if (v->rambank != BNK_UNKNOWN)
+      {  if (ctx->mem_bnk[pin] == BNK_UNKNOWN)
+           ctx->mem_bnk[pin] = v->rambank;
+         else
+           if (ctx->mem_bnk[pin] != v->rambank)   // if found a conflicting instance
+             ctx->mem_bnk[pin] = BNK_VARIOUS;
       }
-      else
-      if (strncmp(model, "BR   ", 5) == 0)
+
+///// use one or both of these for debugging:
+/////dis(ctx, pin, &x);
+/////gets (junk);
+
+      d = &decode[ctx->mem[pin]];
+      again = v->again;
+
+      // push_vein may move ctx->trace, so v isn't used after it.
+      // A vein started from code traced before has been traced before too
+      // (with another bank), and so have its warnings.
+      switch (d->flow)
       {
-         branchaddr = get_r8(pin);
-         badvein=mapmem(branchaddr, rambank);       // recurse
-         level--;
-         mem_use[pin_in] = MEM_CODE_LABELED;        // we'll label the main entry point
-         return badvein;                            // a dead end
+         case FLOW_ILLEGAL:   // Flag illegal code
+            if (!again)
+            {  out_printf (&ctx->out, "WARNING: illegal instruction found at $%04x\n", pin);
+               print_trace_stack (ctx);
+            }
+            return 1;   // don't continue to follow this vein, and tell caller not to, either.
+
+         case FLOW_CALL:      // CALL, CALLF, CALLR
+            if (known_call (ctx, v, get_target(ctx, pin)))
+               break;         // carry on after it
+            push_vein (ctx, get_target(ctx, pin), v->rambank, VEIN_CALL);
+            ctx->trace[ctx->level-1].quiet = again;
+            return VEIN_PUSHED;
+
+         case FLOW_JUMP:      // JMP, JMPF, BR, BRF
+            push_vein (ctx, get_target(ctx, pin), v->rambank, VEIN_JUMP);
+            ctx->trace[ctx->level-1].quiet = again;
+            return VEIN_PUSHED;                        // a dead end
+
+         case FLOW_RETURN:    // RET and RETI
+            note_return (ctx, v);
+            ctx->mem_use[v->pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
+            return 0;                            // a dead-end
+
+         case FLOW_BRANCH:    // These branch instructions are all assumed to be takeable or non-taken:
+//            rambank = BNK_UNKNOWN;  // we don't know if branch is taken or not
+            push_vein (ctx, get_target(ctx, pin), v->rambank, VEIN_BRANCH);
+            ctx->trace[ctx->level-1].quiet = again;
+            return VEIN_PUSHED;
       }
-      else       // These branch instructions are all assumed to be takeable or non-taken:
-      if (   (model[0]=='B')                     // if branch instruction
-          || (strncmp(model, "DBNZ ", 5) == 0))  // funnily named branch instruction
-      {
-//         rambank = BNK_UNKNOWN;  // we don't know if branch is taken or not
-         switch (model[5])
-         {
-            case '8':   // r8    relative
-            case 'c':   // c=@Ri,r8
-               branchaddr= get_r8(pin);
-               break;
-            case 'r':   // r=d9,b3,r8 bit branch
-               branchaddr= get_r8(pin+1);
-               break;
-            case 'z':   // z=#i8,r8
-            case 'x':   // x=d9,r8
-            case 'v':   // v=@Ri,#i8,r8
-               branchaddr= get_r8(pin+1);
-               break;
 
-            default:
-               printf ("FATAL Error: unexpected branch model %c in op[] table!\n", model[5]);
-         }
-         badvein=mapmem(branchaddr, rambank);    // recurse
-         if (badvein && strictmode)
-         {  level--;
-            mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
-            return 1;                                  // end of the line
-         }
-      }
-      else   // Code could change execution location by switching banks:
-      if ( (mem[pin] == 0xB8) && (mem[pin+1]==0x0D) )  // {0xB8, 0x0D,   -1} NOT1   EXT, 0
+      // Code could change execution location by switching banks:
+      if ( (ctx->mem[pin] == 0xB8) && (ctx->mem[pin+1]==0x0D) )  // {0xB8, 0x0D,   -1} NOT1   EXT, 0
       {
-         if (!biosmode)
-         {  entry= pin + opcode_len(opcode);  // calc PC of code after this instruction
+         if (!ctx->biosmode)
+         {  entry= pin + d->len;              // calc PC of code after this instruction
                                               // (always 2 now, but might be 1 if some other way of modifing EXT is trapped)
             for (i=0; FIRMWARECALL[i].entry != -1; i++)
             {
@@ -979,74 +1595,133 @@ int mapmem (int pin_in, int rambank)
                   // "just in case". Usually it's a jump to try the NOT1 EXT,0 portion
                   // again. It may be junk code. We'll disassemble just one opcode to
                   // make it look pretty.
-                  if (mem_use[entry] == MEM_UNKNOWN)   // if it would otherwise not be disassembled...
-                     mem_use[entry] = MEM_CODE;
+                  if (ctx->mem_use[entry] == MEM_UNKNOWN)   // if it would otherwise not be disassembled...
+                     ctx->mem_use[entry] = MEM_CODE;
 
                   if (FIRMWARECALL[i].exit == -1)
                   {                        // treat like a return (this is the exit vector)
-                     level--;
-                     mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
+                     note_return (ctx, v);
+                     ctx->mem_use[v->pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
                      return 0;                            // a dead end
                   }
                   else
                   {                        // treat like a jump
-                     badvein=mapmem(FIRMWARECALL[i].exit, rambank);        // recurse
-                     level--;
-                     mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
-
-                     return badvein;                            // a dead end
+                     push_vein (ctx, FIRMWARECALL[i].exit, v->rambank, VEIN_JUMP);
+                     ctx->trace[ctx->level-1].quiet = again;
+                     return VEIN_PUSHED;                  // a dead end
                   }
                }
             }
 
-            printf ("WARNING: NOT1 EXT,0 encountered at unexpected address %04x.\n"
-                    "         This code calls a routine in the firmware and the return address\n"
-                    "         is unknown (not in FIRMWARECALL table).\n\n", entry);
-            level--;
-            mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
+            if (!again)
+               out_printf (&ctx->out, "WARNING: NOT1 EXT,0 encountered at unexpected address %04x.\n"
+                       "         This code calls a routine in the firmware and the return address\n"
+                       "         is unknown (not in FIRMWARECALL table).\n\n", entry);
+            ctx->mem_use[v->pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
             return 1;                            // a dead end since we don't know where to go
             // we consider this an error because it is unexpected code.
          }
          else          // handle "NOT1 EXT, 0" in biosmode
          {
-            level--;
-            mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
-            mem_use[pin+2] = MEM_CODE_LABELED;   // label the jump to user code
+            ctx->mem_use[v->pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
+            ctx->mem_use[pin+2] = MEM_CODE_LABELED;   // label the jump to user code
             return 1;                            // treat as a dead end
          }
       }
 
       // continue evaluating code until end
-      pin++;   // usage for pin has been marked as code already
+      if (skip_operands (ctx, v))
+         return 1;
+   }  // while 1
+}
+
 
-      // mark remaining bytes of this instruction as code
-      for (i=0; i<opcode_len(opcode)-1; i++)
+// input: executable address
+//        rambank (in future versions, this may expand to a system state)
+//
+// warning: is fooled by branches that cover both cases
+//          i.e. BZ followed by a BNZ will always go to one of those
+//          cases, but this code will think that the BNZ case may not
+//          execute and continue mapping. Nice programmers would use
+//          a BR instruction in the second case, but those that aren't
+//          used to such new-fangled technology might not (like me).
+//
+//          Also, computed gotos (pushing a table entry and RET) are not
+//          honored here; jump_map finds them afterwards.
+//
+//          rambank problems:
+//
+//          POP PSW gets back the bank of the PUSH PSW before it in the
+//          same function (each vein keeps the last few). A function's RETs
+//          say what calling it does to the bank (ctx->effect: leaves it,
+//          sets it, pops the caller's PSW, or more than one of those), and
+//          the caller carries on with that once the function has been
+//          traced all the way; a call to it after that with a bank it's
+//          been traced with isn't traced again. Calls to a function still
+//          being traced (recursion) leave the bank alone, as all calls
+//          used to.
+//
+//          Code that is reached again with a known bank it hasn't been
+//          traced with is traced again with that bank (ctx->seen has a
+//          bitmap per bank), so code used both ways (like the BIOS memory
+//          clear) comes out BNK_VARIOUS whichever way it was found first,
+//          and code first found with an unknown bank gets the bank of any
+//          later path that knows it. Nothing is traced more than three times.
+//
+// Branches aren't followed by recursion; each branch target is pushed on
+// ctx->trace as a new vein and traced first (depth first, the order the
+// old recursive version used), then the vein that branched picks up where
+// it left off. The trace stack only grows with the nesting of the code
+// being traced, never the C stack.
+//
+// Returns: 0=valid code
+//          1=invalid code
+
+int mapmem (lcdis_type * ctx, int pin_in, int rambank)
+{
+   trace_type * v;
+   int    kind;
+   int    badvein;
+
+   if (ctx->gaveup)          // nothing more to be done with this image
+      return 1;
+   ctx->level=0;
+   push_vein (ctx, pin_in, rambank, VEIN_ROOT);
+
+   while (1)
+   {
+      badvein = trace_vein (ctx);
+      if (badvein == VEIN_PUSHED)
+         continue;
+      if (ctx->gaveup)
+         return 1;
+      if (badvein)
+         STAT_ADD (ctx, badveins, 1);
+
+      // vein ended: hand the result down until a vein can carry on
+      while (1)
       {
-         if (mem_use[pin] != MEM_UNKNOWN)
+         kind = ctx->trace[--ctx->level].kind;
+         v = &ctx->trace[ctx->level];
+         if (((kind == VEIN_CALL) || (kind == VEIN_ROOT)) && v->entered)
+            ctx->effect[v->pin_in] |= EFFECT_DONE;   // all its RETs are in
+         if (kind == VEIN_ROOT)
+            return badvein;
+
+         v = &ctx->trace[ctx->level-1];
+         if ((kind == VEIN_CALL) || (kind == VEIN_BRANCH))
          {
-            printf ("WARNING: misaligned code found at $%04x\n"
-                 "         trace stack: ", pin);
-            for (i=0; i<level; i++)
-              printf ("%04x ", calltrace[i]);
-            printf ("\n\n");
-
-            mem_use[pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
-            return 1;    // don't continue in this vein because it's messed up (probably)
-                         // see example below
+            if (!(badvein && ctx->strictmode))
+            {  v->resume=1;                           // carry on after the call/branch
+               break;
+            }
+            // end of the line (strict mode)
+            set_seen (ctx, v->pin, 0);   // so it stays the end for other banks too
          }
-
-         mem_use[pin++] = MEM_INVALID;
-           // mark 2nd through 3rd bytes of an instruction as invalid parts to start executing.
-           // This is a good assumption, but some people are really tricky and do this on purpose
-           //
-           // 6502 Example:      CMP #$13    ;return if A=13
-           //                    BEQ x1+1
-           //                X1: BEQ $60     ; this branch is never taken. $60 opcode is RET and is executed if A=13
-           //                                ; you could put a clear-carry there, instead, if you wanted C clear on A=13
-           //                    ...
+         // a jump (or a strict-mode failure) ends the vein that took it too
+         ctx->mem_use[v->pin_in] = MEM_CODE_LABELED;  // we'll label the main entry point
       }
-
-   }  // while 1
+   }
 }
 
 
@@ -1054,39 +1729,150 @@ int mapmem (int pin_in, int rambank)
 
 int opcode_len (int opcode)
 {
-   char * model;
+   return decode[opcode & 0xFF].len;
+}
+
+
+//------------------------------------------------------------------------------------
+// init_decode
+//  Builds decode[] from op[]. Must be called once before anything is traced
+//  or disassembled; afterwards the table is only read.
+//------------------------------------------------------------------------------------
 
-   model = get_opcode_model(opcode);
+void init_decode (void)
+{
+   int opcode;
+   char * model;
+   decode_type * d;
 
-   switch (model[5])
+   for (opcode=0; opcode<256; opcode++)
    {
+      model = get_opcode_model(opcode);
+      d = &decode[opcode];
 
-     case ' ':   // no parameters
-     case '@':   // @Ri   indirect
-     case '!':   // illegal
-        return 1;
-
-     case '2':   // a12   absolute
-     case '8':   // r8    relative
-     case '9':   // d9    direct
-     case '#':   // #     immediate
-     case '%':   // %=#i8,@Ri
-     case 'b':   // b=d9,b3    bit manipulation
-     case 'c':   // c=@Ri,r8
-        return 2;
-
-     case '6':   // r16   relative
-     case '7':   // a16   absolute
-     case '^':   // ^=#i8,d9 immediate
-     case 'r':   // r=d9,b3,r8 bit branch
-     case 'z':   // z=#i8,r8
-     case 'x':   // x=d9,r8
-     case 'v':   // v=@Ri,#i8,r8
-        return 3;
+      d->model   = model;
+      d->operand = model[5];
+
+      switch (model[5])
+      {
+        case ' ':   // no parameters
+        case '@':   // @Ri   indirect
+        case '!':   // illegal
+           d->len = 1;
+           break;
+
+        case '2':   // a12   absolute
+        case '8':   // r8    relative
+        case '9':   // d9    direct
+        case '#':   // #     immediate
+        case '%':   // %=#i8,@Ri
+        case 'b':   // b=d9,b3    bit manipulation
+        case 'c':   // c=@Ri,r8
+           d->len = 2;
+           break;
+
+        case '6':   // r16   relative
+        case '7':   // a16   absolute
+        case '^':   // ^=#i8,d9 immediate
+        case 'r':   // r=d9,b3,r8 bit branch
+        case 'z':   // z=#i8,r8
+        case 'x':   // x=d9,r8
+        case 'v':   // v=@Ri,#i8,r8
+           d->len = 3;
+           break;
+
+        default:
+           printf ("FATAL Error: unexpected model %c in op[] table!\n", model[5]);
+           exit (-1);
+      }
+
+      // classify control flow. Order matters: BR and BRF also start with 'B'.
+      if (model[5] == '!')
+         d->flow = FLOW_ILLEGAL;
+      else
+      if (   (strncmp(model, "CALL ", 5) == 0)
+          || (strncmp(model, "CALLF", 5) == 0)
+          || (strncmp(model, "CALLR", 5) == 0))
+         d->flow = FLOW_CALL;
+      else
+      if (   (strncmp(model, "JMP  ", 5) == 0)
+          || (strncmp(model, "JMPF ", 5) == 0)
+          || (strncmp(model, "BRF  ", 5) == 0)
+          || (strncmp(model, "BR   ", 5) == 0))
+         d->flow = FLOW_JUMP;
+      else
+      if (strncmp(model, "RET", 3) == 0)     // RET and RETI
+         d->flow = FLOW_RETURN;
+      else
+      if (   (model[0]=='B')                     // if branch instruction
+          || (strncmp(model, "DBNZ ", 5) == 0))  // funnily named branch instruction
+         d->flow = FLOW_BRANCH;
+      else
+         d->flow = FLOW_NEXT;
+
+      // does it store to its memory operand? (flash.c watches TRL, TRH and FLASHA16)
+      d->writes = (   (strncmp(model, "ST   ", 5) == 0)
+                   || (strncmp(model, "MOV  ", 5) == 0)
+                   || (strncmp(model, "INC  ", 5) == 0)
+                   || (strncmp(model, "DEC  ", 5) == 0)
+                   || (strncmp(model, "POP  ", 5) == 0)
+                   || (strncmp(model, "XCH  ", 5) == 0)
+                   || (strncmp(model, "DBNZ ", 5) == 0)
+                   || (strncmp(model, "NOT1 ", 5) == 0)
+                   || (strncmp(model, "CLR1 ", 5) == 0)
+                   || (strncmp(model, "SET1 ", 5) == 0));
+
+      // pick the branch target extractor
+      d->target = TGT_NONE;
+      if ((d->flow == FLOW_CALL) || (d->flow == FLOW_JUMP) || (d->flow == FLOW_BRANCH))
+         switch (model[5])
+         {
+            case '2':   // a12   absolute
+               d->target = TGT_A12;
+               break;
+            case '7':   // a16   absolute
+               d->target = TGT_A16;
+               break;
+            case '6':   // r16   relative
+               d->target = TGT_R16;
+               break;
+            case '8':   // r8    relative
+            case 'c':   // c=@Ri,r8
+               d->target = TGT_R8;
+               break;
+            case 'r':   // r=d9,b3,r8 bit branch
+            case 'z':   // z=#i8,r8
+            case 'x':   // x=d9,r8
+            case 'v':   // v=@Ri,#i8,r8
+               d->target = TGT_R8_1;
+               break;
+
+            default:
+               printf ("FATAL Error: unexpected branch model %c in op[] table!\n", model[5]);
+               exit (-1);
+         }
    }
 }
 
 
+// get_target
+//  in: address of a call, jump or branch instruction
+// out: address it can transfer control to (-1 if it can't)
+
+int get_target (lcdis_type * ctx, int pin)
+{
+   switch (decode[ctx->mem[pin]].target)
+   {
+      case TGT_A12:  return get_a12(ctx, pin);
+      case TGT_A16:  return get_a16(ctx, pin);
+      case TGT_R16:  return get_r16(ctx, pin);
+      case TGT_R8:   return get_r8(ctx, pin);
+      case TGT_R8_1: return get_r8(ctx, pin+1);
+   }
+   return -1;
+}
+
+
 //------------------------------------------------------------------------------------
 // get_opcode_model
 //  in: opcode
@@ -1129,43 +1915,140 @@ char * get_opcode_model (int opcode)
 //                 !       invalid!
 
 
-int get_a12(int pin)
+int get_a12(lcdis_type * ctx, int pin)
 {
-  return (  ((pin+2) & 0xF000)               // get first part from PC
-          | ((mem[pin] & 0x07) << 8 )        // get some bits
-          | ((mem[pin] & 0x10) ? 0x800 : 0)  // out of place bit
-          | (mem[pin+1]));                   // lower 8 bits
+  return (  ((pin+2) & 0xF000)                    // get first part from PC
+          | ((ctx->mem[pin] & 0x07) << 8 )        // get some bits
+          | ((ctx->mem[pin] & 0x10) ? 0x800 : 0)  // out of place bit
+          | (ctx->mem[pin+1]));                   // lower 8 bits
 }
 
 
-int get_r16(int pin)
+int get_r16(lcdis_type * ctx, int pin)
 { // warning: byte order is reversed of A16!
-  return ( 0xFFFF & (pin + 3 - 1 +(mem[pin+2]<<8 | mem[pin+1])));
+  return ( 0xFFFF & (pin + 3 - 1 +(ctx->mem[pin+2]<<8 | ctx->mem[pin+1])));
+}
+
+
+int get_a16(lcdis_type * ctx, int pin)
+{
+  return (ctx->mem[pin+1]<<8 | ctx->mem[pin+2]);
 }
 
+int get_r8(lcdis_type * ctx, int pin)
+{
+   return ( 0xFFFF & (pin + 2 + (int) ((char) ctx->mem[pin+1])));
+}
+
+int get_d9(lcdis_type * ctx, int pin)
+{
+   return ( (ctx->mem[pin]&1)<<8 | ctx->mem[pin+1]);
+}
+int get_d9bit(lcdis_type * ctx, int pin)
+{
+   return ( (ctx->mem[pin]&0x10)<<4 | ctx->mem[pin+1]);
+}
 
-int get_a16(int pin)
+int get_reg(lcdis_type * ctx, int pin)
 {
-  return (mem[pin+1]<<8 | mem[pin+2]);
+   return (ctx->mem[pin] & 0x3);
 }
 
-int get_r8(int pin)
+
+//------------------------------------------------------------------------------------
+// init_symbols
+//  Indexes SFR[], MEM[] and LABELS[] so a name is found without walking the
+//  lists. The data space is only 0x000-0x1FF, so SFR and MEM names are
+//  direct-indexed; code labels go in an open-addressed hash table. Only the
+//  first entry for an address is kept, which is the one the list walk found
+//  (e.g. T1L rather than T1LR).
+//  CODECMTS[] is grouped by opcode (init_comments).
+//------------------------------------------------------------------------------------
+
+static unsigned int label_slot (int addr)
 {
-   return ( 0xFFFF & (pin + 2 + (int) ((char) mem[pin+1])));
+   return ((unsigned int) addr * 0x9E3779B1u) >> 16;   // Fibonacci hashing
 }
 
-int get_d9(int pin)
+
+// Groups CODECMTS[] by opcode so dis_code only tries the patterns that
+// can fit. The opcode byte of a pattern can't be a wildcard (-1 ends the
+// list), so every pattern lands in exactly one group.
+
+static void init_comments (void)
 {
-   return ( (mem[pin]&1)<<8 | mem[pin+1]);
+   int count;
+   int next[256];
+   int i;
+
+   for (count=0; CODECMTS[count].code[0] != -1; count++)
+      cmt_first[CODECMTS[count].code[0] & 0xFF]++;
+   for (i=256; i>0; i--)                 // counts -> start of each group
+      cmt_first[i] = cmt_first[i-1];
+   cmt_first[0] = 0;
+   for (i=1; i<=256; i++)
+      cmt_first[i] += cmt_first[i-1];
+
+   cmt_list = (int *) malloc ((count+1) * sizeof (int));
+   if (cmt_list == NULL)
+   {  printf ("FATAL Error: out of memory for the comment table!\n");
+      exit (-1);
+   }
+   memcpy (next, cmt_first, sizeof (next));
+   for (i=0; i<count; i++)
+      cmt_list[next[CODECMTS[i].code[0] & 0xFF]++] = i;
 }
-int get_d9bit(int pin)
+
+
+void init_symbols (void)
 {
-   return ( (mem[pin]&0x10)<<4 | mem[pin+1]);
+   unsigned int h;
+   int count;
+   int i;
+
+   for (i=0; MEM[i].addr != -1; i++)
+      if ((MEM[i].addr >= 0) && (MEM[i].addr < 0x200) && !mem_name[MEM[i].addr])
+         mem_name[MEM[i].addr] = MEM[i].text;
+
+   for (i=0; SFR[i].addr != -1; i++)
+      if ((SFR[i].addr >= 0) && (SFR[i].addr < 0x200) && !sfr_name[SFR[i].addr])
+         sfr_name[SFR[i].addr] = SFR[i].text;
+
+   init_comments ();
+
+   for (count=0; LABELS[count].addr != -1; count++)
+      ;
+   for (label_mask=1; label_mask < 2*count; label_mask<<=1)   // at most half full
+      ;
+   label_hash = (int *) malloc (label_mask * sizeof (int));
+   if (label_hash == NULL)
+   {  printf ("FATAL Error: out of memory for the label table!\n");
+      exit (-1);
+   }
+   memset (label_hash, -1, label_mask * sizeof (int));
+   label_mask--;
+
+   for (i=0; i<count; i++)
+   {
+      for (h = label_slot (LABELS[i].addr) & label_mask; label_hash[h] != -1; h = (h+1) & label_mask)
+         if (LABELS[label_hash[h]].addr == LABELS[i].addr)
+            break;                        // already have one for this address
+      if (label_hash[h] == -1)
+         label_hash[h] = i;
+   }
 }
 
-int get_reg(int pin)
+
+// Returns: LABELS[] text for addr, or NULL
+
+char * find_label (int addr)
 {
-   return (mem[pin] & 0x3);
+   unsigned int h;
+
+   for (h = label_slot (addr) & label_mask; label_hash[h] != -1; h = (h+1) & label_mask)
+      if (LABELS[label_hash[h]].addr == addr)
+         return LABELS[label_hash[h]].text;
+   return NULL;
 }
 
 
@@ -1181,18 +2064,16 @@ int get_reg(int pin)
 //   $xx    when in assembly mode
 
 
-void print_data_label (int addr, int rambank)
+void print_data_label (lcdis_type * ctx, int addr, int rambank)
 {
-   int found=0;
-   int i;
-
+   char * name;
    int bankedaddr;
 
 
    if (addr < 0x100)    // accessing memory
    {
 
-      if (!asmout)
+      if (!ctx->asmout)
       {
          if (rambank==BNK_BANK0)   // determine bank
            bankedaddr=addr;
@@ -1205,48 +2086,47 @@ void print_data_label (int addr, int rambank)
            bankedaddr=addr;
          }
 
-         if (rambank != BNK_UNKNOWN)
-            for (i=0; (MEM[i].addr != -1) && (!found); i++)
-               if ((bankedaddr) == MEM[i].addr)
-               {
-                  printf ("%s", MEM[i].text);
-                  found++;
-               }
-
-         if (!found)
+         name = (rambank != BNK_UNKNOWN) ? mem_name[bankedaddr] : NULL;
+         if (name)
+            out_str (&ctx->out, name);
+         else
          {
             if (rambank != BNK_UNKNOWN)
-               printf ("MEM%03X", bankedaddr);
+            {  out_str (&ctx->out, "MEM");
+               out_HEX (&ctx->out, bankedaddr, 3);
+            }
             else
             {
-               printf ("MEMU%02X", bankedaddr);
-               printf ("[unknown bank; BANK0=");
-               print_data_label (addr, BNK_BANK0);
-               printf (", BANK1=");
-               print_data_label (addr, BNK_BANK1);
-               printf ("]");
+               out_str (&ctx->out, "MEMU");
+               out_HEX (&ctx->out, bankedaddr, 2);
+               out_str (&ctx->out, "[unknown bank; BANK0=");
+               print_data_label (ctx, addr, BNK_BANK0);
+               out_str (&ctx->out, ", BANK1=");
+               print_data_label (ctx, addr, BNK_BANK1);
+               out_char (&ctx->out, ']');
             }
          }
       }
       else
-         printf ("$%03x", addr); // assembly-compatible output
-                                 // might be nice to add bank info in comment!!!
+      {  out_char (&ctx->out, '$');         // assembly-compatible output
+         out_hex (&ctx->out, addr, 3);     // might be nice to add bank info in comment!!!
+      }
    }
    else                 // accessing an SFR
    {
-      for (i=0; (SFR[i].addr != -1) && (!found); i++)
-         if (addr == SFR[i].addr)
-         {
-            printf ("%s", SFR[i].text);
-            found++;
-         }
-
-      if (!found)
+      name = (addr < 0x200) ? sfr_name[addr] : NULL;
+      if (name)
+         out_str (&ctx->out, name);
+      else
       {
-         if (!asmout)
-            printf ("SFR%03X", addr);
+         if (!ctx->asmout)
+         {  out_str (&ctx->out, "SFR");
+            out_HEX (&ctx->out, addr, 3);
+         }
          else
-            printf ("$%03x", addr);
+         {  out_char (&ctx->out, '$');
+            out_hex (&ctx->out, addr, 3);
+         }
       }
    }
 }
@@ -1256,99 +2136,36 @@ void print_data_label (int addr, int rambank)
 // formatted: 0=just the text, ma'am
 //            1=add the colon and print exactly 13 characters
 //            2=if not found, don't print hex value- just print 13 spaces
-void print_code_label (int addr, int formatted)
+void print_code_label (lcdis_type * ctx, int addr, int formatted)
 {
-   int found;
-   int i;
-   char temp[50];
-
-   found=0;
-   for (i=0; (LABELS[i].addr != -1) && (!found); i++)
-      if (addr == LABELS[i].addr)
+   char * name;
+   int n;
+
+   STAT_ADD (ctx, labels, 1);
+   name = annot_label (ctx, addr);
+   if (name == NULL)
+      name = find_label (addr);
+   if (name)
+   {
+      if (formatted)
       {
-         if (formatted)
-         {
-            sprintf (temp,"%s:", LABELS[i].text);   // add the colon
-            printf ("%-13s", temp);                 // fill to 13 spaces
-         }
-         else
-            printf ("%s", LABELS[i].text);
-         found++;
+         n = strlen (name);                 // annotated labels can be any length
+         out_mem (&ctx->out, name, n);
+         out_pad (&ctx->out, ":", (n < 12) ? 13 - n : 2);   // fill to 13 spaces, at least one
       }
-   if (!found)
+      else
+         out_str (&ctx->out, name);
+   }
+   else
    {
       if (formatted==2)  // used to label graphics and fonts
-        printf ("             ");
+        out_str (&ctx->out, "             ");
       else
       {
-        printf ("L%04X", addr);
+        out_char (&ctx->out, 'L');
+        out_HEX (&ctx->out, addr, 4);
         if (formatted)
-          printf (":       ");
+          out_str (&ctx->out, ":       ");
       }
    }
 }
-
-
-//
-// Search for text strings and mark them with usage MEM_TEXT
-// 
-// Text strings:
-//    are null terminated
-//    are 4-128 characters long
-//    don't have 8th bit set
-//    are printable or $0d or $0a
-//    have at least one alpha character
-//
-//    doesn't check from 0-0x23F. Usually there is no text there,
-//    but more importantly, we don't want to convert the text
-//    game name comments to strings (they are better printed out 
-//    by dis_data).
-//
-
-void search_text (int memsize)
-{
-   int valid, foundnull, alphacount;
-   int pin, i;
-   int stringsfound=0;
-   printf ("; Searching for text strings...");
-
-   for (pin=0x240; pin<memsize; )
-   {
-      valid=1;
-      foundnull=0;
-      alphacount=0;
-      for (i=0; (i<128) && valid && !foundnull; i++)
-      {
-         if ( (mem_use[pin+i]!=MEM_UNKNOWN) &&
-              (mem_use[pin+i]!=MEM_DATA))    // it's used for something else, not text.
-           valid=0;
-         else
-         if (mem[pin+i]==0)
-           foundnull=1;
-         else
-         if (    (   !isprint (mem[pin+i])  // not valid if not printable
-                  || (mem[pin+i] & 0x80))   // or has most significant bit set  
-              && (mem[pin+i] != 0x0d)        //    unless it's a CR
-              && (mem[pin+i] != 0x0a)        // or unless it's a LF
-            )
-           valid=0;
-
-         if (isalpha(mem[pin+i]))
-            alphacount++;
-      }
-
-      if ((i==128) || (i<5) || !valid || alphacount==0)  // if too long or too short or not valid or didn't have alphas
-      {
-         pin+=i; // this section was bad, go on to next one...
-      }
-      else         // found a string!
-      {
-         while (--i >= 0)
-           mem_use[pin++]=MEM_TEXT;
-         stringsfound++;
-      }
-   }
-
-   printf (" (%d strings found)\n", stringsfound);
-}
-
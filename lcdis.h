@@ -1,69 +1,12 @@
+// LCDIS - LC86104C/108C disassembler, library interface.
+// See lcdis.c for how the functions fit together, and main.c for the
+// command-line program built on top of them.
 
-int  mapmem (int pin_in, int rambank);
-void dis (int pin, int * b1);
-void dis_data (int pin, int * b1);
-void dis_code (int pin, int * b1);
-int  opcode_len (int opcode);
-char * get_opcode_model (int opcode);
-int get_a12(int pin);   
-int get_r16(int pin);
-int get_a16(int pin);
-int get_r8(int pin);
-int get_d9(int pin);
-int get_d9bit(int pin);
-int get_reg(int pin);
-void print_data_label (int addr, int rambank);
-void print_code_label (int addr, int formatted);
-int  checkmem(void);
-void search_text (int memsize);
-
-
-
-//---0---- ---1---- --2,3--- --4-7--- --8-F---
-
-
-// Format: 5 chars=NAME
-//         1 char= param   template
-//                  =      nop
-//                 2=a12   absolute
-//                 6=r16   relative 16
-//                 7=a16   absolute 16
-//                 8=r8    relative 8
-//                 9=d9 
-//                 @=@Ri   indirect
-//                 #=#i8   immediate
-//                 ^=#i8,d9 immediate
-//                 %=#i8,@Ri   
-//                 b=d9,b3    bit manipulation
-//                 r=d9,b3,r8 bit branch
-//                 z=#i8,r8
-//                 x=d9,r8
-//                 v=@Ri,#i8,r8
-//                 c=@Ri,r8
-//                 !=      invalid!!
-
-
-
-char op[5*16][8] =
-//---0---- ---1---- --2,3--- --4-7--- --8-F---
- {"NOP   ","BR   8","LD   9","LD   @","CALL 2",
-  "CALLR6","BRF  6","ST   9","ST   @","CALL 2",
-  "CALLF7","JMPF 7","MOV  ^","MOV  %","JMP  2",
-  "MUL   ","BE   z","BE   x","BE   v","JMP  2",
-  "DIV   ","BNE  z","BNE  x","BNE  v","BPC  r",
-  "LDF   ","STF   ","DBNZ x","DBNZ c","BPC  r",
-  "PUSH 9","PUSH 9","INC  9","INC  @","BP   r",
-  "POP  9","POP  9","DEC  9","DEC  @","BP   r",
-  "BZ   8","ADD  #","ADD  9","ADD  @","BN   r",
-  "BNZ  8","ADDC #","ADDC 9","ADDC @","BN   r",
-  "RET   ","SUB  #","SUB  9","SUB  @","NOT1 b",
-  "RETI  ","SUBC #","SUBC 9","SUBC @","NOT1 b",
-  "ROR   ","LDC   ","XCH  9","XCH  @","CLR1 b",
-  "RORC  ","OR   #","OR   9","OR   @","CLR1 b",
-  "ROL   ","AND  #","AND  9","AND  @","SET1 b",
-  "ROLC  ","XOR  #","XOR  9","XOR  @","SET1 b",
- };
+#ifndef LCDIS_H
+#define LCDIS_H
 
+#include <stdio.h>
+#include <stdint.h>
 
 #define MEM_UNUSED       0
 #define MEM_UNKNOWN      1  // used, but unknown yet.
@@ -78,317 +21,510 @@ char op[5*16][8] =
 #define BNK_BANK0    0   // System variables and the CPU stack
 #define BNK_BANK1    1   // For use by game software; by VMS OS before entering game mode
 #define BNK_UNKNOWN  2   // unknown usage
-#define BNK_VARIOUS  3   // has been observed with multiple usages
-                         // (note- the code isn't this smart, yet. It won't
-                         //  really remap code it's already visitied.)
+#define BNK_VARIOUS  3   // has been observed with multiple usages (code
+                         // already traced is traced again for each new bank)
+
+
+// control-flow class of an opcode (decode_type.flow):
+#define FLOW_NEXT        0  // falls through to the next instruction
+#define FLOW_CALL        1  // CALL, CALLF, CALLR
+#define FLOW_JUMP        2  // JMP, JMPF, BR, BRF (always taken)
+#define FLOW_BRANCH      3  // conditional branches and DBNZ (taken or not)
+#define FLOW_RETURN      4  // RET, RETI
+#define FLOW_ILLEGAL     5  // illegal opcode
+
+// branch-target extractor of an opcode (decode_type.target):
+#define TGT_NONE         0
+#define TGT_A12          1  // get_a12(pin)
+#define TGT_A16          2  // get_a16(pin)
+#define TGT_R16          3  // get_r16(pin)
+#define TGT_R8           4  // get_r8(pin)
+#define TGT_R8_1         5  // get_r8(pin+1), for 3-byte branches
+
+// Everything needed to trace or print an opcode, built once from op[]
+// by init_decode so the hot paths don't have to compare model strings:
+typedef struct {
+   char * model;            // entry in op[]
+   char   operand;          // operand template (model[5])
+   unsigned char len;       // instruction length, 1-3 bytes
+   unsigned char flow;      // FLOW_xxx
+   unsigned char target;    // TGT_xxx
+   unsigned char writes;    // 1=stores to its d9 or @Ri operand (ST, MOV, INC, SET1, ...)
+} decode_type;
+
+extern decode_type decode[256];
 
 typedef struct {int addr; char * text;} addrlist_type;
-
-
-// This list need not be ordered because i'm lazy. And the VMU doesn't produce that
-// much code that a decent computer can't cut through it all quick enough.
-//
-// This portion provided by Alexander Villagran -- thanks!
-
-addrlist_type SFR[] =
-  {   { 0x100, "ACC" }, 
-      { 0x101, "PSW" }, 
-      { 0x102, "B" }, 
-      { 0x103, "C" },     // C Register 
-      { 0x104, "TRL" }, 
-      { 0x105, "TRH" }, 
-      { 0x106, "SP" }, 
-      { 0x107, "PCON" }, 
-      { 0x108, "IE" }, 
-      { 0x109, "IP" },    // Interrupt Priority Ranking Control Register 
-      // 0x10A - 0x10C - Not Used 
-      { 0x10D, "EXT" },   // External Memory Control Register
-      { 0x10e, "OCR"},    // Oscillation Control Register - Picks either 32Khz, 600Khz (flash and LCD), and 5 Mhz (Dreamcast Connected) 
-      // 0x10f - Not Used 
-      { 0x110, "T0CON" }, // Timer/Counter 0 Control Register 
-      { 0x111, "T0PRR" }, // Timer 0 Prescaler Data Register 
-      { 0x112, "T0L" }, 
-      { 0x113, "T0LR" },  // Timer 0 Low Reload Register 
-      { 0x114, "T0H" }, 
-      { 0x115, "T0HR" },  // Timer 0 High Reload Register 
-      // 0x116-0x117 - Not Used 
-      { 0x118, "T1CNT" }, // Timer 1 Control Register 
-      // 0x119 - Not Used 
-      { 0x11A, "T1LC" },  // Timer 1 Low Compare Data Register 
-      { 0x11B, "T1L" },   // Timer 1 Low Register 
-      { 0x11B, "T1LR" },  // Timer 1 Low Reload Register 
-      { 0x11C, "T1HC" },  // Timer 1 High Compare Data Register 
-      { 0x11D, "T1H" },   // Timer 1 High Register 
-      { 0x11D, "T1HR" },  // Timer 1 High Reload Register 
-      // 0x11E - 0x11F - Not used 
-      { 0x120, "MCR"},    // Mode Control Register 
-      // 0x121 - Not Used 
-      { 0x122, "STAD" },  // Start Addresss Register 
-      { 0x123, "CNR" },   // Character Number Register 
-      { 0x124, "TDR" },   // Time Division Register 
-      { 0x125, "XBNK"},   // Bank Address Register 
-      // 0x126 - Not Used 
-      { 0x127, "VCCR"},   // LCD Contrast Control Register 
-      // 0x128-0x12f - Not Used 
-      { 0x130, "SCON0"},  // SIO0 Control Register 
-      { 0x131, "SBUF0"},  // SIO0 Buffer 
-      { 0x132, "SBR"},    // SIO Baud Rate Generator Register 
-      // 0x133 - Not Used 
-      { 0x134, "SCON1" }, // SIO1 Control Register 
-      { 0x135, "SBUF1" }, // SIO1 Buffer 
-      // 0x136-0x143 - Not Used 
-      { 0x144, "P1" }, 
-      { 0x145, "P1DDR"}, 
-      { 0x146, "P1FCR"},  // Port 1 Function Control Register 
-      // 0x147-0x14b - Not Used 
-      { 0x14c, "P3" }, 
-      { 0x14d, "P3DDR"}, 
-      { 0x14e, "P3INT"}, 
-      // 0x14F-0x15B - Not Used 
-      { 0x154, "FLASHA16"}, // bit 0 controls flash A17 bit for LDF/STF
-      { 0x15C, "P7" },    // Port 7 Latch 
-      { 0x15D, "I01CR" }, // External Interrupt 0, 1 Control Register 
-      { 0x15E, "I23CR" }, // External Interrupt 2, 3 Control Register 
-      { 0x15F, "ISL" },   // Input Signal Selection Register 
-      // 0x160 - 0x162 - Not Used [actually these are used by the BIOS]
-      { 0x163, "VSEL"},   // VMS Control Register 
-      { 0x164, "VRMAD1"}, // Work RAM Access Address 1 
-      { 0x165, "VRMAD2"}, // Work RAM Access Address 2 
-      { 0x166, "VTRBF"},  // Send/Receive Buffer 
-      { 0x167, "VLREG"},  // Length registration 
-      // 0x168-0x17E - Not Used 
-      { 0x17F, "BTCR" },  // Base Timer Control Register 
-      { 0x180, "XRAM" },  // 0x180-0x1FB - XRAM (Bank 0)[Lines 0 -> 15] 
-      { 0x180, "XRAM" },  // 0x180-0x1FB - XRAM (Bank 1)[Lines 16 -> 31] 
-      { 0x180, "XRAM" },  // 0x180-0x185 - XRAM (Bank 2)[4 Icons on bottom of LCD - DO NOT USE!] 
-      // 0x1FB - 0x1FF - Not Used 
-      { -1, "EOL"}        // ---End of list---
-  }; 
-
-
-addrlist_type MEM[] =
-  {
-// address 0-0xff are in the "OS" bank
-//
-// 000-003                    Index registers, bank 0 [default]
-// 004-007                    Index registers, bank 1 [doesn't seem used by BIOS]
-// 008-00b                    Index registers, bank 2 [doesn't seem used by BIOS]
-// 00c-00f                    Index registers, bank 3 [doesn't seem used by BIOS]
- 
-// 010-015 Buffer used by clock mode to convert current date and time to BCD (Binary Coded Decimal)
-      {0x017, "CD_YEARHI"},    // Current date, year (high byte)
-      {0x018, "CD_YEARLO"},    // Current date, year (low byte)
-      {0x019, "CD_MONTH"},     // Current date, month
-      {0x01A, "CD_DAY"},       // Current date, day
-      {0x01B, "CD_HOUR"},      // Current time, hour
-      {0x01C, "CD_MINUTE"},    // Current time, minute
-      {0x01D, "CD_SECOND"},    // Current time, second
-      {0x01E, "CD_HALFSEC"},   // Current time, halfsecond (0 or 1)
-      {0x01F, "CD_LEAPYR"},    // odd=leapyear, even=not leapyear
-
-//{0x020                has a decoded value (0-3==>1,2,4,8) of bits 2&3 of P7 (MEM023)
-//{0x023                stores bits 2&3 of P7
-
-      {0x031, "CD_CLOCKSET"},  // FF=date set, 00=not
-      {0x033, "AUTO_SLEEP_TIMER"}, //  Auto power-off timer incremented at 2 Hz by T1
-      {0x034, "T1SoftCtr2"}, // General purpose counter incremented at 2 Hz by T1
-                             // used to time the 2 second beep, blink icons, [autorepeat timer?]
-      {0x035, "SLEEP_MODE"}, // Bit-mapped: Bit 0 toggles when user presses sleep
-                             //   Bit 6: 1=disables sleep (both auto and user)
-                             //   Bit 7: 1=GetBtn will return $FE instead of autosleeping
-      {0x050, "CD_YRDIV4HI"},  // Current date, year divided by four (high byte)
-      {0x051, "CD_YRDIV4LO"},  // Current date, year divided by four (low byte)
-
-      {0x060, "CURSOR_X"},     // Cursor position, column (0-7)
-      {0x061, "CURSOR_Y"},     // Cursor position, row (0-3)
-
-      {0x067, "LCD_BKGROUND"},// Screen background color (0 or 0xFF)
-
-      {0x06D, "GAME_LASTBLK"}, //  Last block used by mini-game
-      {0x06E, "BATT_CHECK_DISABLE"}, // Battery check flag. $FF = disable automatic battery check, $00 = enable automatic battery check.
-      {0x06F, "FLASHA16_SHADOW"},    // Save a FLASH bank that is saved and restored
-
-      {0x070, "BUTTONS_PRESSED"}, // P3 xor'ed with $FF; 1=button pressed
-      {0x071, "BUTTONS_READ"},    // bitmap:1=selected button is pressed & not masked
-      {0x072, "BUTTONS_LAST"},    // bitmap:1=ignore because we've seen before, 0=active
-
-
-
-      {0x080, "STACK"},        //       Stack
-
- // addresses 0x100-0x1ff are in the user bank
- // I imagine that the OS uses some of these addresses for itself
- // when the game isn't running. If so, there should be a "BIOS-only"
- // flag so that these are only decoded if checking out the BIOS.
- // Others (such as FL_*) are used by both the BIOS and game for
- // communication.
-
-      {0x17C, "FL_FINAL"},     // 1=wait for last byte to finalize writing
-      {0x17D, "FL_ADDR_MSB"},  // Flash read/write start address (24 bits big endian)
-      {0x17E, "FL_ADDR_MED"},
-      {0x17F, "FL_ADDR_LSB"},
-      {0x17F, "FL_BUFFER"},    // 0x180-0x1FF
-
-      {   -1, "EOL"}        // ---End of list---
-  };
-
-
-
-// predefined label list: 
-addrlist_type LABELS[] =
-   {  { 0x0000, "reset"},    // Reset
-      { 0x0003, "int0"},     // INT0 interrupt (external)
-      { 0x000b, "int1"},     // INT1 interrupt (external)
-      { 0x0013, "int2_T0L"}, // INT2 interrupt (external) or T0L overflow
-      { 0x001b, "int3_BT"},  // INT3 interrupt (external) or Base Timer overflow
-      { 0x0023, "intT0H"},   // T0H overflow
-      { 0x002b, "intT1"},    // T1H or T1L overflow
-      { 0x0033, "intSIO0"},  // SIO0 interrupt
-      { 0x003b, "intSIO1"},  // SIO1 interrupt
-      { 0x0043, "intRFB"},   // RFB interrupt
-      { 0x004b, "intP3"},    // P3 interrupt
-      { 0x0100, "writeFlash"},  // link to ROM code
-      { 0x0108, "writeFlash2"}, // link to ROM code
-      { 0x0110, "verifyFlash"}, // link to ROM code
-      { 0x0120, "readFlash"},   // link to ROM code
-      { 0x0130, "intT1link"},   // link to ROM's T1 interrupt code
-      { 0x0140, "unknownlink"},
-      { 0x01f0, "quit"},   // exit vector
-
-      // future use: this can be used in decoding BIOS
-      // BIOS Version 1.002,1998/06/04,315-6124-03
-      {0x0473, "font0"}, 
-      {0x0f17, "fishgraphics"}, 
-
-      { -1, "EOL"}        // ---End of list---
-   };
-
-
 typedef struct {int code[3]; char * text;} codelist_type;
-
-// predefined code comments list:
-codelist_type CODECMTS[] =
-   {  { {0xB8, 0x0D,   -1}, "      ;execute code in other bank"},  // NOT1   EXT, 0
-      { {0x23, 0x4c, 0xFF}, "     ;allow us to read buttons"},     // MOV    #$ff,P3
-     
-      { {0x98, 0x4c,   -1}, ";branch if up button pressed"},    // BN     P3, 0, xxx
-      { {0x99, 0x4c,   -1}, ";branch if down button pressed"},  // BN     P3, 1, xxx
-      { {0x9a, 0x4c,   -1}, ";branch if left button pressed"},  // BN     P3, 2, xxx
-      { {0x9b, 0x4c,   -1}, ";branch if right button pressed"}, // BN     P3, 3, xxx
-      { {0x9c, 0x4c,   -1}, ";branch if A button pressed"},     // BN     P3, 4, xxx
-      { {0x9d, 0x4c,   -1}, ";branch if B button pressed"},     // BN     P3, 5, xxx
-      { {0x9e, 0x4c,   -1}, ";branch if Mode button pressed"},  // BN     P3, 6, xxx
-      { {0x9f, 0x4c,   -1}, ";branch if Sleep button pressed"}, // BN     P3, 7. xxx
-     
-      { {0x78, 0x4c,   -1}, ";branch if up button isn't pressed"},    // BP     P3, 0, xxx
-      { {0x79, 0x4c,   -1}, ";branch if down button isn't pressed"},  // BP     P3, 1, xxx
-      { {0x7a, 0x4c,   -1}, ";branch if left button isn't pressed"},  // BP     P3, 2, xxx
-      { {0x7b, 0x4c,   -1}, ";branch if right button isn't pressed"}, // BP     P3, 3, xxx
-      { {0x7c, 0x4c,   -1}, ";branch if A button isn't pressed"},     // BP     P3, 4, xxx
-      { {0x7d, 0x4c,   -1}, ";branch if B button isn't pressed"},     // BP     P3, 5, xxx
-      { {0x7e, 0x4c,   -1}, ";branch if Mode button isn't pressed"},  // BP     P3, 6, xxx
-      { {0x7f, 0x4c,   -1}, ";branch if Sleep button isn't pressed"}, // BP     P3, 7. xxx
-      { {0x03, 0x4c,   -1}, "          ;read buttons"}, //  LD     P3
-
-      { {0x78, 0x5c,   -1}, ";branch if Dreamcast connected"},       // BP     P7, 0, L05E4
-      { {0x98, 0x5c,   -1}, ";branch if Dreamcast isn't connected"}, // BN     P7, 0, L05E4
-
-
-      { {0x23, 0x27, 0x00}, "   ;turn off LCD"},                 // MOV    #$00,VCCR
-      { {0x23, 0x27, 0x80}, "   ;turn on LCD"},                  // MOV    #$00,VCCR
-//23 20 00 |              MOV    #$00,MCR
-//23 20 09 |              MOV    #$09,MCR
-
-      { {0xf8, 0x07,   -1}, "     ;hold- CPU & timers sleep until interrupt"}, // SET1   PCON, 0
-      { {0xf9, 0x07,   -1}, "     ;halt- CPU sleeps until interrupt"},         // SET1   PCON, 1
-
-      { {0x03, 0x66,   -1}, " ;read from work RAM"}, //  LD     VTRBF
-      { {0x13, 0x66,   -1}, " ;write to work RAM"},  //  ST     VTRBF
-
-      { {0x23, 0x0e, 0xa1}, "    ;set 32 kHz clock speed (normal)"},      //   MOV    #$a1,OCR
-      { {0x23, 0x0e, 0x81}, "    ;set 600 kHz clock speed (LCD speed)"}, //   MOV    #$81,OCR
-      { {0x23, 0x0e, 0xa3}, "    ;set 32 kHz clock speed (normal), stop RC clock"}, //   MOV    #$a3,OCR
-      { {0x23, 0x0e, 0x92}, "    ;set 6 MHz clock speed (docked)"},     //   MOV    #$92,OCR
-      { {0xfd, 0x0e,   -1}, ";set subclock mode (set to 32kHz)"},     //   SET1   OCR,5   
-      { {0xdd, 0x0e,   -1}, ";clear subclock mode (set to 600kHz)"},  //   CLR1   OCR,5  
-
-      { {0xdf, 0x08,   -1}, "       ;disable all interrupts"},   //  CLR1   IE, 7
-      { {0xd8, 0x4e,   -1}, "    ;disable port 3 interrupts"},   //  CLR1   P3INT, 0
-      { {0xf8, 0x4e,   -1}, "    ;enable port 3 interrupts"},    //  SET1   P3INT, 0
-      { {0xd9, 0x4e,   -1}, "    ;clear port 3 interrupt flag"}, //  CLR1   P3INT, 1
-
-      { {0x9f, 0x01,   -1}, ";branch if carry clear"}, // BN     PSW, 7, L0B6F
-      { {0x7f, 0x01,   -1}, ";branch if carry set"},   // BP     PSW, 7, L0B8D
-      { {0xdf, 0x01,   -1}, "       ;clear carry flag"},      // CLR1   PSW, 7
-      { {0xff, 0x01,   -1}, "       ;set carry flag"},        // SET1   PSW, 7
-
-      { {0xf9, 0x01,   -1}, "      ;access game ram bank"},   // SET1   PSW, 1
-      { {0xd9, 0x01,   -1}, "      ;access OS ram bank"},     // CLR1   PSW, 1
-
-      { {0x30,   -1,   -1}, "               ; B:ACC:C <- ACC:C * B"},           //  MUL
-      { {0x40,   -1,   -1}, "               ; ACC:C remainder B <- ACC:C / B"}, //  DIV
-
-      { {0x23, 0x06, 0x7f}, "     ;init stack pointer"}, //  MOV    #$7f,SP
-      { {0x21, 0x00, 0x00}, "     ;start user's game"},  //  JMPF   reset (used only in OS)
-
-      { {0x23, 0x81, 0x00}, " ;turn off File icon (if xbnk=2)"}, // MOV    #$00,SFR181
-      { {0x23, 0x82, 0x00}, " ;turn off Game icon (if xbnk=2)"}, // MOV    #$00,SFR182
-      { {0x23, 0x83, 0x00}, " ;turn off Clock icon (if xbnk=2)"},// MOV    #$00,SFR183
-      { {0x23, 0x84, 0x00}, " ;turn off Flash icon (if xbnk=2)"},// MOV    #$00,SFR184
-      { {0x23, 0x81, 0x40}, " ;turn on File icon (if xbnk=2)"},  // MOV    #$10,SFR181
-      { {0x23, 0x82, 0x10}, " ;turn on Game icon (if xbnk=2)"},  // MOV    #$40,SFR182
-      { {0x23, 0x83, 0x04}, " ;turn on Clock icon (if xbnk=2)"}, // MOV    #$04,SFR183
-      { {0x23, 0x84, 0x01}, " ;turn on Flash icon (if xbnk=2)"}, // MOV    #$01,SFR184
-      { {0xbe, 0x81,   -1}, "   ;blink File Icon (if xbnk=2)"},    // NOT1   SFR181, 6
-      { {0xbc, 0x82,   -1}, "   ;blink Game Icon (if xbnk=2)"},    // NOT1   SFR182, 4
-      { {0xba, 0x83,   -1}, "   ;blink Clock Icon (if xbnk=2)"},   // NOT1   SFR183, 2
-
-      // Timer 1:
-      { {0xd9, 0x18,   -1}, "   ;Clear Timer1 low overflow"},   // CLR1   T1CNT, 1
-      { {0xdb, 0x18,   -1}, "   ;Clear Timer1 high overflow"},  // CLR1   T1CNT, 3
-      { {0x23, 0x18, 0x00}, "  ;Stop Timer1 (sound off)"},     // MOV    #$00,T1CNT
-      { {0x23, 0x18, 0x50}, "  ;Start Timer1 low (sound on)"}, // MOV    #$50,T1CNT
-
-      // Flash
-      { {0xf9, 0x54,   -1}, ";enable FLASH write, part 1 of 3"}, // SET1   FLASHA16, 1
-      { {0xd9, 0x54,   -1}, ";enable FLASH write, part 3 of 3"}, // CLR1   FLASHA16, 1
-      { {0x23, 0x54, 0x01}, ";access saved-game area of FLASH"}, // MOV    #$01,FLASHA16  
-      { {0x23, 0x54, 0x00}, ";access VMU area of FLASH"},        // MOV    #$00,FLASHA16  
-
- 
-      // Serial I/O
-      { {0xd8, 0x44,   -1}, ";Clears the P10 latch (P10/S00)"},  // CLR1   P1, 0
-      { {0xda, 0x44,   -1}, ";Clears the P12 latch (P12/SCK0)"}, // CLR1   P1, 2
-      { {0xdb, 0x44,   -1}, ";Clears the P13 latch (P13/S01)"},  // CLR1   P1, 3
-
-      { {0x23, 0x31, 0x00}, ";Clear the serial tx buffer"},      // MOV    #$00,SBUF0
-      { {0x23, 0x35, 0x00}, ";Clear the serial rx buffer"},      // MOV    #$00,SBUF1
-      { {0xfb, 0x30,   -1}, ";Start sending character"},         // SET1   SCON0, 3  
-      { {0xd9, 0x34,   -1}, ";Resets the transfer end flag (rx)"}, // CLR1   SCON1, 1
-      { {0xfb, 0x34,   -1}, ";Starts transfer (rx)"},              // SET1   SCON1, 3
- 
-      { {0x99, 0x30,   -1}, ";If data is done transmitting, branch"}, // BN     SCON0, 1, Lxxxx
-
-      { {-1, -1, -1},      "EOL"}        // ---End of list---
-   };
-
-
-
 typedef struct {int entry; int exit;} firmwarecall_type;
 
-// List describing entry and exit points for built-in firmware:
-// The entry point is the code executed after the instruction that modifies
-// the EXT register (typically NOT1 EXT,0); the exit point is where execution
-// resumes.
-firmwarecall_type FIRMWARECALL[] =
-   {  { 0x102, 0x105},  // writeFlash
-      { 0x10a, 0x10b},  // writeFlash2
-      { 0x112, 0x115},  // verifyFlash
-      { 0x122, 0x125},  // readFlash
-      { 0x136, 0x139},  // t1link
-      { 0x142, 0x145},  // bios sleep routine
-      { 0x1f2,    -1},  // exit vector; doesn't return
-// not included     mapmem (0x108); // unknown
-//     mapmem (0x140); // unknown
-      {   -1,     -1}   // end of list
-   };
\ No newline at end of file
+#define MAP_SLACK        0x100  // readable bytes past the end of the image and its maps
+#define SEEN_BYTES       (3 * 0x10000/8)  // ctx->seen: a bitmap for each of BNK_BANK0/1/UNKNOWN
+
+// output.c: buffered output to a file descriptor or memory
+typedef struct
+{
+   char * buf;
+   int    len;                 // bytes waiting in buf
+   int    size;                // room in buf
+   int    fd;                  // where it's flushed to; -1=stays in memory
+   int    error;               // a write failed
+   int    keep;                // out_keep: kept output starts here in buf; -1=not keeping
+   int    flushed;             //    and this much of buf has been written
+   double written;             // bytes written to fd since out_open
+} out_type;
+
+int  out_open (out_type * o, int fd);
+int  out_open_mem (out_type * o);
+void out_flush (out_type * o);
+void out_set_fd (out_type * o, int fd);
+void out_close (out_type * o);
+void out_keep (out_type * o);
+void out_release (out_type * o);
+double out_tell (out_type * o);
+void out_char (out_type * o, int c);
+void out_mem (out_type * o, const char * s, int n);
+void out_str (out_type * o, const char * s);
+void out_pad (out_type * o, const char * s, int width);
+void out_hex (out_type * o, unsigned int v, int digits);
+void out_HEX (out_type * o, unsigned int v, int digits);
+void out_dec (out_type * o, int v);
+void out_printf (out_type * o, const char * format, ...)
+#ifdef __GNUC__
+     __attribute__ ((format (printf, 2, 3)))
+#endif
+     ;
+
+// how a vein on the trace stack was entered, i.e. what the vein below it
+// does with its result (trace_type.kind):
+#define VEIN_ROOT        0  // entry point passed to mapmem
+#define VEIN_CALL        1  // call target; caller carries on afterwards
+#define VEIN_BRANCH      2  // conditional branch target; ditto
+#define VEIN_JUMP        3  // jump target; the jumper's result is this one's
+
+#define VEIN_PUSHED     -1  // trace_vein: started a new vein, come back later
+
+// where a vein's rambank came from, within its function (trace_type.origin)
+#define ORIG_ENTRY       0  // as it was when the function was called
+#define ORIG_SET         1  // set in the function (SET1/CLR1 PSW,1, or a call that does)
+#define ORIG_STACK       2  // POP PSW with no PUSH PSW before it in the function
+#define ORIG_UNKNOWN     3
+
+// what calling a function does to the bank (ctx->effect, by entry address),
+// from the ways its RETs were reached
+#define EFFECT_NONE      0  // no RET seen: taken as EFFECT_KEEP
+#define EFFECT_KEEP      1  // as it was before the call
+#define EFFECT_BANK0     2  // always returns with bank 0
+#define EFFECT_BANK1     3  //    or bank 1
+#define EFFECT_STACK     4  // pops the PSW the caller pushed
+#define EFFECT_UNKNOWN   5  // returns more than one of the above ways
+#define EFFECT_DONE   0x80  // traced all the way; until then calls take EFFECT_KEEP
+
+#define PSW_DEPTH        4  // PUSH PSWs a vein keeps track of
+
+// One vein of code being traced by mapmem.
+typedef struct
+{
+   int    pin_in;              // where the vein starts (gets the label)
+   int    pin;                 // instruction being traced
+   int    rambank;             // BNK_xxx at pin
+   int    kind;                // VEIN_xxx
+   int    resume;              // 1=pin is a call/branch whose target is done
+   int    again;               // 1=pin was traced before, with another bank
+   int    quiet;               // 1=got to pin from code traced before: its warnings are out
+   int    entered;             // 1=traced an instruction (didn't stop where it started)
+   int    func;                // entry point of the function the vein is part of
+   int    origin;              // ORIG_xxx of rambank
+   unsigned char psw[PSW_DEPTH]; // rambank|origin<<4 saved by PUSH PSW, innermost last
+   int    npsw;
+} trace_type;
+
+// stats.c: where the time goes, for --stats. The counters and timers are
+// only compiled in with -DLCDIS_STATS (the Makefile's default); without it
+// the STAT_xxx macros are empty and --stats just says so.
+typedef struct
+{
+   int    pin;
+   double seconds;
+} stats_entry_type;
+
+typedef struct
+{
+   double load;                // seconds in lcdis_load,
+   double trace;               //    tracing (every mapmem call),
+   double tables;              //    jump_map and ldc_map (jump_map's tracing is in trace too),
+   double text;                //    search_text
+   double output;              //    and lcdis_listing
+   stats_entry_type * entries; // each entry point traced, in order
+   int    nentries;
+   int    entryroom;
+   long   insns;               // instructions traced
+   int    depth;               // trace stack high-water mark
+   long   badveins;            // veins that ended in invalid code
+   long   misaligned;          // misaligned-code warnings
+   long   summaries;           // calls answered from ctx->effect instead of traced
+   long   labels;              // label lookups
+   long   comments;            // CODECMTS matches
+   double outbytes;            // listing bytes
+} stats_type;
+
+#define STATS_TEXT       1  // stats_print: readable
+#define STATS_JSON       2  //    or one JSON object
+
+// An entry point waiting for trace_entries.
+typedef struct
+{
+   int    pin;
+   int    rambank;
+   char   header[80];          // printed just before the trace's warnings
+} entry_type;
+
+#ifdef LCDIS_STATS
+#define STAT_ADD(ctx, field, n)   ((ctx)->stats.field += (n))
+#define STAT_MAX(ctx, field, v)   do { if ((v) > (ctx)->stats.field) (ctx)->stats.field = (v); } while (0)
+#define STAT_START(t)             double t = stats_now ()
+#define STAT_TIME(ctx, field, t)  ((ctx)->stats.field += stats_now () - (t))
+#define STAT_CLOCK(var, t)        ((var) += stats_now () - (t))
+#define STAT_ENTRY(ctx, pin, sec) stats_entry (ctx, pin, sec)
+#else
+#define STAT_ADD(ctx, field, n)   ((void) 0)
+#define STAT_MAX(ctx, field, v)   ((void) 0)
+#define STAT_START(t)
+#define STAT_TIME(ctx, field, t)  ((void) 0)
+#define STAT_CLOCK(var, t)        ((void) 0)
+#define STAT_ENTRY(ctx, pin, sec) ((void) 0)
+#endif
+
+// xref.c: who refers to each code and data address
+#define XREF_CALL        0  // CALL, CALLF, CALLR
+#define XREF_JUMP        1  // JMP, JMPF, BR, BRF
+#define XREF_BRANCH      2  // conditional branches, DBNZ
+#define XREF_READ        3  // d9 operand
+#define XREF_WRITE       4  // d9 operand that is stored to (decode_type.writes)
+
+typedef struct
+{
+   unsigned short from;        // address of the referring instruction
+   unsigned char  kind;        // XREF_xxx
+   unsigned char  bnk;         // BNK_xxx it runs with
+} xref_ref_type;
+
+typedef struct xref_s xref_type;
+typedef struct annot_s annot_type;      // annot.c
+
+// cfg.c: basic blocks, edges and functions, in flat arrays
+#define CFG_FALLTHROUGH  0  // on to the next block (or back from a call)
+#define CFG_BRANCH       1  // jump or taken branch
+#define CFG_CALL         2  // call to a function's entry block
+#define CFG_RETURN       3  // RET/RETI block to a block after a call to its function
+
+typedef struct
+{
+   int    start, end;          // instructions in [start,end)
+   int    last;                // address of the last one
+   int    ninsns;
+   int    func;                // cfg_type.funcs index, -1=none reaches it
+   int    succ, nsucc;         // edges out: cfg_type.edges[succ..succ+nsucc-1]
+   int    pred, npred;         // edges in:  cfg_type.edges[preds[pred..pred+npred-1]]
+   unsigned char exit;         // FLOW_xxx of the last instruction
+   unsigned char bnk;          // BNK_xxx at the start
+} cfg_block_type;
+
+typedef struct
+{
+   int    from, to;            // block indices
+   int    kind;                // CFG_xxx
+} cfg_edge_type;
+
+typedef struct
+{
+   int    entry;               // address
+   int    block;               // entry block
+   int    first, count;        // its blocks: cfg_type.func_blocks[first..first+count-1]
+} cfg_func_type;
+
+typedef struct
+{
+   cfg_block_type * blocks;    // in address order
+   int    nblocks;
+   cfg_edge_type * edges;      // grouped by from block
+   int    nedges;
+   int *  preds;               // edges indices grouped by to block
+   cfg_func_type * funcs;      // in address order
+   int    nfuncs;
+   int *  func_blocks;         // block indices, grouped by function
+   int *  block_at;            // block index by address (memsize entries), -1=not code
+} cfg_type;
+
+// ldc.c: TRH, TRL and ACC at an LDC, as far as they're known (-1=unknown)
+typedef struct
+{
+   int    pin;
+   int    trl, trh, acc;
+} ldc_type;
+
+// One disassembly. All state that used to be global lives here.
+typedef struct
+{
+   unsigned char * mem;        // the image (first 64K), read-only; zeros for MAP_SLACK after it
+   size_t memmaplen;           // mmap'ed length of mem; 0=it's malloc'ed
+   unsigned char * mem_use;    // memory usage: MEM_xxx    } mapsize bytes; past that,
+   unsigned char * mem_bnk;    // ram bank the code runs with: BNK_xxx } use get_use
+   int    memsize;             // bytes loaded from the file
+   int    mapsize;             // memsize+MAP_SLACK once loaded, else 0
+   int    maproom;             // bytes allocated for mem_use and mem_bnk
+   unsigned char * outside;    // bitmap: addresses past the maps marked MEM_INVALID
+   unsigned char * seen;       // bitmaps: instructions traced with each bank (get_seen)
+   unsigned char * effect;     // EFFECT_xxx of calling each address $0000-$FFFF
+   unsigned char * hibank;     // file bytes $10000-$1FFFF (a 128K flash dump), read-only
+   size_t himaplen;            // mmap'ed length of hibank; 0=it's malloc'ed
+   int    hisize;              // bytes in hibank
+
+   int    strictmode;          // strict mode that stops at first sign of memmap going amok.
+   int    asmout;              // for compiler-compatible output.
+   int    biosmode;            // for disassembling bios
+   int    flashmode;           // FLASH: list hibank, note LDF/STF addresses (flash.c)
+   int    xrefmode;            // XREF: list references at labels (xref.c)
+   xref_type * xref;           // the index, once xref_build has made it
+   annot_type * annot;         // annotation file (annot_load), or NULL
+   cfg_type * cfg;             // the control-flow graph, once cfg_build has made it
+   ldc_type * ldc;             // every LDC in address order, once ldc_build has
+   int    nldc;                //    looked (ldcready)
+   int    ldcready;
+   int    flash_a16;           // FLASHA16 bit 0, TRL and TRH as far as the listing
+   int    flash_trl;           //    can tell (-1=unknown), good for the instruction
+   int    flash_trh;           //    at flash_next
+   int    flash_next;
+
+   trace_type * trace;         // mapmem trace stack, also printed with warnings
+   int    level;               // veins on the trace stack
+   int    tracesize;           // room on the trace stack (grows as needed)
+
+   entry_type * entries;       // entry points queued for tracing
+   int    nentries;
+   int    entryroom;
+
+   int    keepgoing;           // batch.c: don't exit on fatal errors,
+   int    gaveup;              //    just set this and stop tracing instead
+
+   out_type out;               // where the listing goes (stdout by default)
+   int    stream;              // --stream: write each region of the listing out as it's done
+   double * lineat;            // if set (memsize+1 entries, by the caller), lcdis_listing
+                               //    puts out_tell at each line's address there, -1 elsewhere
+   stats_type stats;           // --stats (stats.c)
+} lcdis_type;
+
+
+lcdis_type * lcdis_new (void);
+void lcdis_free (lcdis_type * ctx);
+void lcdis_reset (lcdis_type * ctx);
+void lcdis_banner (lcdis_type * ctx);
+int  lcdis_load (lcdis_type * ctx, char * filename);
+int  lcdis_load_mem (lcdis_type * ctx, char * name, const unsigned char * data, int len);
+int  lcdis_option (lcdis_type * ctx, char * arg);
+void lcdis_map (lcdis_type * ctx);
+void lcdis_trace (lcdis_type * ctx);
+void lcdis_map_tables (lcdis_type * ctx);
+void lcdis_map_text (lcdis_type * ctx);
+void lcdis_listing (lcdis_type * ctx);
+
+// batch.c: disassemble many images on a pool of threads
+typedef struct
+{
+   int    images;              // inputs found
+   int    unreadable;          // inputs that couldn't be opened
+   int    unwritable;          // listings that couldn't be created
+   int    failed;              // images that hit a fatal error (listing cut short)
+   double bytes;               // image bytes disassembled
+   double seconds;             // wall time
+} batch_result_type;
+
+int  lcdis_batch (char * source, char * outdir, char ** options, int noptions,
+                  int jobs, int exports, int stats, batch_result_type * result);
+
+// trace.c: tracing queued entry points, several at a time
+void queue_entry (lcdis_type * ctx, int pin, int rambank, char * header);
+void trace_entries (lcdis_type * ctx);
+
+// flash.c: FLASH mode
+void flash_reset (lcdis_type * ctx);
+void flash_note (lcdis_type * ctx, int pin);
+void flash_listing (lcdis_type * ctx);
+
+// export.c: the analysis as newline-delimited JSON or as fixed binary records
+#define EXPORT_JSON      1
+#define EXPORT_BINARY    2
+
+// Binary export (EXPORT_BINARY), laid out to be mmap'ed and used in place:
+// an export_header_type, then the four record arrays and the string table
+// at the offsets it gives. Everything is little-endian and 4-byte aligned;
+// strings are offsets into the string table, NUL-terminated.
+#define EXPORT_MAGIC     "LCDX"
+#define EXPORT_VERSION   2
+#define EXPORT_NONE      0xFFFFFFFFu   // no target / no label
+
+// region kinds (export_region_type.kind)
+#define REGION_CODE      0
+#define REGION_DATA      1
+#define REGION_GRAPHICS  2
+#define REGION_FONT      3
+#define REGION_TEXT      4
+#define REGION_ICON      5
+#define REGION_UNUSED    6
+
+typedef struct { uint32_t offset, count; } export_table_type;
+
+typedef struct
+{
+   char     magic[4];          // EXPORT_MAGIC
+   uint32_t version;           // EXPORT_VERSION
+   uint32_t memsize;           // image bytes (first 64K)
+   uint32_t hisize;            // flash bank 1 bytes
+   export_table_type insns;    // export_insn_type
+   export_table_type regions;  // export_region_type
+   export_table_type labels;   // export_label_type
+   export_table_type banks;    // export_bank_type
+   export_table_type strings;  // the string table (count is in bytes)
+   export_table_type blocks;   // export_block_type   } the control-flow
+   export_table_type edges;    // export_edge_type    } graph (cfg.c)
+   export_table_type funcs;    // export_func_type    }
+} export_header_type;
+
+typedef struct
+{
+   uint32_t addr;
+   uint32_t target;            // where it can branch to, or EXPORT_NONE
+   uint32_t mnemonic;          // string: "MOV"
+   uint32_t operands;          // string: "#$00,ACC"
+   uint32_t label;             // string: its label, or EXPORT_NONE
+   uint8_t  bytes[3];          // len bytes used
+   uint8_t  len;
+   uint8_t  use;               // MEM_xxx
+   uint8_t  bnk;               // BNK_xxx
+   uint8_t  flow;              // FLOW_xxx
+   uint8_t  pad;
+} export_insn_type;
+
+typedef struct { uint32_t start, end, kind; } export_region_type;      // [start,end), REGION_xxx
+typedef struct { uint32_t addr, name; } export_label_type;             // name: string
+typedef struct { uint32_t start, end, bnk; } export_bank_type;         // code in [start,end) runs with BNK_xxx
+
+typedef struct
+{
+   uint32_t start, end;        // instructions in [start,end)
+   uint32_t func;              // export_func_type index, or EXPORT_NONE
+   uint32_t succ, nsucc;       // its edges: edges[succ..succ+nsucc-1]
+   uint8_t  exit;              // FLOW_xxx of the last instruction
+   uint8_t  bnk;               // BNK_xxx
+   uint8_t  pad[2];
+} export_block_type;
+
+typedef struct { uint32_t from, to, kind; } export_edge_type;          // block indices, CFG_xxx
+typedef struct { uint32_t entry, block, nblocks; } export_func_type;   // entry address and block
+
+int  lcdis_export (lcdis_type * ctx, int fd, int format);
+
+// server.c: answering questions about images kept in memory, over a Unix socket
+#define SERVE_IMAGE_MAX  0x20000   // a whole 128K flash dump
+int  lcdis_serve (char * path, int images);
+int  lcdis_connect (char * path);
+int  lcdis_ask (int fd, const char * request, const unsigned char * data, int len, out_type * reply);
+
+// annot.c: labels, comments and directives from an annotation file.
+// Compiled, the file is laid out to be mmap'ed and used in place, like the
+// binary export: an annot_header_type, then the records (sorted by address,
+// then kind, then file order), the directives (string offsets, in file
+// order) and the string table.
+#define ANNOT_MAGIC      "LCDA"
+#define ANNOT_VERSION    1
+#define ANNOT_LABEL      0
+#define ANNOT_COMMENT    1
+
+typedef struct
+{
+   char     magic[4];          // ANNOT_MAGIC
+   uint32_t version;           // ANNOT_VERSION
+   export_table_type records;  // annot_record_type
+   export_table_type directives; // uint32_t: string
+   export_table_type strings;  // the string table (count is in bytes)
+} annot_header_type;
+
+typedef struct { uint32_t addr, kind, text; } annot_record_type;       // ANNOT_xxx; text: string
+
+int  annot_load (lcdis_type * ctx, char * filename);
+int  annot_save (lcdis_type * ctx, char * filename);
+void annot_free (lcdis_type * ctx);
+int  annot_directives (lcdis_type * ctx, char *** list);
+char * annot_label (lcdis_type * ctx, int addr);
+int  annot_next (lcdis_type * ctx, int addr);
+void annot_comments (lcdis_type * ctx, int pin, int end);
+
+// cache.c: lcdis_map's results kept on disk between runs
+#define CACHE_HASH_START 0xcbf29ce484222325ull
+int  lcdis_map_cached (lcdis_type * ctx, char * cachedir, char ** options, int noptions);
+uint64_t cache_hash (uint64_t h, const unsigned char * p, size_t n);
+
+// stats.c
+double stats_now (void);
+void stats_reset (lcdis_type * ctx);
+void stats_entry (lcdis_type * ctx, int pin, double seconds);
+void stats_print (lcdis_type * ctx, int fd, char * name, int format);
+
+// xref.c
+int  xref_build (lcdis_type * ctx);
+void xref_free (lcdis_type * ctx);
+int  xref_code (lcdis_type * ctx, int addr, xref_ref_type ** refs);
+int  xref_data (lcdis_type * ctx, int addr, int bnk, xref_ref_type ** refs);
+void xref_print (lcdis_type * ctx, int pin);
+
+// diff.c: which functions changed between two images (both mapped)
+int  lcdis_diff (lcdis_type * a, lcdis_type * b, out_type * o);
+
+// cfg.c
+int  cfg_build (lcdis_type * ctx);
+void cfg_free (lcdis_type * ctx);
+int  cfg_block_at (lcdis_type * ctx, int addr);
+
+// jump.c: computed jumps
+void jump_map (lcdis_type * ctx);
+
+// ldc.c: LDC tables
+int  ldc_build (lcdis_type * ctx);
+void ldc_free (lcdis_type * ctx);
+void ldc_map (lcdis_type * ctx);
+void ldc_note (lcdis_type * ctx, int pin);
+
+// image.c: mapping the image file
+int  image_open (lcdis_type * ctx, char * filename);
+int  image_open_mem (lcdis_type * ctx, const unsigned char * data, int len);
+void image_close (lcdis_type * ctx);
+
+int  get_use (lcdis_type * ctx, int pin);
+void set_use (lcdis_type * ctx, int pin, int use);
+int  get_seen (lcdis_type * ctx, int pin);
+void set_seen (lcdis_type * ctx, int pin, int seen);
+int  mapmem (lcdis_type * ctx, int pin_in, int rambank);
+void dis (lcdis_type * ctx, int pin, int * b1);
+void dis_data (lcdis_type * ctx, int pin, int * b1);
+void dis_code (lcdis_type * ctx, int pin, int * b1);
+void print_operands (lcdis_type * ctx, int pin);
+int  next_line (lcdis_type * ctx, int pin);
+int  is_icon (lcdis_type * ctx, int pin);
+int  opcode_len (int opcode);
+char * get_opcode_model (int opcode);
+void init_decode (void);
+void init_symbols (void);
+int  get_target (lcdis_type * ctx, int pin);
+int get_a12(lcdis_type * ctx, int pin);
+int get_r16(lcdis_type * ctx, int pin);
+int get_a16(lcdis_type * ctx, int pin);
+int get_r8(lcdis_type * ctx, int pin);
+int get_d9(lcdis_type * ctx, int pin);
+int get_d9bit(lcdis_type * ctx, int pin);
+int get_reg(lcdis_type * ctx, int pin);
+void print_data_label (lcdis_type * ctx, int addr, int rambank);
+void print_code_label (lcdis_type * ctx, int addr, int formatted);
+char * find_label (int addr);
+void search_text (lcdis_type * ctx);
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, benchmark
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Times the four phases of a disassembly separately, for each image:
+ *
+ *    mapmem   tracing the code from the entry points (lcdis_trace)
+ *    tables   jump tables and LDC tables (lcdis_map_tables)
+ *    text     search_text over what's left (lcdis_map_text)
+ *    dis      writing the listing (lcdis_listing)
+ *
+ * The listing goes to memory, not to a file, so "dis" is the formatting
+ * and not the disk. Each image is run several times and the fastest run
+ * of each phase is kept. Reported per phase: ns per instruction (code
+ * lines in the listing) and MB/s of image.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "lcdis.h"
+
+#define PHASES  4
+
+static const char * phase_name[PHASES] = { "mapmem", "tables", "text", "dis" };
+
+typedef struct
+{
+   double best[PHASES];        // fastest run of each phase, seconds
+   double bytes;               // image bytes
+   double outbytes;            // listing bytes
+   int    insns;               // instructions listed
+} bench_type;
+
+
+static double now (void)
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// is this a file name we benchmark when given a directory? (.vms and .bin)
+static int image_name (char * name)
+{
+   char * ext;
+
+   ext = strrchr (name, '.');
+   if (ext == NULL)
+      return 0;
+   return (   (tolower(ext[1])=='v' && tolower(ext[2])=='m' && tolower(ext[3])=='s' && ext[4]==0)
+           || (tolower(ext[1])=='b' && tolower(ext[2])=='i' && tolower(ext[3])=='n' && ext[4]==0));
+}
+
+
+// instructions in the listing: the lines the walk in lcdis_listing disassembles
+static int count_insns (lcdis_type * ctx)
+{
+   int pin, n=0;
+
+   for (pin=0; (pin>=0) && (pin<ctx->memsize); pin=next_line (ctx, pin))
+      switch (ctx->mem_use[pin])
+      {
+         case MEM_CODE:
+         case MEM_CODE_LABELED:
+         case MEM_INVALID:
+            n++;
+      }
+   return n;
+}
+
+
+// Returns: 0=ok
+//          1=couldn't load it or it hit a fatal error
+
+static int bench_one (lcdis_type * ctx, char * filename, char ** options, int noptions,
+                      int runs, bench_type * b)
+{
+   double t[PHASES+1];
+   int run, i;
+
+   for (i=0; i<PHASES; i++)
+      b->best[i] = 1e30;
+
+   for (run=0; run<runs; run++)
+   {
+      lcdis_reset (ctx);
+      ctx->out.len = 0;
+      if (lcdis_load (ctx, filename))
+         return 1;
+      if (ctx->hisize)
+         lcdis_option (ctx, "FLASH");
+      for (i=0; i<noptions; i++)
+         lcdis_option (ctx, options[i]);
+
+      t[0] = now ();
+      lcdis_trace (ctx);
+      t[1] = now ();
+      if (ctx->gaveup)
+         return 1;
+      lcdis_map_tables (ctx);
+      t[2] = now ();
+      lcdis_map_text (ctx);
+      t[3] = now ();
+      ctx->out.len = 0;         // only the listing itself is counted
+      lcdis_listing (ctx);
+      t[4] = now ();
+
+      for (i=0; i<PHASES; i++)
+         if (t[i+1] - t[i] < b->best[i])
+            b->best[i] = t[i+1] - t[i];
+   }
+   b->bytes    = ctx->memsize + ctx->hisize;
+   b->outbytes = ctx->out.len;
+   b->insns    = count_insns (ctx);
+   ctx->out.len = 0;
+   return 0;
+}
+
+
+static void report (char * name, bench_type * b)
+{
+   int i;
+
+   printf ("%-28s %7.0f bytes %6d insns %8.0f bytes out\n", name, b->bytes, b->insns, b->outbytes);
+   for (i=0; i<PHASES; i++)
+      printf ("   %-8s %10.3f ms %10.1f ns/insn %10.1f MB/s\n", phase_name[i],
+              b->best[i] * 1e3,
+              b->insns ? b->best[i] * 1e9 / b->insns : 0.0,
+              b->best[i] > 0 ? b->bytes / b->best[i] / 1e6 : 0.0);
+}
+
+
+static void add (bench_type * total, bench_type * b)
+{
+   int i;
+
+   for (i=0; i<PHASES; i++)
+      total->best[i] += b->best[i];
+   total->bytes    += b->bytes;
+   total->outbytes += b->outbytes;
+   total->insns    += b->insns;
+}
+
+
+static int run_file (lcdis_type * ctx, char * path, char ** options, int noptions,
+                     int runs, bench_type * total)
+{
+   bench_type b;
+
+   if (bench_one (ctx, path, options, noptions, runs, &b))
+   {  fprintf (stderr, "lcdisbench: %s: can not load or trace it\n", path);
+      return 1;
+   }
+   report (path, &b);
+   add (total, &b);
+   return 0;
+}
+
+
+int main (int argc, char * argv[])
+{
+   lcdis_type * ctx;
+   bench_type total;
+   struct stat st;
+   DIR * dir;
+   struct dirent * de;
+   char path[4096];
+   char ** options;
+   int noptions=0;
+   int runs=5;
+   int failed=0;
+   int i;
+
+   if (argc < 2)
+   {  printf ("lcdisbench [--runs n] (file | directory) ... {[options] ...}\n"
+              "  times mapmem, the jump/LDC tables, search_text and the listing for\n"
+              "  each .vms/.bin image, keeping the fastest of n runs (default 5)\n");
+      return 1;
+   }
+
+   if ((ctx = lcdis_new()) == NULL)
+   {  printf ("FATAL: out of memory\n");
+      return 1;
+   }
+   out_set_fd (&ctx->out, -1);   // everything stays in memory
+   ctx->keepgoing = 1;           // a fatal error gives up on that image only
+
+   options = (char **) malloc (argc * sizeof (char *));
+   for (i=1; i<argc; i++)
+      if ((strcmp(argv[i], "--runs")==0) && (i+1 < argc))
+         runs = atoi (argv[++i]);
+      else
+      if (stat (argv[i], &st) != 0)
+         options[noptions++] = argv[i];
+   if (runs < 1)
+      runs = 1;
+
+   memset (&total, 0, sizeof (total));
+   for (i=1; i<argc; i++)
+   {
+      if (strcmp(argv[i], "--runs")==0)
+      {  i++;
+         continue;
+      }
+      if (stat (argv[i], &st) != 0)
+         continue;
+      if (!S_ISDIR (st.st_mode))
+      {  failed |= run_file (ctx, argv[i], options, noptions, runs, &total);
+         continue;
+      }
+      if ((dir = opendir (argv[i])) == NULL)
+      {  fprintf (stderr, "lcdisbench: can not read %s\n", argv[i]);
+         failed = 1;
+         continue;
+      }
+      while ((de = readdir (dir)) != NULL)
+      {
+         if (!image_name (de->d_name))
+            continue;
+         snprintf (path, sizeof (path), "%s/%s", argv[i], de->d_name);
+         if (stat (path, &st) == 0 && S_ISREG (st.st_mode))
+            failed |= run_file (ctx, path, options, noptions, runs, &total);
+      }
+      closedir (dir);
+   }
+   report ("total", &total);
+
+   free (options);
+   lcdis_free (ctx);
+   return failed;
+}
@@ -0,0 +1,474 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, LDC tables
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * LDC loads ACC from code memory at TRH:TRL+ACC, which is how games read
+ * their lookup tables. A forward pass over the control-flow graph (cfg.c)
+ * follows the constants put in ACC, B, C, TRL and TRH (MOV #i8, ST from a
+ * known ACC, INC, SET1, ...). Where paths join, a register keeps its value
+ * only if every way in agrees. A call hands the caller's values to the
+ * function, and what the function has at its RETs comes back after it.
+ *
+ * Each LDC whose TRH:TRL comes out known is noted in the listing
+ * ("      ;table $1a2b", with "+$05" if ACC is known too), and ldc_map marks
+ * the table as MEM_DATA: up to the highest known index, or with an unknown
+ * index up to 256 bytes, stopping at anything already mapped (code, text,
+ * GRAPHBYTES, ...) and at the next table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lcdis.h"
+
+#define OP_LDC        0xC1
+
+#define REG_ACC       0
+#define REG_B         1
+#define REG_C         2
+#define REG_TRL       3
+#define REG_TRH       4
+#define NREGS         5
+
+#define VAL_UNKNOWN  -1
+#define VAL_NONE     -2        // no path has got here (yet)
+
+typedef struct
+{
+   short  r[NREGS];            // 0-255, or VAL_xxx
+} regs_type;
+
+// a table: LDCs with the same TRH:TRL, up to the furthest index read
+typedef struct
+{
+   int    base;
+   int    end;                 // one past the last byte
+   int    pin;                 // first LDC that reads it
+} table_type;
+
+
+static void set_all (regs_type * s, int v)
+{
+   int i;
+
+   for (i=0; i<NREGS; i++)
+      s->r[i] = v;
+}
+
+
+// which register is at d9 address addr, or -1
+static int reg_at (int addr)
+{
+   switch (addr)
+   {
+      case 0x100:  return REG_ACC;
+      case 0x102:  return REG_B;
+      case 0x103:  return REG_C;
+      case 0x104:  return REG_TRL;
+      case 0x105:  return REG_TRH;
+   }
+   return -1;
+}
+
+
+// ACC after an ALU instruction with an immediate (the ones that don't
+// need the carry)
+static int alu (int opcode, int acc, int i8)
+{
+   if (acc < 0)
+      return VAL_UNKNOWN;
+   switch (opcode)
+   {
+      case 0x81:  return (acc + i8) & 0xFF;       // ADD #i8
+      case 0xA1:  return (acc - i8) & 0xFF;       // SUB #i8
+      case 0xD1:  return acc | i8;                // OR  #i8
+      case 0xE1:  return acc & i8;                // AND #i8
+      case 0xF1:  return acc ^ i8;                // XOR #i8
+   }
+   return VAL_UNKNOWN;                            // ADDC, SUBC
+}
+
+
+// What the instruction at pin does to the registers.
+
+static void step (lcdis_type * ctx, int pin, regs_type * s)
+{
+   unsigned char * m = &ctx->mem[pin];
+   decode_type * d = &decode[m[0]];
+   int acc = s->r[REG_ACC];
+   int r, v;
+
+   if ((m[0] == 0xB8) && (m[1] == 0x0D))          // NOT1 EXT,0: off to the firmware
+   {  set_all (s, VAL_UNKNOWN);
+      return;
+   }
+
+   switch (m[0])
+   {
+      case 0x02: case 0x03:                       // LD d9
+         r = reg_at (get_d9 (ctx, pin));
+         s->r[REG_ACC] = (r >= 0) ? s->r[r] : VAL_UNKNOWN;
+         return;
+
+      case 0x30: case 0x40:                       // MUL, DIV
+         s->r[REG_ACC] = s->r[REG_B] = s->r[REG_C] = VAL_UNKNOWN;
+         return;
+
+      case 0x81: case 0x91: case 0xA1: case 0xB1:
+      case 0xD1: case 0xE1: case 0xF1:            // ADD..XOR #i8
+         s->r[REG_ACC] = alu (m[0], acc, m[1]);
+         return;
+
+      case 0xC2: case 0xC3:                       // XCH d9
+         r = reg_at (get_d9 (ctx, pin));
+         if (r >= 0)
+         {  s->r[REG_ACC] = s->r[r];
+            s->r[r] = acc;
+         }
+         else
+            s->r[REG_ACC] = VAL_UNKNOWN;
+         return;
+
+      case 0xC4: case 0xC5: case 0xC6: case 0xC7: // XCH @Ri
+         if (get_reg (ctx, pin) >= 2)
+            set_all (s, VAL_UNKNOWN);
+         s->r[REG_ACC] = VAL_UNKNOWN;
+         return;
+   }
+
+   if (d->writes)
+   {
+      switch (d->operand)
+      {
+         case '9':   // d9
+         case '^':   // #i8,d9
+         case 'x':   // d9,r8 (DBNZ)
+            r = reg_at (get_d9 (ctx, pin));
+            break;
+         case 'b':   // d9,b3
+            r = reg_at (get_d9bit (ctx, pin));
+            break;
+         default:    // @Ri: R2 and R3 point at the SFRs
+            if (get_reg (ctx, pin) >= 2)
+               set_all (s, VAL_UNKNOWN);
+            return;
+      }
+      if (r < 0)
+         return;
+      v = s->r[r];
+      switch (m[0] & 0xF0)
+      {
+         case 0x10:  v = acc;                                break;   // ST
+         case 0x20:  v = m[2];                               break;   // MOV #i8,d9
+         case 0x60:  v = (v >= 0) ? (v + 1) & 0xFF : v;      break;   // INC
+         case 0x70:  v = (m[0] == 0x72 || m[0] == 0x73)
+                         ? ((v >= 0) ? (v - 1) & 0xFF : v)            // DEC
+                         : VAL_UNKNOWN;                      break;   // POP
+         case 0xA0: case 0xB0:
+         case 0xC0: case 0xD0:
+         case 0xE0: case 0xF0:
+            if (v >= 0)                                               // like flash_bit
+               switch (m[0] & 0xE8)
+               {
+                  case 0xE8:  v |=  (1 << (m[0] & 7));  break;        // SET1
+                  case 0xC8:  v &= ~(1 << (m[0] & 7));  break;        // CLR1
+                  case 0xA8:  v ^=  (1 << (m[0] & 7));  break;        // NOT1
+               }
+            break;
+         default:    v = VAL_UNKNOWN;                                 // DBNZ
+      }
+      s->r[r] = v;
+      return;
+   }
+
+   // anything else that leaves something new in ACC
+   switch (m[0] & 0x0F)
+   {
+      case 0x00:
+         if ((m[0] >= 0xC0) || (m[0] == 0x50))    // ROR, RORC, ROL, ROLC, LDF
+            s->r[REG_ACC] = VAL_UNKNOWN;
+         break;
+      case 0x01:
+         if (m[0] == OP_LDC)                      // LDC
+            s->r[REG_ACC] = VAL_UNKNOWN;
+         break;
+      case 0x04: case 0x05: case 0x06: case 0x07:
+         if (m[0] < 0x10)                         // LD @Ri
+         {  s->r[REG_ACC] = VAL_UNKNOWN;
+            break;
+         }
+         // fall through
+      case 0x02: case 0x03:
+         if (m[0] >= 0x80)                        // ADD..XOR d9/@Ri
+            s->r[REG_ACC] = VAL_UNKNOWN;
+         break;
+   }
+}
+
+
+// Merges from into to.
+//
+// Returns: 1=to changed
+
+static int merge (regs_type * to, regs_type * from)
+{
+   int i, changed=0;
+
+   for (i=0; i<NREGS; i++)
+      if (to->r[i] != from->r[i])
+      {  if (to->r[i] == VAL_NONE)
+            to->r[i] = from->r[i];
+         else
+         if (to->r[i] == VAL_UNKNOWN)
+            continue;
+         else
+            to->r[i] = VAL_UNKNOWN;
+         changed = 1;
+      }
+   return changed;
+}
+
+
+// Does block k end with a call the graph follows (so what comes back is
+// carried by the return edges)?
+
+static int calls_function (cfg_type * g, int k)
+{
+   int i;
+
+   for (i=0; i<g->blocks[k].nsucc; i++)
+      if (g->edges[g->blocks[k].succ + i].kind == CFG_CALL)
+         return 1;
+   return 0;
+}
+
+
+static int add_ldc (lcdis_type * ctx, int pin, regs_type * s, int * room)
+{
+   ldc_type * p;
+
+   if (ctx->nldc == *room)
+   {  p = (ldc_type *) realloc (ctx->ldc, (*room ? *room * 2 : 64) * sizeof (ldc_type));
+      if (p == NULL)
+         return 1;
+      ctx->ldc = p;
+      *room = *room ? *room * 2 : 64;
+   }
+   p = &ctx->ldc[ctx->nldc++];
+   p->pin = pin;
+   p->trl = s->r[REG_TRL];
+   p->trh = s->r[REG_TRH];
+   p->acc = s->r[REG_ACC];
+   return 0;
+}
+
+
+// Finds the registers at every LDC (ctx->ldc, in address order) from the
+// control-flow graph, building that first if need be.
+//
+// Returns: 0=ok
+//          1=out of memory (no LDCs are known)
+
+int ldc_build (lcdis_type * ctx)
+{
+   cfg_type * g;
+   regs_type * in;            // at the start of each block
+   regs_type s, none;
+   cfg_edge_type * e;
+   int * work;
+   unsigned char * queued;
+   int n=0, room=0;
+   int k, i, pin, failed=0;
+
+   ldc_free (ctx);
+   ctx->ldcready = 1;
+   for (pin=0; (pin>=0) && (pin<ctx->memsize); pin=next_line (ctx, pin))
+      if (   (ctx->mem[pin] == OP_LDC)
+          && ((ctx->mem_use[pin] == MEM_CODE) || (ctx->mem_use[pin] == MEM_CODE_LABELED)))
+         break;
+   if ((pin < 0) || (pin >= ctx->memsize))
+      return 0;                  // no LDCs: no need for the graph
+   if (!ctx->cfg && cfg_build (ctx))
+      return 1;
+   g = ctx->cfg;
+
+   in     = (regs_type *) malloc ((g->nblocks + 1) * sizeof (regs_type));
+   work   = (int *) malloc ((g->nblocks + 1) * sizeof (int));
+   queued = (unsigned char *) calloc (g->nblocks + 1, 1);
+   if (!in || !work || !queued)
+   {  free (in);
+      free (work);
+      free (queued);
+      return 1;
+   }
+
+   // blocks nothing leads to (vectors, ENTRYn) start with nothing known
+   for (k=g->nblocks-1; k>=0; k--)
+   {  set_all (&in[k], VAL_NONE);
+      if (g->blocks[k].npred == 0)
+      {  set_all (&in[k], VAL_UNKNOWN);
+         work[n++] = k;
+         queued[k] = 1;
+      }
+   }
+   set_all (&none, VAL_UNKNOWN);
+
+   while (n)
+   {
+      k = work[--n];
+      queued[k] = 0;
+      s = in[k];
+      for (pin=g->blocks[k].start; pin<=g->blocks[k].last; pin+=decode[ctx->mem[pin]].len)
+         step (ctx, pin, &s);
+
+      for (i=0; i<g->blocks[k].nsucc; i++)
+      {
+         e = &g->edges[g->blocks[k].succ + i];
+         if ((e->kind == CFG_FALLTHROUGH) && (g->blocks[k].exit == FLOW_CALL))
+         {  if (calls_function (g, k))
+               continue;                 // the function's RETs bring it back
+            if (merge (&in[e->to], &none) && !queued[e->to])
+            {  work[n++] = e->to;        // a call into the blue: anything goes
+               queued[e->to] = 1;
+            }
+            continue;
+         }
+         if (merge (&in[e->to], &s) && !queued[e->to])
+         {  work[n++] = e->to;
+            queued[e->to] = 1;
+         }
+      }
+   }
+
+   for (k=0; (k<g->nblocks) && !failed; k++)
+   {
+      s = in[k];
+      for (i=0; i<NREGS; i++)
+         if (s.r[i] == VAL_NONE)         // never reached from a root
+            s.r[i] = VAL_UNKNOWN;
+      for (pin=g->blocks[k].start; (pin<=g->blocks[k].last) && !failed; pin+=decode[ctx->mem[pin]].len)
+      {  if (ctx->mem[pin] == OP_LDC)
+            failed = add_ldc (ctx, pin, &s, &room);
+         step (ctx, pin, &s);
+      }
+   }
+
+   free (in);
+   free (work);
+   free (queued);
+   if (failed)
+      ldc_free (ctx);
+   ctx->ldcready = 1;
+   return failed;
+}
+
+
+void ldc_free (lcdis_type * ctx)
+{
+   free (ctx->ldc);
+   ctx->ldc = NULL;
+   ctx->nldc = 0;
+   ctx->ldcready = 0;
+}
+
+
+static int by_base (const void * a, const void * b)
+{
+   const table_type * x = (const table_type *) a;
+   const table_type * y = (const table_type *) b;
+
+   if (x->base != y->base)
+      return x->base - y->base;
+   return x->pin - y->pin;
+}
+
+
+// Marks the tables the LDCs read as MEM_DATA (see top of file). Part of
+// lcdis_map_tables, after jump_map.
+
+void ldc_map (lcdis_type * ctx)
+{
+   table_type * t;
+   int n=0, i, j, pin, end;
+
+   if (ldc_build (ctx) || !ctx->nldc)
+      return;
+   if ((t = (table_type *) malloc (ctx->nldc * sizeof (table_type))) == NULL)
+      return;
+
+   for (i=0; i<ctx->nldc; i++)
+      if ((ctx->ldc[i].trl >= 0) && (ctx->ldc[i].trh >= 0))
+      {  t[n].base = (ctx->ldc[i].trh << 8) | ctx->ldc[i].trl;
+         t[n].end  = t[n].base + ((ctx->ldc[i].acc >= 0) ? ctx->ldc[i].acc + 1 : 256);
+         t[n].pin  = ctx->ldc[i].pin;
+         n++;
+      }
+   qsort (t, n, sizeof (table_type), by_base);
+
+   for (i=0; i<n; i=j)
+   {
+      end = t[i].end;
+      for (j=i+1; (j<n) && (t[j].base == t[i].base); j++)
+         if (t[j].end > end)
+            end = t[j].end;
+      if ((j < n) && (end > t[j].base))
+         end = t[j].base;                // up to the next table at most
+      if (end > ctx->memsize)
+         end = ctx->memsize;
+
+      for (pin=t[i].base; (pin<end) && (ctx->mem_use[pin] == MEM_UNKNOWN); pin++)
+         ctx->mem_use[pin] = MEM_DATA;
+      if (pin > t[i].base)
+         out_printf (&ctx->out, "; Mapping LDC table... read at $%04x: $%04x-$%04x ($%04x bytes)\n",
+                     t[i].pin, t[i].base, pin-1, pin-t[i].base);
+   }
+   free (t);
+}
+
+
+// Called by dis_code for every LDC, where the auto-comments go: notes the
+// table it reads ("      ;table $1a2b+$05"), as far as TRH, TRL and ACC
+// are known.
+
+void ldc_note (lcdis_type * ctx, int pin)
+{
+   ldc_type * p;
+   int lo, hi, mid;
+
+   if (!ctx->ldcready)
+      ldc_build (ctx);
+
+   p = NULL;
+   for (lo=0, hi=ctx->nldc-1; lo<=hi; )
+   {  mid = (lo + hi) / 2;
+      if (ctx->ldc[mid].pin == pin)
+      {  p = &ctx->ldc[mid];
+         break;
+      }
+      if (ctx->ldc[mid].pin < pin)
+         lo = mid + 1;
+      else
+         hi = mid - 1;
+   }
+   if ((p == NULL) || ((p->trl < 0) && (p->trh < 0)))
+      return;
+
+   out_str (&ctx->out, "      ;table $");
+   if (p->trh >= 0)
+      out_hex (&ctx->out, p->trh, 2);
+   else
+      out_str (&ctx->out, "??");
+   if (p->trl >= 0)
+      out_hex (&ctx->out, p->trl, 2);
+   else
+      out_str (&ctx->out, "??");
+   if (p->acc >= 0)
+   {  out_str (&ctx->out, "+$");
+      out_hex (&ctx->out, p->acc, 2);
+   }
+}
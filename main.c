@@ -0,0 +1,483 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, command-line program
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * All of the real work is done by the library in lcdis.c; this just turns
+ * the command line into calls on it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "lcdis.h"
+
+
+// --stats or --stats=json: STATS_xxx, else 0
+
+static int stats_arg (char * arg)
+{
+  if (strcmp(arg, "--stats")==0)
+     return (STATS_TEXT);
+  if (strcmp(arg, "--stats=json")==0)
+     return (STATS_JSON);
+  return (0);
+}
+
+
+// lcdis --batch source outdir [--jobs n] [--json] [--binary] [--stats[=json]] {[options] ...}
+
+static int batch_main (int argc, char * argv[])
+{
+  batch_result_type r;
+  char ** options;
+  int noptions=0;
+  int jobs=0;
+  int exports=0;
+  int stats=0;
+  int i;
+
+  if (argc < 4)
+  {  printf ("lcdis --batch (directory | listfile) outputdir [--jobs n] [--json] [--binary] [--stats[=json]] {[options] ...}\n");
+     return (1);
+  }
+
+  options = (char **) malloc (argc * sizeof (char *));
+  for (i=4; i<argc; i++)
+     if ((strcmp(argv[i], "--jobs")==0) && (i+1 < argc))
+        jobs = atoi (argv[++i]);
+     else
+     if (strcmp(argv[i], "--json")==0)
+        exports |= EXPORT_JSON;
+     else
+     if (strcmp(argv[i], "--binary")==0)
+        exports |= EXPORT_BINARY;
+     else
+     if (stats_arg (argv[i]))
+        stats = stats_arg (argv[i]);
+     else
+        options[noptions++] = argv[i];
+
+  if (lcdis_batch (argv[2], argv[3], options, noptions, jobs, exports, stats, &r))
+  {  printf ("; batch: can not read %s\n", argv[2]);
+     free (options);
+     return (1);
+  }
+  free (options);
+
+  printf ("; batch: %d images, %.0f bytes in %.3f s\n", r.images, r.bytes, r.seconds);
+  if (r.seconds > 0)
+     printf ("; batch: %.1f images/s, %.0f bytes/s\n", r.images / r.seconds, r.bytes / r.seconds);
+  printf ("; batch: %d unreadable, %d listings not written, %d stopped by a fatal error\n",
+          r.unreadable, r.unwritable, r.failed);
+  return ((r.unreadable || r.unwritable || r.failed) ? 1 : 0);
+}
+
+
+// lcdis --serve socket [--images n]
+
+static int serve_main (int argc, char * argv[])
+{
+  int images=16;
+  int i;
+
+  if (argc < 3)
+  {  printf ("lcdis --serve socket [--images n]\n");
+     return (1);
+  }
+  for (i=3; i<argc; i++)
+     if ((strcmp(argv[i], "--images")==0) && (i+1 < argc))
+        images = atoi (argv[++i]);
+
+  lcdis_serve (argv[2], images);
+  fprintf (stderr, "lcdis: can not listen on %s\n", argv[2]);
+  return (1);
+}
+
+
+static int by_value (const void * a, const void * b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+
+// lcdis --client socket (inputfile.vms | -) [--list from to] [--label addr] [--xref addr]
+//                                           [--repeat n] {[options] ...}
+//
+// Sends the image, asks the questions in order and prints the answers.
+// --repeat asks each question n times and prints how long they took.
+
+static int client_main (int argc, char * argv[])
+{
+  out_type reply;
+  char ** options;
+  int * queries;               // where each --list/--label/--xref is in argv
+  char request[4096];
+  char key[20];
+  unsigned char * image;
+  double * times;
+  double start;
+  int noptions=0, nqueries=0;
+  int repeat=1;
+  int len=0, n, fd, in, i, q, r;
+  int failed=0;
+
+  if (argc < 4)
+  {  printf ("lcdis --client socket (inputfile.vms | -) [--list from to] [--label addr] [--xref addr] [--repeat n] {[options] ...}\n");
+     return (1);
+  }
+
+  in = (strcmp(argv[3], "-")==0) ? 0 : open (argv[3], O_RDONLY);
+  if ((image = (unsigned char *) malloc (SERVE_IMAGE_MAX + 1)) == NULL)
+  {  fprintf (stderr, "lcdis: out of memory\n");
+     return (1);
+  }
+  // one byte more than the server takes, to tell a file that's too big
+  while ((in >= 0) && (len <= SERVE_IMAGE_MAX) && ((n = read (in, image + len, SERVE_IMAGE_MAX + 1 - len)) > 0))
+     len += n;
+  if ((in < 0) || (len == 0))
+  {  fprintf (stderr, "lcdis: can not read %s\n", argv[3]);
+     return (1);
+  }
+  if (in > 0)
+     close (in);
+  if (len > SERVE_IMAGE_MAX)
+  {  fprintf (stderr, "lcdis: %s is bigger than the server takes (%d bytes)\n", argv[3], SERVE_IMAGE_MAX);
+     return (1);
+  }
+
+  options = (char **) malloc (argc * sizeof (char *));
+  queries = (int *) malloc (argc * sizeof (int));
+  for (i=4; i<argc; i++)
+     if ((strcmp(argv[i], "--list")==0) && (i+2 < argc))
+     {  queries[nqueries++] = i;
+        i += 2;
+     }
+     else
+     if (((strcmp(argv[i], "--label")==0) || (strcmp(argv[i], "--xref")==0)) && (i+1 < argc))
+        queries[nqueries++] = i++;
+     else
+     if ((strcmp(argv[i], "--repeat")==0) && (i+1 < argc))
+        repeat = atoi (argv[++i]);
+     else
+        options[noptions++] = argv[i];
+  if (repeat < 1)
+     repeat = 1;
+
+  if ((fd = lcdis_connect (argv[2])) < 0)
+  {  fprintf (stderr, "lcdis: can not connect to %s\n", argv[2]);
+     return (1);
+  }
+  out_open_mem (&reply);
+  times = (double *) malloc (repeat * sizeof (double));
+
+  n = snprintf (request, sizeof (request), "IMAGE %d", len);
+  for (i=0; i<noptions; i++)
+     n += snprintf (request + n, (n < (int) sizeof (request)) ? sizeof (request) - n : 0, " %s", options[i]);
+  start = stats_now ();
+  if ((r = lcdis_ask (fd, request, image, len, &reply)) != 0)
+     failed = 1;
+  else
+  {  fprintf (stderr, "; image %.*s, %.3f ms\n", reply.len - 1, reply.buf, (stats_now () - start) * 1e3);
+     snprintf (key, sizeof (key), "%.*s", reply.len - 1, reply.buf);
+
+     for (q=0; (q<nqueries) && !failed; q++)
+     {
+        i = queries[q];
+        if (strcmp(argv[i], "--list")==0)
+           snprintf (request, sizeof (request), "LIST %s %s %s", key, argv[i+1], argv[i+2]);
+        else
+           snprintf (request, sizeof (request), "%s %s %s",
+                     (strcmp(argv[i], "--label")==0) ? "LABEL" : "XREF", key, argv[i+1]);
+        for (i=0; (i<repeat) && !failed; i++)
+        {  start = stats_now ();
+           failed = (r = lcdis_ask (fd, request, NULL, 0, &reply)) != 0;
+           times[i] = stats_now () - start;
+        }
+        if (!failed)
+        {  fwrite (reply.buf, 1, reply.len, stdout);
+           if (repeat > 1)
+           {  qsort (times, repeat, sizeof (double), by_value);
+              fprintf (stderr, "; %s: %d times, p50 %.1f us, p99 %.1f us, max %.1f us\n", request, repeat,
+                       times[repeat/2] * 1e6, times[(int) (repeat * 0.99)] * 1e6, times[repeat-1] * 1e6);
+           }
+        }
+     }
+  }
+  if (r > 0)
+     fprintf (stderr, "lcdis: %.*s\n", reply.len, reply.buf);
+  else
+  if (r < 0)
+     fprintf (stderr, "lcdis: lost the connection to %s\n", argv[2]);
+
+  close (fd);
+  free (reply.buf);
+  free (times);
+  free (queries);
+  free (options);
+  free (image);
+  return (failed);
+}
+
+
+// lcdis --compile-annotations annotations.txt index.lca
+
+static int compile_main (int argc, char * argv[])
+{
+  lcdis_type * ctx;
+  int failed;
+
+  if (argc < 4)
+  {  printf ("lcdis --compile-annotations annotationfile indexfile\n");
+     return (1);
+  }
+  if ((ctx = lcdis_new()) == NULL)
+  {  printf ("FATAL: out of memory\n");
+     return (1);
+  }
+  if ((failed = annot_load (ctx, argv[2])) != 0)
+     out_printf (&ctx->out, "; Annotation file=%s, can not read!\n", argv[2]);
+  else
+  if ((failed = annot_save (ctx, argv[3])) != 0)
+     out_printf (&ctx->out, "; can not write %s\n", argv[3]);
+  lcdis_free (ctx);
+  return (failed);
+}
+
+
+// lcdis --diff old.vms new.vms {[options] ...}
+//
+// Maps both images with the same options (the notes that makes are thrown
+// away) and lists the functions that changed.
+
+static int diff_main (int argc, char * argv[])
+{
+  lcdis_type * ctx[2];
+  out_type out;
+  char ** options;
+  int noptions=0;
+  int failed=0;
+  int i, k;
+
+  if (argc < 4)
+  {  printf ("lcdis --diff oldfile newfile {[options] ...}\n");
+     return (1);
+  }
+
+  options = (char **) malloc (argc * sizeof (char *));
+  for (i=4; i<argc; i++)
+     options[noptions++] = argv[i];
+
+  for (k=0; k<2; k++)
+  {  if ((ctx[k] = lcdis_new()) == NULL)
+     {  printf ("FATAL: out of memory\n");
+        return (1);
+     }
+     out_close (&ctx[k]->out);
+     out_open_mem (&ctx[k]->out);
+     ctx[k]->keepgoing = 1;
+     if (lcdis_load (ctx[k], argv[2+k]))
+     {  printf ("; %s file=%s, can not read!\n", k ? "New" : "Old", argv[2+k]);
+        failed = 1;
+        continue;
+     }
+     for (i=0; i<noptions; i++)
+        lcdis_option (ctx[k], options[i]);
+     lcdis_map (ctx[k]);
+     if (ctx[k]->gaveup)
+     {  printf ("; %s file=%s, fatal error while mapping\n", k ? "New" : "Old", argv[2+k]);
+        failed = 1;
+     }
+  }
+  free (options);
+
+  if (!failed)
+  {  out_open (&out, 1);
+     out_printf (&out, "; old: %s\n; new: %s\n", argv[2], argv[3]);
+     if (lcdis_diff (ctx[0], ctx[1], &out))
+     {  out_str (&out, "FATAL: out of memory\n");
+        failed = 1;
+     }
+     out_close (&out);
+  }
+  lcdis_free (ctx[0]);
+  lcdis_free (ctx[1]);
+  return (failed);
+}
+
+
+// --json file / --binary file: writes the analysis there as well.
+//
+// Returns: 0=ok
+//          1=couldn't
+
+static int export_main (lcdis_type * ctx, char * filename, int format)
+{
+  int fd;
+  int failed;
+
+  if ((fd = open (filename, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0)
+  {  fprintf (stderr, "lcdis: can not create %s\n", filename);
+     return (1);
+  }
+  failed = lcdis_export (ctx, fd, format);
+  close (fd);
+  if (failed)
+     fprintf (stderr, "lcdis: can not write %s\n", filename);
+  return (failed);
+}
+
+
+int main (int argc, char * argv[])
+{
+  lcdis_type * ctx;
+  char * json=NULL;
+  char * binary=NULL;
+  char * cachedir=NULL;
+  char * annotfile=NULL;
+  char ** options;
+  char ** dirs;
+  int noptions=0;
+  int ndirs;
+  int stats=0;
+  int failed=0;
+  int i;
+
+  if ((argc >= 2) && (strcmp(argv[1], "--batch")==0))
+     return batch_main (argc, argv);
+  if ((argc >= 2) && (strcmp(argv[1], "--compile-annotations")==0))
+     return compile_main (argc, argv);
+  if ((argc >= 2) && (strcmp(argv[1], "--diff")==0))
+     return diff_main (argc, argv);
+  if ((argc >= 2) && (strcmp(argv[1], "--serve")==0))
+     return serve_main (argc, argv);
+  if ((argc >= 2) && (strcmp(argv[1], "--client")==0))
+     return client_main (argc, argv);
+
+  if ((ctx = lcdis_new()) == NULL)
+  {  printf ("FATAL: out of memory\n");
+     return (1);
+  }
+
+  lcdis_banner (ctx);
+
+  if (argc < 2)
+  {  out_printf (&ctx->out, "lcdis (inputfile.vms | -) [--json file] [--binary file] [--cache dir] [--annotate file] [--stream] [--stats[=json]] {[entrypoint] ...}> outputfile\n\n"
+             "  STRICT         - kills bad 'veins'; helps prevent disassembly of bad code and\n"
+             "                   finds errors, but stops before all good code is disassembled\n"
+             "  ASMOUT         - outputs cleaner code for use with an assembler\n"
+             "  BIOS           - interpret file as a BIOS (use before ENTRY)\n"
+             "  FLASH          - 128K flash dump: list the upper 64K as data and note the\n"
+             "                   flash address (FLASHA16:TRH:TRL) at LDF and STF\n"
+             "  XREF           - list the calls, jumps and branches to each label\n"
+             "  ENTRYn         - define code starting at address n\n"
+             "  GRAPHBYTESn,b  - define b bytes of graphics at address n\n"
+             "  FONT8,n,b      - define b bytes of 8-bit wide fonts at address n\n"
+             "  GRAPHPAGESn,p  - define p pages (=0xC0 bytes) of graphics at address n\n"
+             "  --json file    - also write the analysis to file as JSON, one record a line\n"
+             "  --binary file  - also write the analysis to file as binary records (lcdis.h)\n"
+             "  --cache dir    - keep the memory map in dir and reuse it when the same file\n"
+             "                   is run with the same options\n"
+             "  --annotate file - labels, comments and directives from an annotation file\n"
+             "                   (text, or compiled with --compile-annotations)\n"
+             "  --stream       - write the listing out a region at a time as it's made,\n"
+             "                   for a pipe (the default is in 64K chunks)\n"
+             "  --stats        - print the time each phase took and the tracer's counters\n"
+             "                   to stderr (--stats=json: as one JSON object)\n\n"
+             "lcdis --batch (directory | listfile) outputdir [--jobs n] [--json] [--binary] [--stats[=json]] {[options] ...}\n"
+             "  disassembles every .vms/.bin file in the directory (or every file named in\n"
+             "  the list file) into outputdir/<name>.lst, using n threads (default: all CPUs);\n"
+             "  --json and --binary add outputdir/<name>.json and outputdir/<name>.lcx;\n"
+             "  --stats prints each image's stats as it's done\n\n"
+             "lcdis --compile-annotations annotationfile indexfile\n"
+             "  turns an annotation file into an index --annotate maps straight in\n\n"
+             "lcdis --diff oldfile newfile {[options] ...}\n"
+             "  maps both images the same way and lists the functions that changed, side\n"
+             "  by side, then the ones removed and added\n\n"
+             "lcdis --serve socket [--images n]\n"
+             "  answers requests on a Unix socket, keeping the last n images (default 16)\n"
+             "  analysed in memory (see server.c)\n\n"
+             "lcdis --client socket (inputfile.vms | -) [--list from to] [--label addr] [--xref addr] [--repeat n] {[options] ...}\n"
+             "  sends the image to the server and prints the answers; --repeat asks each\n"
+             "  question n times and prints the latencies\n\n"
+             "In addition to the standard entry points, other points can be disassembled.\n"
+             "Enter these as parameters after the input file. Use decimal or the 0x notation.\n"
+             "An input file of - reads the image from stdin.\n"
+             "Example:\n"
+             "    lcdis football.vms ENTRY0x139 > football.lst\n\n");
+     lcdis_free (ctx);
+     return (1);
+  }
+
+  if (lcdis_load (ctx, argv[1]))
+  {  lcdis_free (ctx);
+     return (1);
+  }
+
+  options = (char **) malloc (argc * sizeof (char *));
+  for (i=2; i<argc; i++)    // extra command-line arguments
+     if ((strcmp(argv[i], "--json")==0) && (i+1 < argc))
+        json = argv[++i];
+     else
+     if ((strcmp(argv[i], "--binary")==0) && (i+1 < argc))
+        binary = argv[++i];
+     else
+     if ((strcmp(argv[i], "--cache")==0) && (i+1 < argc))
+        cachedir = argv[++i];
+     else
+     if (strcmp(argv[i], "--stream")==0)
+        ctx->stream = 1;
+     else
+     if ((strcmp(argv[i], "--annotate")==0) && (i+1 < argc))
+        annotfile = argv[++i];
+     else
+     if (stats_arg (argv[i]))
+        stats = stats_arg (argv[i]);
+     else
+        options[noptions++] = argv[i];
+
+  if (annotfile)     // its directives go first, as if they'd been typed first
+  {  if (annot_load (ctx, annotfile))
+     {  out_printf (&ctx->out, "; Annotation file=%s, can not read!\n", annotfile);
+        free (options);
+        lcdis_free (ctx);
+        return (1);
+     }
+     ndirs = annot_directives (ctx, &dirs);
+     options = (char **) realloc (options, (argc + ndirs) * sizeof (char *));
+     memmove (options + ndirs, options, noptions * sizeof (char *));
+     memcpy (options, dirs, ndirs * sizeof (char *));
+     noptions += ndirs;
+  }
+
+  if (cachedir)
+     lcdis_map_cached (ctx, cachedir, options, noptions);
+  else
+  {  for (i=0; i<noptions; i++)
+        lcdis_option (ctx, options[i]);
+     lcdis_map (ctx);
+  }
+  free (options);
+  if (ctx->stream)
+     out_flush (&ctx->out);    // the mapping notes, while the listing gets going
+  lcdis_listing (ctx);
+  if (json)
+     failed |= export_main (ctx, json, EXPORT_JSON);
+  if (binary)
+     failed |= export_main (ctx, binary, EXPORT_BINARY);
+  if (stats)
+  {  out_flush (&ctx->out);    // the listing comes first on a terminal
+     stats_print (ctx, 2, argv[1], stats);
+  }
+
+  lcdis_free (ctx);
+  return(failed);
+}
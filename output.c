@@ -0,0 +1,263 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, buffered output
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * A listing line used to be a dozen printf calls. Now everything goes into
+ * a big buffer, with the hex and decimal done by hand, and the buffer is
+ * written out in one go when it fills up. The output can go to a file
+ * descriptor or just stay in memory, or both for a while (out_keep).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include "lcdis.h"
+
+#define OUT_BUFSIZE      0x10000
+
+static const char hexdigits[] = "0123456789abcdef";
+static const char HEXDIGITS[] = "0123456789ABCDEF";
+
+
+// Sends output to file descriptor fd (not closed by out_close).
+//
+// Returns: 0=ok
+//          1=out of memory
+
+int out_open (out_type * o, int fd)
+{
+   o->size  = OUT_BUFSIZE;
+   o->buf   = (char *) malloc (o->size);
+   o->len   = 0;
+   o->fd    = fd;
+   o->error = 0;
+   o->keep  = -1;
+   o->flushed = 0;
+   o->written = 0;
+   return (o->buf == NULL);
+}
+
+
+// Keeps output in o->buf (o->len bytes), which grows as needed. The caller
+// owns o->buf after out_close.
+
+int out_open_mem (out_type * o)
+{
+   return out_open (o, -1);
+}
+
+
+void out_flush (out_type * o)
+{
+   int done=o->flushed;
+   int n;
+
+   if (o->fd < 0)
+      return;
+   while (done < o->len)
+   {
+      n = write (o->fd, o->buf + done, o->len - done);
+      if (n <= 0)
+      {  o->error=1;
+         break;
+      }
+      done += n;
+      o->written += n;
+   }
+   if (o->keep >= 0)
+      o->flushed=o->len;
+   else
+      o->len=0;
+}
+
+
+// From now on, keeps a copy of everything in o->buf (from o->keep to
+// o->len) as well as writing it out, until out_release.
+
+void out_keep (out_type * o)
+{
+   out_flush (o);
+   o->keep = o->len;
+}
+
+
+void out_release (out_type * o)
+{
+   out_flush (o);
+   if (o->fd >= 0)
+      o->len = 0;
+   o->keep    = -1;
+   o->flushed = 0;
+}
+
+
+// Returns: bytes of output so far (written out or waiting)
+
+double out_tell (out_type * o)
+{
+   return o->written + o->len - o->flushed;
+}
+
+
+// Flushes what's waiting and sends everything after that to fd.
+
+void out_set_fd (out_type * o, int fd)
+{
+   out_flush (o);
+   o->fd    = fd;
+   o->error = 0;
+}
+
+
+// Flushes and lets go of the buffer (unless it's a memory target).
+
+void out_close (out_type * o)
+{
+   if (o->fd < 0)
+      return;
+   out_flush (o);
+   free (o->buf);
+   o->buf  = NULL;
+   o->size = 0;
+}
+
+
+// Makes room for n more bytes.
+
+static void out_room (out_type * o, int n)
+{
+   char * b;
+
+   if (o->len + n <= o->size)
+      return;
+   if ((o->fd >= 0) && (o->keep < 0))
+   {  out_flush (o);
+      if (n <= o->size)
+         return;
+   }
+   while (o->len + n > o->size)
+      o->size *= 2;
+   b = (char *) realloc (o->buf, o->size);
+   if (b == NULL)
+   {  fprintf (stderr, "FATAL INTERNAL ERROR: out of memory for output!\n");
+      exit (-1);
+   }
+   o->buf = b;
+}
+
+
+void out_char (out_type * o, int c)
+{
+   if (o->len == o->size)
+      out_room (o, 1);
+   o->buf[o->len++] = c;
+}
+
+
+void out_mem (out_type * o, const char * s, int n)
+{
+   if (n <= 0)                 // s may be NULL then
+      return;
+   out_room (o, n);
+   memcpy (o->buf + o->len, s, n);
+   o->len += n;
+}
+
+
+void out_str (out_type * o, const char * s)
+{
+   out_mem (o, s, strlen (s));
+}
+
+
+// s, then spaces up to width characters (printf's "%-*s")
+
+void out_pad (out_type * o, const char * s, int width)
+{
+   int n;
+
+   n = strlen (s);
+   out_mem (o, s, n);
+   while (n++ < width)
+      out_char (o, ' ');
+}
+
+
+// v in hex, at least digits long (printf's "%0*x" and "%0*X")
+
+static void out_hexdigits (out_type * o, unsigned int v, int digits, const char * set)
+{
+   char temp[8];
+   int n=0;
+
+   do
+   {  temp[n++] = set[v & 0xF];
+      v >>= 4;
+   } while (v || (n < digits));
+   out_room (o, n);
+   while (n)
+      o->buf[o->len++] = temp[--n];
+}
+
+
+void out_hex (out_type * o, unsigned int v, int digits)
+{
+   out_hexdigits (o, v, digits, hexdigits);
+}
+
+
+void out_HEX (out_type * o, unsigned int v, int digits)
+{
+   out_hexdigits (o, v, digits, HEXDIGITS);
+}
+
+
+// v in decimal (printf's "%d")
+
+void out_dec (out_type * o, int v)
+{
+   char temp[12];
+   unsigned int u;
+   int n=0;
+
+   u = (v < 0) ? -(unsigned int) v : (unsigned int) v;
+   do
+   {  temp[n++] = '0' + u % 10;
+      u /= 10;
+   } while (u);
+   if (v < 0)
+      temp[n++] = '-';
+   out_room (o, n);
+   while (n)
+      o->buf[o->len++] = temp[--n];
+}
+
+
+// For the messages that aren't worth formatting by hand.
+
+void out_printf (out_type * o, const char * format, ...)
+{
+   va_list ap;
+   int n;
+
+   va_start (ap, format);
+   n = vsnprintf (o->buf + o->len, o->size - o->len, format, ap);
+   va_end (ap);
+   if (n < o->size - o->len)
+   {  o->len += n;
+      return;
+   }
+
+   out_room (o, n+1);
+   va_start (ap, format);
+   vsnprintf (o->buf + o->len, o->size - o->len, format, ap);
+   va_end (ap);
+   o->len += n;
+}
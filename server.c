@@ -0,0 +1,624 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, server mode
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * For something that asks about the same images over and over (a browser
+ * front end), lcdis_serve listens on a Unix domain socket and keeps the
+ * images it has analysed in memory, most recently used first, each under a
+ * hash of its bytes and options. An image is disassembled once into a
+ * listing in memory, with the address and offset of every line; after that
+ * a question is a lookup and a write.
+ *
+ * Every request is one line of text. The reply is "OK <n>\n" and n bytes,
+ * or "ERR <why>\n":
+ *
+ *    IMAGE <len> {option ...}   then len bytes of image: the image's key
+ *    LIST <key> <from> <to>     the listing lines for addresses from..to
+ *    LABEL <key> <addr>         the label at addr, or the one before it
+ *                               and how far on ("L0690+$07"); empty if none
+ *    XREF <key> <addr>          what calls, jumps or branches to addr,
+ *                               a line each ("L0123 call")
+ *
+ * A connection can ask any number of questions, and lasts until the client
+ * closes it. Each connection gets a thread. An image is analysed on the
+ * thread that first sends it; once it's in the cache nothing changes it,
+ * so questions only take the lock to find it.
+ *
+ * lcdis_connect and lcdis_ask are the other end (lcdis --client).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "lcdis.h"
+
+#define SERVE_LINE       4096      // longest request line
+#define SERVE_WORDS      64        // words in a request line
+
+typedef struct served_s served_type;
+
+struct served_s
+{
+   uint64_t      key;
+   lcdis_type *  ctx;          // the analysis; the listing is ctx->out.buf
+   int *         line_addr;    // each line of the listing: its address
+   int *         line_at;      //    and where it starts in ctx->out.buf
+   int           nlines;       //    (plus one more for the end)
+   int           users;        // connections using it right now
+   int           evicted;      // out of the list; the last user frees it
+   served_type * prev, * next; // most recently used first
+};
+
+typedef struct
+{
+   served_type * first, * last;
+   int           count;
+   int           max;          // images kept
+   pthread_mutex_t lock;
+} server_type;
+
+typedef struct
+{
+   server_type * server;
+   int           fd;
+   char          buf[SERVE_LINE];
+   int           start, len;   // buf[start..len-1] is read but not used yet
+} conn_type;
+
+
+static void drop (served_type * e)
+{
+   lcdis_free (e->ctx);
+   free (e->line_addr);
+   free (e->line_at);
+   free (e);
+}
+
+
+static void unlink_served (server_type * s, served_type * e)
+{
+   if (e->prev)
+      e->prev->next = e->next;
+   else
+      s->first = e->next;
+   if (e->next)
+      e->next->prev = e->prev;
+   else
+      s->last = e->prev;
+   e->prev = e->next = NULL;
+   s->count--;
+}
+
+
+static void push_served (server_type * s, served_type * e)
+{
+   e->prev = NULL;
+   e->next = s->first;
+   if (s->first)
+      s->first->prev = e;
+   else
+      s->last = e;
+   s->first = e;
+   s->count++;
+}
+
+
+// Returns: the image with this key (now most recently used, and in use by
+//          the caller until release), or NULL
+
+static served_type * find (server_type * s, uint64_t key)
+{
+   served_type * e;
+
+   pthread_mutex_lock (&s->lock);
+   for (e=s->first; e && (e->key != key); e=e->next)
+      ;
+   if (e)
+   {  unlink_served (s, e);
+      push_served (s, e);
+      e->users++;
+   }
+   pthread_mutex_unlock (&s->lock);
+   return e;
+}
+
+
+// Puts a newly analysed image in the list, unless another connection got
+// there first, and evicts the least recently used ones over s->max.
+//
+// Returns: the one in the list (in use by the caller until release)
+
+static served_type * add (server_type * s, served_type * e)
+{
+   served_type * old;
+   served_type * gone=NULL;
+
+   pthread_mutex_lock (&s->lock);
+   for (old=s->first; old && (old->key != e->key); old=old->next)
+      ;
+   if (old)
+   {  old->users++;
+      pthread_mutex_unlock (&s->lock);
+      drop (e);
+      return old;
+   }
+   e->users = 1;
+   push_served (s, e);
+   while (s->count > s->max)
+   {  old = s->last;
+      unlink_served (s, old);
+      if (old->users)
+         old->evicted = 1;
+      else
+      {  old->next = gone;      // freed after unlocking
+         gone = old;
+      }
+   }
+   pthread_mutex_unlock (&s->lock);
+   while (gone)
+   {  old = gone->next;
+      drop (gone);
+      gone = old;
+   }
+   return e;
+}
+
+
+static void release (server_type * s, served_type * e)
+{
+   int last;
+
+   pthread_mutex_lock (&s->lock);
+   last = (--e->users == 0) && e->evicted;
+   pthread_mutex_unlock (&s->lock);
+   if (last)
+      drop (e);
+}
+
+
+// Disassembles len bytes of image with the options in words[0..nwords-1].
+//
+// Returns: the analysis, or NULL (*why says why)
+
+static served_type * analyse (server_type * s, uint64_t key, const unsigned char * data,
+                              int len, char ** words, int nwords, char ** why)
+{
+   served_type * e;
+   lcdis_type * ctx;
+   double * lineat;
+   char name[20];
+   int i, n;
+
+   *why = "out of memory";
+   if ((e = (served_type *) calloc (1, sizeof (served_type))) == NULL)
+      return NULL;
+   if ((e->ctx = ctx = lcdis_new()) == NULL)
+   {  free (e);
+      return NULL;
+   }
+   e->key = key;
+   out_close (&ctx->out);
+   out_open_mem (&ctx->out);
+   ctx->keepgoing = 1;
+
+   snprintf (name, sizeof (name), "%016llx", (unsigned long long) key);
+   lcdis_banner (ctx);
+   if (lcdis_load_mem (ctx, name, data, len))
+   {  drop (e);
+      return NULL;
+   }
+   for (i=0; i<nwords; i++)
+      lcdis_option (ctx, words[i]);
+   lcdis_map (ctx);
+   if (ctx->gaveup)
+   {  *why = "fatal error while mapping";
+      drop (e);
+      return NULL;
+   }
+
+   if ((lineat = (double *) malloc ((ctx->memsize + 1) * sizeof (double))) == NULL)
+   {  drop (e);
+      return NULL;
+   }
+   ctx->lineat = lineat;
+   lcdis_listing (ctx);
+   ctx->lineat = NULL;
+   if (ctx->xref == NULL)
+      xref_build (ctx);
+
+   for (i=0, n=1; i<ctx->memsize; i++)
+      n += (lineat[i] >= 0);
+   e->line_addr = (int *) malloc (n * sizeof (int));
+   e->line_at   = (int *) malloc (n * sizeof (int));
+   if (!e->line_addr || !e->line_at || !ctx->out.buf)
+   {  free (lineat);
+      drop (e);
+      return NULL;
+   }
+   for (i=0, n=0; i<=ctx->memsize; i++)
+      if ((lineat[i] >= 0) || (i == ctx->memsize))
+      {  e->line_addr[n] = i;
+         e->line_at[n++] = (int) lineat[i];
+      }
+   e->nlines = n - 1;
+   free (lineat);
+   return e;
+}
+
+
+// Returns: the first line whose address is above addr (e->nlines if none)
+
+static int line_after (served_type * e, int addr)
+{
+   int lo=0, hi=e->nlines;
+
+   while (lo < hi)
+   {  int mid = (lo + hi) / 2;
+      if (e->line_addr[mid] <= addr)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+
+// Returns: 0=ok
+//          1=the connection is gone
+
+static int send_all (int fd, const char * p, int n)
+{
+   int done;
+
+   while (n > 0)
+   {  if ((done = send (fd, p, n, MSG_NOSIGNAL)) <= 0)
+         return 1;
+      p += done;
+      n -= done;
+   }
+   return 0;
+}
+
+
+static int reply (conn_type * c, const char * body, int n)
+{
+   char head[32];
+
+   snprintf (head, sizeof (head), "OK %d\n", n);
+   return send_all (c->fd, head, strlen (head)) || send_all (c->fd, body, n);
+}
+
+
+static int reply_error (conn_type * c, const char * why)
+{
+   char head[SERVE_LINE];
+
+   snprintf (head, sizeof (head), "ERR %s\n", why);
+   return send_all (c->fd, head, strlen (head));
+}
+
+
+// Reads one request line (without the newline) into line.
+//
+// Returns: 0=ok
+//          1=the connection is gone, or the line is too long
+
+static int read_line (conn_type * c, char * line)
+{
+   char * nl;
+   int n;
+
+   for (;;)
+   {
+      nl = memchr (c->buf + c->start, '\n', c->len - c->start);
+      if (nl)
+      {  n = nl - (c->buf + c->start);
+         memcpy (line, c->buf + c->start, n);
+         line[n] = 0;
+         c->start += n + 1;
+         return 0;
+      }
+      if (c->start)
+      {  memmove (c->buf, c->buf + c->start, c->len - c->start);
+         c->len  -= c->start;
+         c->start = 0;
+      }
+      if (c->len == SERVE_LINE)
+         return 1;
+      if ((n = recv (c->fd, c->buf + c->len, SERVE_LINE - c->len, 0)) <= 0)
+         return 1;
+      c->len += n;
+   }
+}
+
+
+static int read_bytes (conn_type * c, unsigned char * p, int n)
+{
+   int got;
+
+   got = c->len - c->start;
+   if (got > n)
+      got = n;
+   memcpy (p, c->buf + c->start, got);
+   c->start += got;
+   while (got < n)
+   {  int r = recv (c->fd, p + got, n - got, 0);
+      if (r <= 0)
+         return 1;
+      got += r;
+   }
+   return 0;
+}
+
+
+// IMAGE <len> {option ...}
+//
+// Returns: 0=ok
+//          1=the connection is gone
+
+static int do_image (conn_type * c, char ** words, int nwords)
+{
+   server_type * s = c->server;
+   served_type * e;
+   unsigned char * data;
+   uint64_t key;
+   char answer[20];
+   char * why;
+   int len, i;
+
+   len = (nwords >= 2) ? atoi (words[1]) : 0;
+   if ((len <= 0) || (len > SERVE_IMAGE_MAX))
+   {  reply_error (c, "bad image length");
+      return 1;                 // the bytes can't be skipped, so that's it
+   }
+   if ((data = (unsigned char *) malloc (len)) == NULL)
+   {  reply_error (c, "out of memory");
+      return 1;
+   }
+   if (read_bytes (c, data, len))
+   {  free (data);
+      return 1;
+   }
+
+   key = cache_hash (CACHE_HASH_START, data, len);
+   for (i=2; i<nwords; i++)
+      key = cache_hash (key, (const unsigned char *) words[i], strlen (words[i]) + 1);
+
+   if ((e = find (s, key)) == NULL)
+   {  if ((e = analyse (s, key, data, len, words + 2, nwords - 2, &why)) == NULL)
+      {  free (data);
+         return reply_error (c, why);
+      }
+      e = add (s, e);
+   }
+   free (data);
+   release (s, e);
+   snprintf (answer, sizeof (answer), "%016llx\n", (unsigned long long) key);
+   return reply (c, answer, strlen (answer));
+}
+
+
+// LIST/LABEL/XREF <key> <addr> ...
+//
+// Returns: 0=ok
+//          1=the connection is gone
+
+static int do_query (conn_type * c, char ** words, int nwords)
+{
+   server_type * s = c->server;
+   served_type * e;
+   xref_ref_type * refs;
+   static const char * kinds[] = { "call", "jump", "branch" };
+   out_type o;
+   char * name;
+   int from, to, a, b, n, i;
+   int failed;
+
+   if (strcmp (words[0], "LIST") && strcmp (words[0], "LABEL") && strcmp (words[0], "XREF"))
+      return reply_error (c, "unknown request");
+   if ((nwords < 3) || (sscanf (words[2], "%i", &from) != 1))
+      return reply_error (c, "usage: LIST <key> <from> <to>, LABEL <key> <addr> or XREF <key> <addr>");
+   if ((e = find (s, strtoull (words[1], NULL, 16))) == NULL)
+      return reply_error (c, "unknown image; send it with IMAGE first");
+
+   if (strcmp (words[0], "LIST") == 0)
+   {
+      if ((nwords < 4) || (sscanf (words[3], "%i", &to) != 1))
+         to = from;
+      a = line_after (e, from);              // the line with from in it...
+      if (a > 0)
+         a--;
+      b = line_after (e, to);                // ...to the line with to in it
+      failed = reply (c, e->ctx->out.buf + e->line_at[a],
+                      (b > a) ? e->line_at[b] - e->line_at[a] : 0);
+   }
+   else
+   {
+      out_open_mem (&o);
+      if (strcmp (words[0], "LABEL") == 0)
+      {
+         a = line_after (e, from);
+         while ((--a >= 0) && (e->ctx->mem_use[e->line_addr[a]] != MEM_CODE_LABELED))
+            ;
+         if ((from >= 0) && (from < 0x10000) && (name = find_label (from)))
+            out_str (&o, name);
+         else
+         if (a >= 0)
+         {  a = e->line_addr[a];
+            if ((name = find_label (a)))
+               out_str (&o, name);
+            else
+            {  out_char (&o, 'L');
+               out_HEX (&o, a, 4);
+            }
+            if (from != a)
+            {  out_str (&o, "+$");
+               out_hex (&o, from - a, 2);
+            }
+         }
+         if (o.len)
+            out_char (&o, '\n');
+      }
+      else                                   // XREF
+      {
+         n = xref_code (e->ctx, from, &refs);
+         for (i=0; i<n; i++)
+         {  out_char (&o, 'L');
+            out_HEX (&o, refs[i].from, 4);
+            out_char (&o, ' ');
+            out_str (&o, kinds[refs[i].kind]);
+            out_char (&o, '\n');
+         }
+      }
+      failed = reply (c, o.buf, o.len);
+      free (o.buf);
+   }
+   release (s, e);
+   return failed;
+}
+
+
+static void * connection (void * arg)
+{
+   conn_type * c = (conn_type *) arg;
+   char line[SERVE_LINE+1];
+   char * words[SERVE_WORDS];
+   int nwords;
+
+   while (!read_line (c, line))
+   {
+      for (nwords=0, words[0]=strtok (line, " \t\r"); words[nwords] && (nwords < SERVE_WORDS-1); )
+         words[++nwords] = strtok (NULL, " \t\r");
+      if (nwords == 0)
+         continue;
+      if (strcmp (words[0], "IMAGE") == 0)
+      {  if (do_image (c, words, nwords))
+            break;
+      }
+      else
+      if (do_query (c, words, nwords))
+         break;
+   }
+   close (c->fd);
+   free (c);
+   return NULL;
+}
+
+
+// Serves requests on the Unix socket at path until killed, keeping up to
+// images analysed images.
+//
+// Returns: 1=couldn't listen on path (it doesn't return otherwise)
+
+int lcdis_serve (char * path, int images)
+{
+   server_type s;
+   struct sockaddr_un addr;
+   pthread_t thread;
+   conn_type * c;
+   int fd, cfd;
+
+   memset (&s, 0, sizeof (s));
+   s.max  = (images > 0) ? images : 1;
+   pthread_mutex_init (&s.lock, NULL);
+   signal (SIGPIPE, SIG_IGN);
+
+   memset (&addr, 0, sizeof (addr));
+   addr.sun_family = AF_UNIX;
+   if (strlen (path) >= sizeof (addr.sun_path))
+      return 1;
+   strcpy (addr.sun_path, path);
+   unlink (path);
+   if (   ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0)
+       || bind (fd, (struct sockaddr *) &addr, sizeof (addr))
+       || listen (fd, 64))
+      return 1;
+
+   for (;;)
+   {
+      if ((cfd = accept (fd, NULL, NULL)) < 0)
+         continue;
+      if ((c = (conn_type *) calloc (1, sizeof (conn_type))) == NULL)
+      {  close (cfd);
+         continue;
+      }
+      c->server = &s;
+      c->fd     = cfd;
+      if (pthread_create (&thread, NULL, connection, c))
+      {  close (cfd);
+         free (c);
+         continue;
+      }
+      pthread_detach (thread);
+   }
+}
+
+
+// Returns: a connection to the server at path, or -1
+
+int lcdis_connect (char * path)
+{
+   struct sockaddr_un addr;
+   int fd;
+
+   memset (&addr, 0, sizeof (addr));
+   addr.sun_family = AF_UNIX;
+   if (strlen (path) >= sizeof (addr.sun_path))
+      return -1;
+   strcpy (addr.sun_path, path);
+   if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0)
+      return -1;
+   if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)))
+   {  close (fd);
+      return -1;
+   }
+   return fd;
+}
+
+
+// Sends request (a line, without the newline) and len bytes of data after
+// it, and reads the reply into reply (out_open_mem'd by the caller; it's
+// emptied first).
+//
+// Returns: 0=OK, the body is in reply
+//          1=ERR, the reason is in reply
+//         -1=the connection is gone
+
+int lcdis_ask (int fd, const char * request, const unsigned char * data, int len, out_type * reply)
+{
+   char head[SERVE_LINE];
+   char chunk[0x4000];
+   int n=0, r;
+
+   reply->len = 0;
+   if (   send_all (fd, request, strlen (request)) || send_all (fd, "\n", 1)
+       || (len && send_all (fd, (const char *) data, len)))
+      return -1;
+
+   do                                 // the reply's first line, a byte at a time
+   {  if ((n == SERVE_LINE-1) || (recv (fd, head + n, 1, 0) != 1))
+         return -1;
+   } while (head[n++] != '\n');
+   head[n-1] = 0;
+
+   if (strncmp (head, "OK ", 3) != 0)
+   {  out_str (reply, (strncmp (head, "ERR ", 4) == 0) ? head + 4 : head);
+      return 1;
+   }
+   for (n = atoi (head + 3); n > 0; n -= r)
+   {  if ((r = recv (fd, chunk, (n < (int) sizeof (chunk)) ? n : (int) sizeof (chunk), 0)) <= 0)
+         return -1;
+      out_mem (reply, chunk, r);
+   }
+   return 0;
+}
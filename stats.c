@@ -0,0 +1,134 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, --stats
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * How long each phase of one disassembly took (loading, tracing each entry
+ * point, search_text, the listing) and what the tracer ran into on the way.
+ * The numbers are gathered by the STAT_xxx macros in lcdis.h, which are
+ * empty unless LCDIS_STATS is defined, and printed here to a file
+ * descriptor (stderr, from main.c and batch.c) as text or as one JSON
+ * object, so a batch run can show which image spends its time where.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lcdis.h"
+
+
+double stats_now (void)
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// Zeroes the counters for the next image (the entry list's room is kept).
+
+void stats_reset (lcdis_type * ctx)
+{
+   stats_entry_type * entries = ctx->stats.entries;
+   int room = ctx->stats.entryroom;
+
+   memset (&ctx->stats, 0, sizeof (stats_type));
+   ctx->stats.entries   = entries;
+   ctx->stats.entryroom = room;
+}
+
+
+// One entry point took this long to trace.
+
+void stats_entry (lcdis_type * ctx, int pin, double seconds)
+{
+   stats_type * s = &ctx->stats;
+   stats_entry_type * e;
+
+   if (s->nentries == s->entryroom)
+   {  e = (stats_entry_type *) realloc (s->entries, (s->entryroom ? s->entryroom * 2 : 32) * sizeof (stats_entry_type));
+      if (e == NULL)
+         return;              // just not listed
+      s->entries = e;
+      s->entryroom = s->entryroom ? s->entryroom * 2 : 32;
+   }
+   e = &s->entries[s->nentries++];
+   e->pin     = pin;
+   e->seconds = seconds;
+}
+
+
+#ifdef LCDIS_STATS
+static void print_text (out_type * o, stats_type * s, char * name)
+{
+   int i;
+
+   out_printf (o, "lcdis stats: %s\n", name);
+   out_printf (o, "   load            %10.3f ms\n", s->load * 1e3);
+   out_printf (o, "   mapmem          %10.3f ms  (%d entry points)\n", s->trace * 1e3, s->nentries);
+   for (i=0; i<s->nentries; i++)
+      out_printf (o, "      $%04x        %10.3f ms\n", s->entries[i].pin & 0xFFFF, s->entries[i].seconds * 1e3);
+   out_printf (o, "   jump/LDC tables %10.3f ms\n", s->tables * 1e3);
+   out_printf (o, "   search_text     %10.3f ms\n", s->text * 1e3);
+   out_printf (o, "   output          %10.3f ms\n", s->output * 1e3);
+   out_printf (o, "   instructions traced       %ld\n", s->insns);
+   out_printf (o, "   trace stack high-water    %d\n", s->depth);
+   out_printf (o, "   bad veins                 %ld\n", s->badveins);
+   out_printf (o, "   misaligned code warnings  %ld\n", s->misaligned);
+   out_printf (o, "   calls taken from summary  %ld\n", s->summaries);
+   out_printf (o, "   label lookups             %ld\n", s->labels);
+   out_printf (o, "   CODECMTS matches          %ld\n", s->comments);
+   out_printf (o, "   output bytes              %.0f\n", s->outbytes);
+}
+
+
+static void print_json (out_type * o, stats_type * s, char * name)
+{
+   int i;
+
+   out_str (o, "{\"image\":\"");
+   for (; *name; name++)
+   {  if ((*name == '"') || (*name == '\\'))
+         out_char (o, '\\');
+      if ((unsigned char) *name >= ' ')
+         out_char (o, *name);
+   }
+   out_printf (o, "\",\"load_ms\":%.3f,\"mapmem_ms\":%.3f,\"entries\":[", s->load * 1e3, s->trace * 1e3);
+   for (i=0; i<s->nentries; i++)
+      out_printf (o, "%s{\"addr\":%d,\"ms\":%.3f}", i ? "," : "", s->entries[i].pin, s->entries[i].seconds * 1e3);
+   out_printf (o, "],\"tables_ms\":%.3f,\"search_text_ms\":%.3f,\"output_ms\":%.3f",
+               s->tables * 1e3, s->text * 1e3, s->output * 1e3);
+   out_printf (o, ",\"insns\":%ld,\"depth\":%d,\"bad_veins\":%ld,\"misaligned\":%ld,\"summaries\":%ld",
+               s->insns, s->depth, s->badveins, s->misaligned, s->summaries);
+   out_printf (o, ",\"label_lookups\":%ld,\"codecmts\":%ld,\"output_bytes\":%.0f}\n",
+               s->labels, s->comments, s->outbytes);
+}
+#endif
+
+
+// Prints ctx's stats for image 'name' to fd as STATS_TEXT or STATS_JSON,
+// in one write so that batch workers don't mix their lines.
+
+void stats_print (lcdis_type * ctx, int fd, char * name, int format)
+{
+   out_type o;
+
+   if (out_open_mem (&o))
+      return;
+#ifdef LCDIS_STATS
+   if (format == STATS_JSON)
+      print_json (&o, &ctx->stats, name);
+   else
+      print_text (&o, &ctx->stats, name);
+#else
+   out_printf (&o, "lcdis: --stats needs a build with -DLCDIS_STATS\n");
+#endif
+   out_set_fd (&o, fd);
+   out_close (&o);
+}
@@ -0,0 +1,213 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, finding text strings
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * search_text used to try a string at every address, looking at up to 128
+ * bytes each time. Now the image is read once, 16 bytes at a time: each
+ * block is boiled down to a bitmask of the bytes that end a string (or
+ * spoil it) and a bitmask of the letters, and only the ends are looked at
+ * one by one. With SSE2 the masks take a handful of instructions per
+ * block; otherwise they come from a 256-entry table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lcdis.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define TEXT_BLOCK       16     // bytes classified at once
+#define TEXT_WINDOW      128    // longest look for the $00 at the end
+
+#ifndef __SSE2__
+
+#define CH_TEXT          1      // printable, CR or LF
+#define CH_ALPHA         2      // letter
+
+static unsigned char text_class[256];
+static int text_class_ready=0;
+
+
+// Same tests search_text always made (isprint and isalpha in the C locale,
+// which is all lcdis ever runs in).
+
+static void init_text_class (void)
+{
+   int c;
+
+   for (c=0; c<256; c++)
+   {  if (((c >= 0x20) && (c < 0x7F)) || (c == 0x0d) || (c == 0x0a))
+         text_class[c] |= CH_TEXT;
+      if (((c >= 'A') && (c <= 'Z')) || ((c >= 'a') && (c <= 'z')))
+         text_class[c] |= CH_ALPHA;
+   }
+   text_class_ready=1;
+}
+
+#endif
+
+
+// Classifies the TEXT_BLOCK bytes at pin (which may run into the slack
+// after the image, but no further):
+//   *stop  - bit n set if byte n ends a string: $00, not text, or not
+//            MEM_UNKNOWN/MEM_DATA
+//   *null  - bit n set if byte n is a $00 that can end a string
+//   *alpha - bit n set if byte n is a letter
+
+static void classify (lcdis_type * ctx, int pin, unsigned int * stop,
+                      unsigned int * null, unsigned int * alpha)
+{
+#ifdef __SSE2__
+   __m128i b, u, lower, usable, zero, text;
+
+   b = _mm_loadu_si128 ((const __m128i *) (ctx->mem + pin));
+   u = _mm_loadu_si128 ((const __m128i *) (ctx->mem_use + pin));
+
+   usable = _mm_or_si128 (_mm_cmpeq_epi8 (u, _mm_set1_epi8 (MEM_UNKNOWN)),
+                          _mm_cmpeq_epi8 (u, _mm_set1_epi8 (MEM_DATA)));
+   zero   = _mm_cmpeq_epi8 (b, _mm_setzero_si128 ());
+
+   // signed compares: bytes with the high bit set are negative, so they
+   // fail both the printable and the letter test
+   text   = _mm_and_si128 (_mm_cmpgt_epi8 (b, _mm_set1_epi8 (0x1F)),
+                           _mm_cmplt_epi8 (b, _mm_set1_epi8 (0x7F)));
+   text   = _mm_or_si128 (text, _mm_cmpeq_epi8 (b, _mm_set1_epi8 (0x0d)));
+   text   = _mm_or_si128 (text, _mm_cmpeq_epi8 (b, _mm_set1_epi8 (0x0a)));
+   lower  = _mm_or_si128 (b, _mm_set1_epi8 (0x20));
+
+   *stop  = 0xFFFF & ~_mm_movemask_epi8 (_mm_andnot_si128 (zero, _mm_and_si128 (usable, text)));
+   *null  = _mm_movemask_epi8 (_mm_and_si128 (usable, zero));
+   *alpha = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpgt_epi8 (lower, _mm_set1_epi8 ('a'-1)),
+                                              _mm_cmplt_epi8 (lower, _mm_set1_epi8 ('z'+1))));
+#else
+   unsigned char * b = ctx->mem + pin;
+   unsigned char * u = ctx->mem_use + pin;
+   unsigned int bit;
+   int i;
+
+   *stop = *null = *alpha = 0;
+   for (i=0, bit=1; i<TEXT_BLOCK; i++, bit<<=1)
+   {
+      if ((u[i] != MEM_UNKNOWN) && (u[i] != MEM_DATA))
+         *stop |= bit;
+      else
+      if (b[i] == 0)
+      {  *stop |= bit;
+         *null |= bit;
+      }
+      else
+      if (!(text_class[b[i]] & CH_TEXT))
+         *stop |= bit;
+      if (text_class[b[i]] & CH_ALPHA)
+         *alpha |= bit;
+   }
+#endif
+}
+
+
+static int lowest_bit (unsigned int mask)
+{
+#ifdef __GNUC__
+   return __builtin_ctz (mask);
+#else
+   int n=0;
+
+   while (!(mask & 1))
+   {  mask >>= 1;
+      n++;
+   }
+   return n;
+#endif
+}
+
+
+//
+// Search for text strings and mark them with usage MEM_TEXT
+//
+// Text strings:
+//    are null terminated
+//    are 4-128 characters long
+//    don't have 8th bit set
+//    are printable or $0d or $0a
+//    have at least one alpha character
+//
+//    doesn't check from 0-0x23F. Usually there is no text there,
+//    but more importantly, we don't want to convert the text
+//    game name comments to strings (they are better printed out
+//    by dis_data).
+//
+// A string is tried from the address after the last one that stopped the
+// look (see classify), or TEXT_WINDOW bytes on if none turned up that soon.
+// A $00 4-126 bytes in ends a string, if there was a letter before it.
+// That's exactly where the old byte-at-a-time search tried and what it
+// found.
+//
+
+void search_text (lcdis_type * ctx)
+{
+   unsigned int stop, null, alpha;
+   unsigned int mask;
+   int block, limit;
+   int start;                 // where the string being looked at starts
+   int letters;               // it has a letter so far
+   int at;                    // next byte of the block to look at
+   int end, len;
+   int stringsfound=0;
+   out_printf (&ctx->out, "; Searching for text strings...");
+
+#ifndef __SSE2__
+   if (!text_class_ready)     // harmless if two threads get here at once
+      init_text_class ();
+#endif
+
+   start   = 0x240;
+   letters = 0;
+   for (block=start; block<ctx->memsize; block+=TEXT_BLOCK)
+   {
+      // blocks may read into the slack; what's past the image can't end
+      // a string there, since anything still open then runs into MEM_UNUSED
+      classify (ctx, block, &stop, &null, &alpha);
+      limit = ctx->memsize - block;
+      if (limit < TEXT_BLOCK)
+         stop &= (1u << limit) - 1;
+
+      at = 0;
+      while (1)
+      {
+         mask = stop >> at << at;
+         end  = mask ? lowest_bit (mask) : TEXT_BLOCK;
+
+         if (start + TEXT_WINDOW - block <= end)   // no end in sight: give up on it
+         {  at      = start + TEXT_WINDOW - block;
+            start  += TEXT_WINDOW;
+            letters = 0;
+            continue;
+         }
+         if (end == TEXT_BLOCK)
+            break;
+
+         if ((alpha >> at << at) & ((1u << end) - 1))
+            letters = 1;
+         len = block + end - start;               // not counting the $00
+         if ((null & (1u << end)) && (len >= 4) && (len < TEXT_WINDOW-1) && letters)
+         {  memset (ctx->mem_use + start, MEM_TEXT, len+1);
+            stringsfound++;
+         }
+         start   = block + end + 1;
+         letters = 0;
+         at      = end + 1;
+      }
+      if ((alpha >> at << at) & 0xFFFF)
+         letters = 1;
+   }
+
+   out_printf (&ctx->out, " (%d strings found)\n", stringsfound);
+}
@@ -0,0 +1,64 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, tracing the entry points
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The reset vector, the interrupt vectors, the BIOS entry points and every
+ * ENTRYn are queued up and traced here together, one after the other.
+ *
+ * They used to be traced speculatively on worker threads, each on its own
+ * copy of the maps, but the entry points share so much code that the
+ * copies and the redone traces cost far more than they saved. Threads are
+ * for --batch (batch.c), where the images have nothing in common.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lcdis.h"
+
+// Queues an entry point. header is printed just before its warnings.
+
+void queue_entry (lcdis_type * ctx, int pin, int rambank, char * header)
+{
+   entry_type * e;
+
+   if (ctx->nentries == ctx->entryroom)
+   {  ctx->entryroom = ctx->entryroom ? ctx->entryroom * 2 : 32;
+      e = (entry_type *) realloc (ctx->entries, ctx->entryroom * sizeof (entry_type));
+      if (e == NULL)
+      {  out_printf (&ctx->out, "FATAL INTERNAL ERROR: out of memory for entry points!\n");
+         out_flush (&ctx->out);
+         exit (-1);
+      }
+      ctx->entries = e;
+   }
+   e = &ctx->entries[ctx->nentries++];
+   memset (e, 0, sizeof (entry_type));
+   e->pin     = pin;
+   e->rambank = rambank;
+   snprintf (e->header, sizeof (e->header), "%s", header);
+}
+
+
+// Traces the queued entry points in order and empties the queue.
+
+void trace_entries (lcdis_type * ctx)
+{
+   int k;
+   STAT_START (start);
+
+   for (k=0; k<ctx->nentries; k++)
+   {
+      STAT_START (t0);
+      out_str (&ctx->out, ctx->entries[k].header);
+      mapmem (ctx, ctx->entries[k].pin, ctx->entries[k].rambank);
+      STAT_ENTRY (ctx, ctx->entries[k].pin, stats_now () - t0);
+   }
+   ctx->nentries = 0;
+   STAT_TIME (ctx, trace, start);
+}
@@ -0,0 +1,361 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, synthetic image generator
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Makes VMU images for lcdisbench that exercise one part of lcdis each:
+ *
+ *    straight.vms   long runs of ordinary instructions
+ *    calls.vms      a call chain thousands of calls deep
+ *    branches.vms   a conditional branch every other instruction
+ *    data.vms       a little code, then text strings and graphics
+ *    flash.bin      a 128K flash dump: LDF/STF code, upper 64K of data
+ *    noise.bin      a 128K flash dump of random bytes after the vectors,
+ *                   with a call to an instruction at $FFFE
+ *
+ * Except in noise.bin, every instruction comes from op[] (through
+ * decode[]), and every branch lands on the start of an instruction, so the
+ * whole image traces cleanly from the reset and interrupt vectors.
+ * noise.bin is the opposite: code that runs anywhere, including off the
+ * end of the 64K address space.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lcdis.h"
+
+#define OP_NOP        0x00
+#define OP_BR         0x01     // BR r8
+#define OP_CALLF      0x20     // CALLF a16
+#define OP_JMPF       0x21     // JMPF a16
+#define OP_MOV        0x23     // MOV #i8,d9 (d9 >= $100)
+#define OP_BE         0x31     // BE #i8,r8
+#define OP_BNE        0x41     // BNE #i8,r8
+#define OP_LDF        0x50
+#define OP_STF        0x51
+#define OP_LDC        0xC1
+#define OP_BZ         0x80     // BZ r8
+#define OP_BNZ        0x90     // BNZ r8
+#define OP_RET        0xA0
+#define OP_RETI       0xB0
+
+#define SFR_ACC       0x00     // $100
+#define SFR_TRL       0x04     // $104
+#define SFR_TRH       0x05     // $105
+#define SFR_FLASHA16  0x54     // $154
+
+#define CODE_START    0x680    // after the header and one icon
+
+typedef struct
+{
+   unsigned char * mem;
+   int    size;                // bytes in the image
+   int    pin;                 // where the next instruction goes
+   int *  starts;              // instruction starts in the current run
+   int    nstarts;
+} image_type;
+
+static unsigned int seed = 12345;
+
+
+static int rnd (int n)
+{
+   seed = seed * 1103515245u + 12345u;
+   return (int) ((seed >> 8) % (unsigned int) n);
+}
+
+
+// An ordinary instruction (one that just goes on to the next) at the end
+// of the image, with random operands.
+
+static void plain (image_type * m)
+{
+   decode_type * d;
+   int opcode, i;
+
+   do
+   {  opcode = rnd (256);
+      d = &decode[opcode];
+   } while ((d->flow != FLOW_NEXT) || (d->operand == '!')
+            || (opcode == OP_LDF) || (opcode == OP_STF));
+
+   m->starts[m->nstarts++] = m->pin;
+   m->mem[m->pin] = opcode;
+   for (i=1; i<d->len; i++)
+      m->mem[m->pin+i] = rnd (256);
+   if ((opcode == 0xB8) && (m->mem[m->pin+1] == 0x0D))
+      m->mem[m->pin+1] = 0x0C;          // not NOT1 EXT,0 (a firmware call)
+   m->pin += d->len;
+}
+
+
+static void emit (image_type * m, int b0, int b1, int b2, int len)
+{
+   m->starts[m->nstarts++] = m->pin;
+   m->mem[m->pin] = b0;
+   if (len > 1)
+      m->mem[m->pin+1] = b1;
+   if (len > 2)
+      m->mem[m->pin+2] = b2;
+   m->pin += len;
+}
+
+
+static void emit_a16 (image_type * m, int opcode, int addr)
+{
+   emit (m, opcode, addr >> 8, addr & 0xFF, 3);
+}
+
+
+// An instruction start in the current run that an r8 relative to 'from'
+// can reach, or -1.
+
+static int near_start (image_type * m, int from)
+{
+   int lo, hi, k, tries;
+
+   for (lo=0; (lo < m->nstarts) && (m->starts[lo] < from - 120); lo++)
+      ;
+   for (hi=lo; (hi < m->nstarts) && (m->starts[hi] < from + 120); hi++)
+      ;
+   for (tries=0; tries<8; tries++)
+   {  k = lo + rnd (hi - lo);
+      if ((m->starts[k] - from >= -128) && (m->starts[k] - from <= 127))
+         return m->starts[k];
+   }
+   return -1;
+}
+
+
+// Vectors: reset jumps to CODE_START, interrupts just return.
+// Header: 16+32 bytes of name, one icon.
+
+static void vectors (image_type * m)
+{
+   int v;
+
+   m->pin = 0;
+   emit_a16 (m, OP_JMPF, CODE_START);
+   for (v=0x03; v<=0x4b; v+=8)
+   {  m->pin = v;
+      emit (m, OP_RETI, 0, 0, 1);
+   }
+   memcpy (m->mem + 0x200, "SYNTHETIC IMAGE SYNTHETIC VMU IMAGE FOR LCDISBENCH", 48);
+   m->mem[0x240] = 1;
+   for (v=0x280; v<0x480; v++)
+      m->mem[v] = rnd (256);
+   m->pin = CODE_START;
+   m->nstarts = 0;
+}
+
+
+// Long runs of ordinary code, a forward BR every so often, then RET.
+
+static void make_straight (image_type * m, int end)
+{
+   int skip, i;
+
+   while (m->pin < end - 16)
+   {
+      plain (m);
+      if (rnd (64) == 0)
+      {  skip = rnd (4) + 1;
+         emit (m, OP_BR, 0, 0, 2);
+         m->mem[m->pin-1] = skip;
+         for (i=0; i<skip; i++)
+            m->mem[m->pin++] = OP_NOP;    // skipped over, never traced
+         m->nstarts = 0;                  // nothing before the gap is a target
+      }
+   }
+   emit (m, OP_RET, 0, 0, 1);
+}
+
+
+// Function k: a few instructions, CALLF function k+1, a few more, RET.
+
+static void make_calls (image_type * m, int end)
+{
+   int i, call;
+
+   while (m->pin < end - 24)
+   {
+      for (i=rnd (4); i; i--)
+         plain (m);
+      call = m->pin;
+      emit_a16 (m, OP_CALLF, 0);
+      plain (m);
+      emit (m, OP_RET, 0, 0, 1);
+      m->mem[call+1] = m->pin >> 8;      // function k+1 starts right here
+      m->mem[call+2] = m->pin & 0xFF;
+   }
+   emit (m, OP_RET, 0, 0, 1);
+}
+
+
+// Conditional branches (BZ, BNZ, BE, BNE) to nearby instructions, with one
+// ordinary instruction between them.
+
+static void make_branches (image_type * m, int end)
+{
+   int pin, target, kind;
+
+   while (m->pin < end - 8)
+   {
+      plain (m);
+      pin = m->pin;
+      kind = rnd (4);
+      if (kind < 2)
+      {  emit (m, kind ? OP_BNZ : OP_BZ, 0, 0, 2);
+         target = near_start (m, pin + 2);
+         m->mem[pin+1] = (target < 0) ? 0 : (target - (pin + 2)) & 0xFF;
+      }
+      else
+      {  emit (m, (kind == 2) ? OP_BE : OP_BNE, rnd (256), 0, 3);
+         target = near_start (m, pin + 3);
+         m->mem[pin+2] = (target < 0) ? 0 : (target - (pin + 3)) & 0xFF;
+      }
+   }
+   emit (m, OP_RET, 0, 0, 1);
+}
+
+
+// NUL-terminated strings from 'from' to 'end'.
+
+static void make_text (image_type * m, int from, int end)
+{
+   static const char * words[] =
+      { "PRESS", "START", "GAME", "OVER", "SCORE", "LEVEL", "VMU", "A", "B", "HI" };
+   int pin = from;
+   int n;
+
+   while (pin < end - 40)
+   {  for (n = rnd (6) + 1; n; n--)
+      {  pin += sprintf ((char *) m->mem + pin, "%s", words[rnd (10)]);
+         m->mem[pin++] = ' ';
+      }
+      m->mem[pin++] = 0;
+   }
+}
+
+
+// Loads and stores of flash, each after setting up FLASHA16, TRH and TRL.
+// The first LDF is followed by an LDC: ACC is unknown after the LDF, so
+// the listing must show the table at $0310 without a "+$05".
+
+static void make_flash (image_type * m, int end)
+{
+   emit (m, OP_MOV, SFR_ACC, 0x05, 3);
+   emit (m, OP_MOV, SFR_TRL, 0x10, 3);
+   emit (m, OP_MOV, SFR_TRH, 0x03, 3);
+   emit (m, OP_LDF, 0, 0, 1);
+   emit (m, OP_LDC, 0, 0, 1);
+   while (m->pin < end - 16)
+   {
+      emit (m, OP_MOV, SFR_FLASHA16, rnd (2), 3);
+      emit (m, OP_MOV, SFR_TRH, rnd (256), 3);
+      emit (m, OP_MOV, SFR_TRL, rnd (256), 3);
+      emit (m, rnd (4) ? OP_LDF : OP_STF, 0, 0, 1);
+      plain (m);
+   }
+   emit (m, OP_RET, 0, 0, 1);
+}
+
+
+static int write_image (char * dir, char * name, image_type * m)
+{
+   char path[4096];
+   int fd, n;
+
+   snprintf (path, sizeof (path), "%s/%s", dir, name);
+   if ((fd = open (path, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0)
+   {  fprintf (stderr, "vmugen: can not create %s\n", path);
+      return 1;
+   }
+   n = write (fd, m->mem, m->size);
+   close (fd);
+   if (n != m->size)
+   {  fprintf (stderr, "vmugen: can not write %s\n", path);
+      return 1;
+   }
+   printf ("vmugen: %s (%d bytes)\n", path, m->size);
+   return 0;
+}
+
+
+static void clear (image_type * m, int size)
+{
+   memset (m->mem, 0, 0x20000 + 16);
+   m->size = size;
+   vectors (m);
+}
+
+
+int main (int argc, char * argv[])
+{
+   image_type m;
+   int failed=0;
+
+   if (argc < 2)
+   {  printf ("vmugen outputdir [seed]\n"
+              "  writes straight.vms, calls.vms, branches.vms, data.vms, flash.bin\n"
+              "  and noise.bin\n");
+      return 1;
+   }
+   if (argc > 2)
+      seed = atoi (argv[2]);
+   mkdir (argv[1], 0777);      // fine if it's already there
+
+   init_decode ();
+   m.mem    = (unsigned char *) malloc (0x20000 + 16);
+   m.starts = (int *) malloc (0x20000 * sizeof (int));
+   if (!m.mem || !m.starts)
+   {  fprintf (stderr, "vmugen: out of memory\n");
+      return 1;
+   }
+
+   clear (&m, 0x10000);
+   make_straight (&m, 0x10000);
+   failed |= write_image (argv[1], "straight.vms", &m);
+
+   clear (&m, 0x10000);
+   make_calls (&m, 0x10000);
+   failed |= write_image (argv[1], "calls.vms", &m);
+
+   clear (&m, 0x10000);
+   make_branches (&m, 0x10000);
+   failed |= write_image (argv[1], "branches.vms", &m);
+
+   clear (&m, 0x10000);
+   make_straight (&m, 0x1000);
+   make_text (&m, 0x1000, 0x9000);
+   for (m.pin=0x9000; m.pin<0x10000; m.pin++)    // graphics-like noise
+      m.mem[m.pin] = rnd (256);
+   failed |= write_image (argv[1], "data.vms", &m);
+
+   clear (&m, 0x20000);
+   make_flash (&m, 0x10000);
+   for (m.pin=0x10000; m.pin<0x20000; m.pin++)
+      m.mem[m.pin] = rnd (256);
+   failed |= write_image (argv[1], "flash.bin", &m);
+
+   clear (&m, 0x20000);
+   for (m.pin=CODE_START; m.pin<0x20000; m.pin++)
+      m.mem[m.pin] = rnd (256);
+   m.pin = CODE_START;
+   emit_a16 (&m, OP_CALLF, 0xFFFE);
+   m.pin = 0xFFFE;
+   emit (&m, OP_MOV, SFR_ACC, 0, 3);    // operands at $10000-$10001
+   failed |= write_image (argv[1], "noise.bin", &m);
+
+   free (m.mem);
+   free (m.starts);
+   return failed;
+}
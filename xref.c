@@ -0,0 +1,235 @@
+/*
+ * LCDIS - LC86104C/108C disassembler, cross references
+ * Copyright 1999-2000 John Maushammer  john@maushammer.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Who calls, jumps or branches to each code address, and who reads or
+ * writes each RAM/SFR address in each bank. The index is made in one pass
+ * over the traced code once mapping is done (the code as the listing
+ * shows it, so it doesn't matter whether the map was traced on several
+ * threads or came out of the cache), and each address's references are
+ * one contiguous, sorted slice of a single array:
+ *
+ *    refs of x = list[first[x] .. first[x+1]-1]
+ *
+ * With XREF, the listing puts "; xref: L0123 L0456" in front of every
+ * labeled line that something refers to.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lcdis.h"
+
+#define XREF_CODE_KEYS   0x10000           // code address
+#define XREF_DATA_KEYS   (0x200 * 4)       // data address * 4 + BNK_xxx
+#define XREF_PER_LINE    8
+
+struct xref_s
+{
+   int *        code_first;    // XREF_CODE_KEYS+1 offsets into code_list
+   xref_ref_type * code_list;
+   int *        data_first;    // XREF_DATA_KEYS+1 offsets into data_list
+   xref_ref_type * data_list;
+};
+
+
+// The references the instruction at pin makes: at most one to code and
+// one to data. *target/*data are -1 if it doesn't.
+
+static void refs_of (lcdis_type * ctx, int pin, int * target, int * tkind,
+                     int * data, int * dkind)
+{
+   decode_type * d = &decode[ctx->mem[pin]];
+
+   *target = -1;
+   switch (d->flow)
+   {
+      case FLOW_CALL:    *tkind = XREF_CALL;   *target = get_target (ctx, pin);  break;
+      case FLOW_JUMP:    *tkind = XREF_JUMP;   *target = get_target (ctx, pin);  break;
+      case FLOW_BRANCH:  *tkind = XREF_BRANCH; *target = get_target (ctx, pin);  break;
+   }
+
+   *data = -1;
+   switch (d->operand)
+   {
+      case '9':   // d9
+      case '^':   // #i8,d9
+      case 'x':   // d9,r8
+         *data = get_d9 (ctx, pin);
+         break;
+      case 'b':   // d9,b3
+      case 'r':   // d9,b3,r8
+         *data = get_d9bit (ctx, pin);
+         break;
+   }
+   *dkind = d->writes ? XREF_WRITE : XREF_READ;
+   if (*data >= 0)
+      *data = *data * 4 + (ctx->mem_bnk[pin] & 3);
+}
+
+
+// Two passes over the code: count the references to each address, then
+// drop them into place. The code is walked in address order, so every
+// address's list comes out sorted.
+
+static void fill (lcdis_type * ctx, xref_type * x, int counting)
+{
+   int pin, target, tkind, data, dkind;
+   xref_ref_type * r;
+
+   for (pin=0; (pin>=0) && (pin<ctx->memsize); pin=next_line (ctx, pin))
+   {
+      switch (ctx->mem_use[pin])
+      {
+         case MEM_CODE:
+         case MEM_CODE_LABELED:
+         case MEM_INVALID:
+            break;
+         default:
+            continue;
+      }
+      refs_of (ctx, pin, &target, &tkind, &data, &dkind);
+      if (counting)
+      {  if (target >= 0)
+            x->code_first[target+1]++;
+         if (data >= 0)
+            x->data_first[data+1]++;
+         continue;
+      }
+      if (target >= 0)
+      {  r = &x->code_list[x->code_first[target]++];
+         r->from = pin;
+         r->kind = tkind;
+         r->bnk  = ctx->mem_bnk[pin];
+      }
+      if (data >= 0)
+      {  r = &x->data_list[x->data_first[data]++];
+         r->from = pin;
+         r->kind = dkind;
+         r->bnk  = ctx->mem_bnk[pin];
+      }
+   }
+}
+
+
+// Builds (or rebuilds) ctx->xref from the maps. Call it after mapping;
+// lcdis_listing does in XREF mode.
+//
+// Returns: 0=ok
+//          1=out of memory (ctx->xref is NULL)
+
+int xref_build (lcdis_type * ctx)
+{
+   xref_type * x;
+   int i;
+
+   xref_free (ctx);
+   x = (xref_type *) calloc (1, sizeof (xref_type));
+   if (x == NULL)
+      return 1;
+   x->code_first = (int *) calloc (XREF_CODE_KEYS+1, sizeof (int));
+   x->data_first = (int *) calloc (XREF_DATA_KEYS+1, sizeof (int));
+   ctx->xref = x;
+   if (!x->code_first || !x->data_first)
+   {  xref_free (ctx);
+      return 1;
+   }
+
+   fill (ctx, x, 1);
+   for (i=0; i<XREF_CODE_KEYS; i++)      // counts -> where each list starts
+      x->code_first[i+1] += x->code_first[i];
+   for (i=0; i<XREF_DATA_KEYS; i++)
+      x->data_first[i+1] += x->data_first[i];
+
+   x->code_list = (xref_ref_type *) malloc ((x->code_first[XREF_CODE_KEYS] + 1) * sizeof (xref_ref_type));
+   x->data_list = (xref_ref_type *) malloc ((x->data_first[XREF_DATA_KEYS] + 1) * sizeof (xref_ref_type));
+   if (!x->code_list || !x->data_list)
+   {  xref_free (ctx);
+      return 1;
+   }
+
+   fill (ctx, x, 0);                     // leaves first[x] at the end of x's list,
+   for (i=XREF_CODE_KEYS; i>0; i--)      // which is where x+1's starts
+      x->code_first[i] = x->code_first[i-1];
+   x->code_first[0] = 0;
+   for (i=XREF_DATA_KEYS; i>0; i--)
+      x->data_first[i] = x->data_first[i-1];
+   x->data_first[0] = 0;
+   return 0;
+}
+
+
+void xref_free (lcdis_type * ctx)
+{
+   xref_type * x = ctx->xref;
+
+   if (x == NULL)
+      return;
+   free (x->code_first);
+   free (x->code_list);
+   free (x->data_first);
+   free (x->data_list);
+   free (x);
+   ctx->xref = NULL;
+}
+
+
+// Calls, jumps and branches to code address addr, sorted by address.
+//
+// Returns: how many (*refs points at them); 0 if none or no index
+
+int xref_code (lcdis_type * ctx, int addr, xref_ref_type ** refs)
+{
+   xref_type * x = ctx->xref;
+
+   if ((x == NULL) || (addr < 0) || (addr >= XREF_CODE_KEYS))
+      return 0;
+   *refs = &x->code_list[x->code_first[addr]];
+   return x->code_first[addr+1] - x->code_first[addr];
+}
+
+
+// Reads and writes of data address addr ($000-$1FF) by code running with
+// ram bank bnk (BNK_xxx), sorted by address.
+//
+// Returns: how many (*refs points at them); 0 if none or no index
+
+int xref_data (lcdis_type * ctx, int addr, int bnk, xref_ref_type ** refs)
+{
+   xref_type * x = ctx->xref;
+   int key;
+
+   if ((x == NULL) || (addr < 0) || (addr >= 0x200) || (bnk < 0) || (bnk > 3))
+      return 0;
+   key = addr * 4 + bnk;
+   *refs = &x->data_list[x->data_first[key]];
+   return x->data_first[key+1] - x->data_first[key];
+}
+
+
+// "; xref: L0123 L0456" before a labeled line, if anything refers to it
+
+void xref_print (lcdis_type * ctx, int pin)
+{
+   xref_ref_type * refs;
+   int n, i;
+
+   n = xref_code (ctx, pin, &refs);
+   for (i=0; i<n; i++)
+   {
+      if ((i % XREF_PER_LINE) == 0)
+      {  if (i)
+            out_char (&ctx->out, '\n');
+         out_str (&ctx->out, ctx->asmout ? "             ; xref:" : "               |              ; xref:");
+      }
+      out_str (&ctx->out, " L");
+      out_HEX (&ctx->out, refs[i].from, 4);
+   }
+   if (n)
+      out_char (&ctx->out, '\n');
+}